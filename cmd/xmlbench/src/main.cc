@@ -0,0 +1,207 @@
+#include "xml_arena_document.h"
+#include "xml_operations.h"
+#include "xml_parts.h"
+
+#include "absl/strings/str_cat.h"
+#include "pugixml.hpp"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// Roughly the shape of assets.xml
+std::string Generate(size_t size)
+{
+    std::string buffer = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<AssetList>\n  <Groups>\n";
+    buffer.reserve(size + 64 * 1024);
+    size_t guid = 100000;
+    while (buffer.size() < size) {
+        buffer += "    <Group>\n      <Name>Generated</Name>\n      <Assets>\n";
+        for (size_t i = 0; i < 100; ++i, ++guid) {
+            absl::StrAppend(&buffer,
+                            "        <Asset>\n"
+                            "          <Template>Building</Template>\n"
+                            "          <Values>\n"
+                            "            <Standard>\n"
+                            "              <GUID>",
+                            guid,
+                            "</GUID>\n"
+                            "              <Name>Asset ",
+                            guid,
+                            "</Name>\n"
+                            "              <IconFilename>data/ui/building.png</IconFilename>\n"
+                            "            </Standard>\n"
+                            "            <Cost>\n"
+                            "              <Costs>\n"
+                            "                <Item><Ingredient>1010017</Ingredient>"
+                            "<Amount>50</Amount></Item>\n"
+                            "                <Item><Ingredient>1010196</Ingredient>"
+                            "<Amount>4</Amount></Item>\n"
+                            "              </Costs>\n"
+                            "            </Cost>\n"
+                            "            <Building BuildModeRandomRotation=\"90\" />\n"
+                            "          </Values>\n"
+                            "        </Asset>\n");
+        }
+        buffer += "      </Assets>\n    </Group>\n";
+    }
+    buffer += "  </Groups>\n</AssetList>\n";
+    return buffer;
+}
+
+// What finding assets takes with a document: every GUID and where its asset is
+void Walk(pugi::xml_node node, std::vector<std::pair<std::string, ptrdiff_t>> &guids)
+{
+    for (auto child : node.children()) {
+        if (child.type() != pugi::node_element) {
+            continue;
+        }
+        if (strcmp(child.name(), "Asset") == 0) {
+            const auto guid = child.child("Values").child("Standard").child("GUID");
+            if (guid) {
+                guids.emplace_back(guid.text().get(), child.offset_debug());
+            }
+        }
+        Walk(child, guids);
+    }
+}
+
+// Merges and adds across the file, by GUID and by path
+std::string Operations(const std::vector<std::pair<std::string, ptrdiff_t>> &guids)
+{
+    std::string operations = "<ModOps>";
+    const auto  step       = std::max<size_t>(1, guids.size() / 50);
+    for (size_t i = 0; i < guids.size(); i += step) {
+        const auto &guid = guids[i].first;
+        absl::StrAppend(&operations, "<ModOp Type=\"merge\" GUID=\"", guid,
+                        "\" Path=\"/Values/Standard\"><Standard><Name>Merged</Name></Standard>"
+                        "</ModOp><ModOp Type=\"add\" Path=\"//Asset[Values/Standard/GUID='",
+                        guid, "']/Values\"><Maintenance /></ModOp><ModOp Type=\"add\" GUID=\"",
+                        guid, "\" Path=\"/Values\"><Upgrade /></ModOp>");
+    }
+    operations += "<ModOp Type=\"merge\" Path=\"//Building\"><Building Rotated=\"1\" /></ModOp>"
+                  "</ModOps>";
+    return operations;
+}
+
+template <typename Work> void Measure(const char *name, size_t bytes, const Work &work)
+{
+    const auto start = std::chrono::steady_clock::now();
+    work();
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    spdlog::info("{:<24} {:>9.1f} ms {:>9.1f} MB/s", name, seconds.count() * 1000,
+                 bytes / seconds.count() / (1024 * 1024));
+}
+} // namespace
+
+// xmlbench [file.xml | size in MB]
+// Compares finding the assets of a file with pugixml to scanning it with XmlPartIndex, then
+// parsing, patching and printing it with pugixml to doing so with XmlArenaDocument. Without a
+// file a synthetic one of the given size is used, 100 MB by default.
+int main(int argc, const char **argv)
+{
+    std::string buffer;
+    const auto  size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100;
+    if (argc > 1 && size == 0) {
+        std::ifstream file(argv[1], std::ios::binary | std::ios::ate);
+        if (!file) {
+            spdlog::error("Failed to open {}", argv[1]);
+            return -1;
+        }
+        buffer.resize(file.tellg());
+        file.seekg(0, std::ios::beg);
+        file.read(buffer.data(), buffer.size());
+    } else {
+        buffer = Generate(size * 1024 * 1024);
+    }
+    spdlog::info("{} bytes", buffer.size());
+
+    std::vector<std::pair<std::string, ptrdiff_t>> guids;
+    Measure("pugixml parse and walk", buffer.size(), [&] {
+        pugi::xml_document doc;
+        if (!doc.load_buffer(buffer.data(), buffer.size())) {
+            spdlog::error("Failed to parse");
+        }
+        Walk(doc, guids);
+        std::sort(guids.begin(), guids.end());
+    });
+
+    std::optional<XmlPartIndex> index;
+    Measure("scan", buffer.size(), [&] { index = XmlPartIndex::Scan(buffer); });
+    if (!index) {
+        spdlog::error("Failed to scan");
+        return -1;
+    }
+    const auto assets = std::count_if(index->keys.begin(), index->keys.end(),
+                                      [](const auto &entry) { return entry.key[0] == 'a'; });
+    spdlog::info("{} assets walked, {} scanned", guids.size(), assets);
+
+    std::string saved;
+    Measure("save", buffer.size(), [&] { saved = index->Save(); });
+    Measure("load", buffer.size(), [&] { index = XmlPartIndex::Load(saved); });
+    spdlog::info("{} bytes saved", saved.size());
+    if (!index) {
+        spdlog::error("Failed to load");
+        return -1;
+    }
+
+    size_t extracted = 0;
+    Measure("extract every asset", buffer.size(), [&] {
+        for (const auto &[guid, offset] : guids) {
+            extracted += index->Extract(buffer, absl::StrCat("asset:", guid)).size();
+        }
+    });
+    spdlog::info("{} bytes extracted", extracted);
+
+    auto ops_doc = std::make_shared<pugi::xml_document>();
+    ops_doc->load_string(Operations(guids).c_str());
+    auto operations = XmlOperation::GetXmlOperations(ops_doc);
+
+    auto doc = std::make_shared<pugi::xml_document>();
+    Measure("pugixml parse", buffer.size(),
+            [&] { doc->load_buffer(buffer.data(), buffer.size()); });
+    Measure("pugixml apply", buffer.size(), [&] {
+        for (auto &operation : operations) {
+            operation.Apply(doc);
+        }
+    });
+    std::string printed;
+    Measure("pugixml print", buffer.size(), [&] {
+        std::stringstream ss;
+        doc->print(ss, "", pugi::format_raw);
+        printed = ss.str();
+    });
+    doc.reset();
+
+    std::optional<XmlArenaDocument> arena;
+    Measure("arena parse", buffer.size(), [&] { arena = XmlArenaDocument::Parse(buffer); });
+    if (!arena) {
+        spdlog::error("Failed to parse into an arena");
+        return -1;
+    }
+    size_t unsupported = 0;
+    Measure("arena apply", buffer.size(), [&] {
+        for (auto &operation : operations) {
+            unsupported += !operation.Apply(*arena);
+        }
+    });
+    std::string arena_printed;
+    Measure("arena print", buffer.size(), [&] { arena_printed = arena->Print(); });
+    spdlog::info("{} ops, {} beyond the arena, outputs {}", operations.size(), unsupported,
+                 printed == arena_printed ? "match" : "differ");
+    spdlog::info("{} of {} arena selections reused", arena->CacheHits(),
+                 arena->CacheHits() + arena->CacheMisses());
+
+    return guids.size() == static_cast<size_t>(assets) && printed == arena_printed ? 0 : 1;
+}
@@ -1,23 +1,112 @@
+#include "xml_arena_document.h"
 #include "xml_operations.h"
 
 #include "absl/strings/str_cat.h"
 #include "pugixml.hpp"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <optional>
 #include <sstream>
 #include <vector>
 
+namespace
+{
+// Applies `operations` one by one, to `doc` and to an arena copy of it, and logs how each op
+// found its targets in the arena: the plan, the nodes it was estimated to visit and those it did.
+// The loader applies ops with pugixml, which has no indexes, so that is timed and only tells
+// whether the path below the asset or template found the targets or the whole path had to.
+void Explain(std::shared_ptr<pugi::xml_document> doc, const std::string &buffer,
+             std::vector<XmlOperation> &operations)
+{
+    auto arena = XmlArenaDocument::Parse(buffer);
+    if (!arena) {
+        spdlog::error("Failed to parse into an arena, nothing to explain");
+    }
+    spdlog::info("Plans and visits are of the arena backend, the loader's pugixml is timed and "
+                 "shows its lookup");
+
+    const auto label = [](const XmlPlan &plan) {
+        return plan.pugixml ? "pugixml" : XmlPlan::Name(plan.kind);
+    };
+    struct Row {
+        size_t  op;
+        XmlPlan       plan;
+        size_t        visits;
+        double        pugixml_ms;
+        XmlPlan::Kind pugixml_lookup;
+    };
+    const auto apply = [&](XmlOperation &operation) {
+        const auto start = std::chrono::steady_clock::now();
+        operation.Apply(doc);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+    };
+    std::vector<Row> rows;
+    // Of the arenas replaced so far
+    size_t hits   = 0;
+    size_t misses = 0;
+    for (size_t i = 0; i < operations.size(); ++i) {
+        auto &operation = operations[i];
+        if (arena) {
+            auto       plan   = operation.Explain(*arena);
+            const auto before = arena->Visits();
+            const bool done   = operation.Apply(*arena);
+            const auto visits = arena->Visits() - before;
+            const auto ms     = apply(operation);
+            rows.push_back({i, std::move(plan), visits, ms, operation.LastLookup()});
+            const auto &row = rows.back();
+            spdlog::info("EXPLAIN #{:<4} {:<14} est {:>9} visited {:>9} pugixml {:>8.3f} ms {:<14} "
+                         "{}",
+                         i, label(row.plan), row.plan.estimated_visits,
+                         row.plan.pugixml ? "-" : std::to_string(row.visits), row.pugixml_ms,
+                         XmlPlan::Name(row.pugixml_lookup), row.plan.path);
+            if (!done) {
+                // pugixml applied it alone, start over from its result
+                std::stringstream ss;
+                doc->print(ss, "", pugi::format_raw);
+                hits += arena->CacheHits();
+                misses += arena->CacheMisses();
+                arena = XmlArenaDocument::Parse(ss.str());
+            }
+        } else {
+            operation.Apply(doc);
+        }
+    }
+
+    // By what they cost the loader
+    std::sort(rows.begin(), rows.end(),
+              [](const Row &a, const Row &b) { return a.pugixml_ms > b.pugixml_ms; });
+    for (size_t i = 0; i < rows.size() && i < 5; ++i) {
+        spdlog::info("Most expensive #{}: {} ({:.3f} ms with pugixml by {}, arena plan: {})",
+                     rows[i].op, rows[i].plan.path, rows[i].pugixml_ms,
+                     XmlPlan::Name(rows[i].pugixml_lookup), label(rows[i].plan));
+    }
+    if (arena) {
+        hits += arena->CacheHits();
+        misses += arena->CacheMisses();
+    }
+    spdlog::info("{} of {} selections reused ({:.1f}%)", hits, hits + misses,
+                 hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
+} // namespace
+
+// xmltest <game file> <patch file> [--explain]
+// Writes the patched game file to patched.xml. With --explain every op logs how it found its
+// targets and how many nodes that took.
 int main(int argc, const char **argv)
 {
     if (argc < 3) {
         // TODO(alexander): Print usage
         return -1;
     }
+    const bool explain = argc > 3 && strcmp(argv[3], "--explain") == 0;
 
-    spdlog::set_level(spdlog::level::debug);
+    spdlog::set_level(explain ? spdlog::level::info : spdlog::level::debug);
 
     std::ifstream   file(argv[1], std::ios::binary | std::ios::ate);
     std::streamsize size = file.tellg();
@@ -31,8 +120,10 @@ int main(int argc, const char **argv)
     }
 
     auto operations = XmlOperation::GetXmlOperationsFromFile(argv[2]);
-    for (auto &&operation : operations) {
-        operation.Apply(doc);
+    if (explain) {
+        Explain(doc, buffer, operations);
+    } else {
+        XmlOperation::ApplyAll(doc, operations);
     }
 
     struct xml_string_writer : pugi::xml_writer {
@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <functional>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <cstring>
 
@@ -33,4 +34,6 @@ struct fs_equal_to {
 };
 
 template<typename T>
-using PathMap = std::unordered_map<fs::path, T, fs_hash, fs_equal_to>;
\ No newline at end of file
+using PathMap = std::unordered_map<fs::path, T, fs_hash, fs_equal_to>;
+
+using PathSet = std::unordered_set<fs::path, fs_hash, fs_equal_to>;
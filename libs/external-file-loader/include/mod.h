@@ -5,12 +5,15 @@
 #include <unordered_map>
 
 #include "fs.h"
+#include "mod_listing.h"
 
 class Mod
 {
   public:
     Mod() = default;
     explicit Mod(const fs::path &root);
+    // `root` has to be canonical, `listing` is relative to it
+    Mod(const fs::path &root, const ModListing &listing);
 
     std::string Name() const;
     bool        HasFile(const fs::path &file) const;
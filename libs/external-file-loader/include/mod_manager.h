@@ -2,8 +2,8 @@
 
 #include "mod.h"
 #include "fs.h"
-
-#include "nlohmann/json.hpp"
+#include "path_index.h"
+#include "snapshot_ptr.h"
 
 #include <Windows.h>
 
@@ -11,6 +11,7 @@
 #include <condition_variable>
 #include <filesystem>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <thread>
@@ -18,6 +19,12 @@
 
 namespace fs = std::filesystem;
 
+class ChangeQueue;
+class DirectoryWatcher;
+class DomCheckpoints;
+class FingerprintCache;
+class LayerStore;
+
 class ModManager
 {
   public:
@@ -26,13 +33,17 @@ class ModManager
         static ModManager instance;
         return instance;
     }
+    // Patched outputs are immutable and shared, handing them out never copies the data
+    using Buffer = std::shared_ptr<const std::string>;
+
     struct File {
-        size_t      size;
-        bool        is_patched = false;
-        std::string data;
-        fs::path    disk_path;
+        size_t   size;
+        bool     is_patched = false;
+        Buffer   data;
+        fs::path disk_path;
     };
 
+    ModManager();
     ~ModManager();
 
     void Shutdown();
@@ -40,13 +51,17 @@ class ModManager
     static fs::path GetModsDirectory();
     static fs::path GetCacheDirectory();
     static fs::path GetDummyPath();
+    static fs::path GetGameDirectory();
+    static fs::path GetGameExecutablePath();
     static void     EnsureDummy();
 
     bool                            IsFileModded(const fs::path& path) const;
-    const File&                     GetModdedFileInfo(const fs::path& path) const;
+    File                            GetModdedFileInfo(const fs::path& path) const;
     void                            GameFilesReady();
-    Mod&                            Create(const fs::path& path);
     void                            LoadMods();
+    // Rescans only the mods touched by `changes` (paths relative to the mods directory) and
+    // returns the game paths that have to be patched and reloaded again
+    PathSet                         ReloadMods(const std::vector<fs::path>& changes);
     const std::vector<std::string>& GetPythonScripts() const;
 
     static std::string ReadGameFile(fs::path path);
@@ -58,70 +73,55 @@ class ModManager
     bool IsIncludeFile(const fs::path& file) const;
     bool IsPythonStartScript(const fs::path& file) const;
     void CollectPatchableFiles();
+    static std::vector<fs::path> FindModRoots();
+    static std::vector<Mod>      ScanMods(const std::vector<fs::path>& mod_roots,
+                                          const std::vector<Mod>&      previous_mods,
+                                          const PathSet&               changed_mods);
+    void BuildPathIndex();
+    void PublishSnapshot();
     void StartWatchingFiles();
+    // GameFilesReady without taking reload_mx_
+    void StartPatching();
     void WaitModsReady() const;
-    Mod& GetModContainingFile(const fs::path& file);
+    const Mod& GetModContainingFile(const fs::path& file) const;
+
+    std::string GetDataHash(const std::string& data) const;
+    std::string GetGameDataHash() const;
 
-    // Cache system stuff
-    // This should be moved into it's own class
-    struct LayerId {
-        std::string output;
-        std::string patch;
+    struct ModdedPath {
+        fs::path game_path;
+        fs::path disk_path;
+        uint32_t mod_index;
     };
 
-    std::string                GetFileHash(const fs::path& file) const;
-    std::string                GetDataHash(const std::string& data) const;
-    void                       ReadCache();
-    std::optional<std::string> CheckCacheLayer(const fs::path&    game_path,
-                                               const std::string& input_hash,
-                                               const std::string& patch_hash);
-    std::string ReadCacheLayer(const fs::path& game_path, const std::string& input_hash);
-    LayerId PushCacheLayer(const fs::path& game_path, const LayerId& last_valid_cache,
-                               const std::string& patch_file_hash, const std::string& buf,
-                               const std::string& mod_name = "");
-    void        WriteCacheInfo(const fs::path& game_path);
-
-    struct CacheLayer {
-        std::string input_hash;
-        std::string patch_hash;
-        std::string output_hash;
-        std::string layer_file;
-        std::string mod_name;
+    // What the game threads see. Built by the loading threads and never modified once published,
+    // a reload publishes a new one.
+    struct Snapshot {
+        std::shared_ptr<const std::vector<Mod>> mods;
+        PathIndex                               path_index;
+        // Indexed by path index value, empty for files that could not be loaded
+        std::vector<std::optional<File>> files;
     };
-    friend void to_json(nlohmann::json& j, const ModManager::CacheLayer& p);
-    friend void from_json(const nlohmann::json& j, ModManager::CacheLayer& p);
 
-    std::vector<Mod>                                      mods_;
+    std::shared_ptr<const std::vector<Mod>> mods_ = std::make_shared<const std::vector<Mod>>();
+    PathIndex                                             path_index_;
+    std::vector<ModdedPath>                               modded_paths_;
     std::vector<std::string>                              python_scripts_;
-    mutable std::mutex                                    file_cache_mutex_;
-    PathMap<File>                    file_cache_;
-    PathMap<std::vector<fs::path>>   modded_patchable_files_;
-    PathMap<std::vector<CacheLayer>> modded_file_cache_info_;
+    PathMap<File>                                         file_cache_;
+    SnapshotPtr<Snapshot>                                 snapshot_;
+    PathMap<std::vector<fs::path>>                        modded_patchable_files_;
+    std::unique_ptr<LayerStore>                           layer_store_;
+    std::unique_ptr<FingerprintCache>                     fingerprints_;
+    // Developer mode only, survives reloads
+    std::unique_ptr<DomCheckpoints>                       checkpoints_;
     mutable std::thread                                   patching_file_thread_;
-    mutable std::thread                                   watch_file_thread_;
-    OVERLAPPED                                            watch_file_ov_;
+    std::unique_ptr<ChangeQueue>                          change_queue_;
+    std::unique_ptr<DirectoryWatcher>                     watcher_;
     mutable std::thread                                   reload_mods_thread_;
-    std::atomic_bool                                      mods_change_wile_reload_ = false;
     mutable std::condition_variable                       mods_ready_cv_;
     mutable std::mutex                                    mods_ready_mx_;
+    // Held while a reload rebuilds the mod state and starts patching it
+    std::mutex                                            reload_mx_;
     std::atomic_bool                                      mods_ready_     = false;
     std::atomic_bool                                      shuttding_down_ = false;
 };
-
-inline void to_json(nlohmann::json& j, const ModManager::CacheLayer& p)
-{
-    j = nlohmann::json{{"input_hash", p.input_hash},
-                       {"patch_hash", p.patch_hash},
-                       {"output_hash", p.output_hash},
-                       {"layer_file", p.layer_file},
-                       {"mod_name", p.mod_name}};
-}
-
-inline void from_json(const nlohmann::json& j, ModManager::CacheLayer& p)
-{
-    j.at("input_hash").get_to(p.input_hash);
-    j.at("patch_hash").get_to(p.patch_hash);
-    j.at("output_hash").get_to(p.output_hash);
-    j.at("layer_file").get_to(p.layer_file);
-    j.at("mod_name").get_to(p.mod_name);
-}
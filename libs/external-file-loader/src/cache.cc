@@ -0,0 +1,382 @@
+#include "cache.h"
+
+#include "spdlog/spdlog.h"
+
+#define ZSTD_STATIC_LINKING_ONLY
+#include "zstd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+constexpr static auto INDEX_FILE_NAME = "index.json";
+
+// Sidecars are named after their layer. The header repeats the layer hash and the store version,
+// followed by the data: "MLSC", format version, size and text of both, all sizes uint32.
+constexpr static auto     SIDECAR_EXTENSION = ".sidecar";
+constexpr static char     SIDECAR_MAGIC[4]  = {'M', 'L', 'S', 'C'};
+constexpr static uint32_t SIDECAR_VERSION   = 1;
+
+void AppendText(std::string& data, const std::string& text)
+{
+    const auto size = static_cast<uint32_t>(text.size());
+    data.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    data.append(text);
+}
+
+bool ConsumeText(std::string_view& data, const std::string& expected)
+{
+    uint32_t size = 0;
+    if (data.size() < sizeof(size)) {
+        return false;
+    }
+    std::memcpy(&size, data.data(), sizeof(size));
+    data.remove_prefix(sizeof(size));
+    if (size != expected.size() || data.substr(0, size) != expected) {
+        return false;
+    }
+    data.remove_prefix(size);
+    return true;
+}
+} // namespace
+
+LayerStore::LayerStore(fs::path directory, std::string version)
+    : directory_(std::move(directory))
+    , version_(std::move(version))
+{
+}
+
+std::string LayerStore::TransitionKey(const std::string& input_hash,
+                                      const std::string& patch_hash)
+{
+    return input_hash + "." + patch_hash;
+}
+
+void LayerStore::Load()
+{
+    transitions_.clear();
+    ref_counts_.clear();
+    session_ = 0;
+
+    fs::create_directories(directory_);
+    const auto index_path = directory_ / INDEX_FILE_NAME;
+    if (!fs::exists(index_path)) {
+        session_ = 1;
+        return;
+    }
+
+    std::ifstream ifs(index_path);
+    try {
+        const auto& data    = nlohmann::json::parse(ifs);
+        const auto  version = data.at("version").get<std::string>();
+        session_            = data.at("session").get<uint64_t>() + 1;
+        if (version != version_) {
+            spdlog::debug("Dropping layer store because Patch Op Version mismatch {} vs {}",
+                          version, version_);
+            return;
+        }
+        for (auto&& [key, value] : data.at("transitions").items()) {
+            auto transition = value.get<Transition>();
+            if (!fs::exists(directory_ / transition.output_hash)) {
+                continue;
+            }
+            AddRef(transition.output_hash);
+            transitions_[key] = std::move(transition);
+        }
+    } catch (const nlohmann::json::exception& e) {
+        spdlog::warn("Failed to read layer store index {}", e.what());
+        transitions_.clear();
+        ref_counts_.clear();
+    }
+}
+
+void LayerStore::Save()
+{
+    nlohmann::json j;
+    j["version"]     = version_;
+    j["session"]     = session_;
+    j["transitions"] = nlohmann::json::object();
+    for (auto&& [key, transition] : transitions_) {
+        j["transitions"][key] = transition;
+    }
+    std::ofstream ofs(directory_ / INDEX_FILE_NAME);
+    ofs << j.dump(4);
+    ofs.close();
+
+    // Layers that are no longer referenced by any transition can go, their sidecars with them
+    for (auto&& file : fs::directory_iterator(directory_)) {
+        auto file_name = file.path().filename().string();
+        if (file_name == INDEX_FILE_NAME) {
+            continue;
+        }
+        if (file.path().extension() == SIDECAR_EXTENSION) {
+            file_name = file.path().stem().string();
+        }
+        if (ref_counts_.count(file_name) == 0) {
+            std::error_code ec;
+            fs::remove(file, ec);
+        }
+    }
+}
+
+std::optional<std::string> LayerStore::Lookup(const std::string& input_hash,
+                                              const std::string& patch_hash)
+{
+    if (input_hash.empty()) {
+        return {};
+    }
+
+    spdlog::debug("Check cache {} {}", input_hash, patch_hash);
+
+    auto it = transitions_.find(TransitionKey(input_hash, patch_hash));
+    if (it == transitions_.end()) {
+        return {};
+    }
+    it->second.last_used = session_;
+    return it->second.output_hash;
+}
+
+std::optional<std::string> LayerStore::LookupChain(const std::string&              input_hash,
+                                                   const std::vector<std::string>& patch_hashes)
+{
+    std::optional<std::string> current = input_hash;
+    for (const auto& patch_hash : patch_hashes) {
+        current = Lookup(*current, patch_hash);
+        if (!current) {
+            return {};
+        }
+    }
+    return current;
+}
+
+bool LayerStore::HasLayer(const std::string& output_hash) const
+{
+    return ref_counts_.count(output_hash) > 0;
+}
+
+std::string LayerStore::Read(const std::string& output_hash) const
+{
+    if (!HasLayer(output_hash)) {
+        return "";
+    }
+    return ReadLayerFile(output_hash);
+}
+
+std::string LayerStore::ReadLayerFile(const std::string& output_hash) const
+{
+    std::ifstream file(directory_ / output_hash, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return "";
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::string buffer;
+    buffer.resize(size);
+    if (file.read(buffer.data(), size)) {
+        std::string output;
+        size_t      rSize = ZSTD_getFrameContentSize(buffer.data(), buffer.size());
+        output.resize(rSize);
+        size_t dSize = ZSTD_decompress(output.data(), output.size(), buffer.data(), buffer.size());
+        output.resize(dSize);
+        return output;
+    }
+    return "";
+}
+
+void LayerStore::Push(const std::string& input_hash, const std::string& patch_hash,
+                      const std::string& output_hash, const std::string& data,
+                      const std::string& mod_name)
+{
+    spdlog::debug("PushCacheLayer {} {} {} {}", input_hash, patch_hash, output_hash, mod_name);
+
+    const auto key = TransitionKey(input_hash, patch_hash);
+    if (auto it = transitions_.find(key); it != transitions_.end()) {
+        Release(it->second.output_hash);
+        transitions_.erase(it);
+    }
+
+    if (!HasLayer(output_hash)) {
+        fs::create_directories(directory_);
+        std::ofstream ofs(directory_ / output_hash, std::ofstream::binary);
+
+        size_t const                    cBuffSize = ZSTD_compressBound(data.size());
+        static thread_local std::string CompressedBuffer;
+        CompressedBuffer.resize(cBuffSize);
+        size_t const cSize = ZSTD_compress(CompressedBuffer.data(), CompressedBuffer.size(),
+                                           data.data(), data.size(), 1);
+        CompressedBuffer.resize(cSize);
+
+        ofs.write(CompressedBuffer.data(), CompressedBuffer.size());
+        ofs.close();
+    }
+
+    AddRef(output_hash);
+    transitions_[key] = {output_hash, mod_name, session_};
+}
+
+void LayerStore::PushSidecar(const std::string& output_hash, std::string_view data)
+{
+    if (!HasLayer(output_hash)) {
+        return;
+    }
+    const auto path = directory_ / (output_hash + SIDECAR_EXTENSION);
+    if (fs::exists(path)) {
+        return;
+    }
+
+    std::string header(SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+    header.append(reinterpret_cast<const char*>(&SIDECAR_VERSION), sizeof(SIDECAR_VERSION));
+    AppendText(header, output_hash);
+    AppendText(header, version_);
+
+    // Written aside first, a sidecar that is there is complete
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream ofs(temporary, std::ofstream::binary);
+        ofs.write(header.data(), header.size());
+        ofs.write(data.data(), data.size());
+        if (!ofs) {
+            spdlog::warn("Failed to write sidecar of {}", output_hash);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temporary, path, ec);
+    if (ec) {
+        fs::remove(temporary, ec);
+    }
+}
+
+std::optional<LayerStore::Sidecar> LayerStore::ReadSidecar(const std::string& output_hash) const
+{
+    if (!HasLayer(output_hash)) {
+        return {};
+    }
+    auto file = MappedFile::Open(directory_ / (output_hash + SIDECAR_EXTENSION));
+    if (!file) {
+        return {};
+    }
+
+    auto     data    = file->Data();
+    uint32_t version = 0;
+    if (data.substr(0, sizeof(SIDECAR_MAGIC))
+            != std::string_view(SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC))
+        || data.size() < sizeof(SIDECAR_MAGIC) + sizeof(version)) {
+        return {};
+    }
+    std::memcpy(&version, data.data() + sizeof(SIDECAR_MAGIC), sizeof(version));
+    data.remove_prefix(sizeof(SIDECAR_MAGIC) + sizeof(version));
+    if (version != SIDECAR_VERSION || !ConsumeText(data, output_hash)
+        || !ConsumeText(data, version_)) {
+        spdlog::debug("Ignoring outdated sidecar of {}", output_hash);
+        return {};
+    }
+    return Sidecar{std::move(file), data};
+}
+
+void LayerStore::Trim(uint64_t max_unused_sessions)
+{
+    for (auto it = transitions_.begin(); it != transitions_.end();) {
+        if (session_ - it->second.last_used > max_unused_sessions) {
+            spdlog::debug("Dropping unused cache layer {} ({})", it->first, it->second.mod_name);
+            Release(it->second.output_hash);
+            it = transitions_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void LayerStore::AddRef(const std::string& output_hash)
+{
+    ref_counts_[output_hash] += 1;
+}
+
+void LayerStore::Release(const std::string& output_hash)
+{
+    auto it = ref_counts_.find(output_hash);
+    if (it == ref_counts_.end()) {
+        return;
+    }
+    if (--it->second == 0) {
+        ref_counts_.erase(it);
+    }
+}
+
+LayerPrefetcher::LayerPrefetcher(const LayerStore& store, size_t max_threads)
+    : store_(store)
+    , max_threads_(std::max<size_t>(max_threads, 1))
+{
+}
+
+LayerPrefetcher::~LayerPrefetcher()
+{
+    {
+        // Nobody takes them anymore, only the layers being read are waited for
+        std::lock_guard<std::mutex> lk(mutex_);
+        stopping_ = true;
+        queue_.clear();
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void LayerPrefetcher::Request(const std::string& output_hash)
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (!requested_.insert(output_hash).second) {
+            return;
+        }
+        queue_.push_back(output_hash);
+        if (workers_.size() < max_threads_) {
+            workers_.emplace_back([this]() { Work(); });
+        }
+    }
+    work_cv_.notify_one();
+}
+
+std::string LayerPrefetcher::Take(const std::string& output_hash)
+{
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        if (requested_.count(output_hash) > 0) {
+            done_cv_.wait(lk, [&] { return ready_.count(output_hash) > 0; });
+            auto data = std::move(ready_[output_hash]);
+            ready_.erase(output_hash);
+            requested_.erase(output_hash);
+            return data;
+        }
+    }
+    return store_.ReadLayerFile(output_hash);
+}
+
+void LayerPrefetcher::Work()
+{
+    for (;;) {
+        std::string output_hash;
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            work_cv_.wait(lk, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            output_hash = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        spdlog::debug("Prefetching cache layer {}", output_hash);
+        auto data = store_.ReadLayerFile(output_hash);
+
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            ready_[output_hash] = std::move(data);
+        }
+        done_cv_.notify_all();
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include "nlohmann/json.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Content addressed store for patch layers.
+// A layer is the output of applying a single patch file to an input, both identified by their
+// hash. Layers are shared between all game files and are not tied to a particular position in a
+// mod chain, so reordering, disabling or re-enabling mods can reuse every transition that was
+// computed before.
+class LayerStore
+{
+  public:
+    struct Transition {
+        std::string output_hash;
+        std::string mod_name;
+        uint64_t    last_used = 0;
+    };
+
+    // Sidecar of a layer, mapped into memory
+    struct Sidecar {
+        std::unique_ptr<MappedFile> file;
+        // Whatever was pushed, without the header
+        std::string_view data;
+    };
+
+    LayerStore(fs::path directory, std::string version);
+
+    // Reads the index and starts a new session, every Load counts as one
+    void Load();
+    void Save();
+
+    std::optional<std::string> Lookup(const std::string& input_hash,
+                                      const std::string& patch_hash);
+    // Follows `patch_hashes` from `input_hash`, marking every transition on the way as used.
+    // Empty if one of them is missing.
+    std::optional<std::string> LookupChain(const std::string&              input_hash,
+                                           const std::vector<std::string>& patch_hashes);
+    bool                       HasLayer(const std::string& output_hash) const;
+    std::string                Read(const std::string& output_hash) const;
+    void Push(const std::string& input_hash, const std::string& patch_hash,
+              const std::string& output_hash, const std::string& data,
+              const std::string& mod_name = "");
+
+    // Drop transitions that haven't been used for `max_unused_sessions` sessions.
+    // Layer files are only deleted once no transition references them anymore.
+    void Trim(uint64_t max_unused_sessions);
+
+    // Decompress a layer file without touching the index, safe to call from any thread as long as
+    // the layer isn't trimmed at the same time.
+    std::string ReadLayerFile(const std::string& output_hash) const;
+
+    // Keeps `data` (e.g. an index of the layer) next to an existing layer until the layer goes
+    void PushSidecar(const std::string& output_hash, std::string_view data);
+    // Empty if there is none or it was written for another layer or store version
+    std::optional<Sidecar> ReadSidecar(const std::string& output_hash) const;
+
+  private:
+    static std::string TransitionKey(const std::string& input_hash, const std::string& patch_hash);
+
+    void AddRef(const std::string& output_hash);
+    void Release(const std::string& output_hash);
+
+    fs::path    directory_;
+    std::string version_;
+    uint64_t    session_ = 0;
+
+    std::unordered_map<std::string, Transition> transitions_;
+    std::unordered_map<std::string, uint32_t>   ref_counts_;
+};
+
+inline void to_json(nlohmann::json& j, const LayerStore::Transition& p)
+{
+    j = nlohmann::json{
+        {"output_hash", p.output_hash}, {"mod_name", p.mod_name}, {"last_used", p.last_used}};
+}
+
+inline void from_json(const nlohmann::json& j, LayerStore::Transition& p)
+{
+    j.at("output_hash").get_to(p.output_hash);
+    j.at("mod_name").get_to(p.mod_name);
+    j.at("last_used").get_to(p.last_used);
+}
+
+// Decompresses final layers on worker threads ahead of time.
+// Layers are requested as soon as it's known which ones will be served, by the time they are
+// taken they are usually ready.
+class LayerPrefetcher
+{
+  public:
+    explicit LayerPrefetcher(const LayerStore& store,
+                             size_t            max_threads = std::thread::hardware_concurrency());
+    ~LayerPrefetcher();
+
+    void        Request(const std::string& output_hash);
+    // Blocks until the layer is decompressed, layers that weren't requested are read directly
+    std::string Take(const std::string& output_hash);
+
+  private:
+    void Work();
+
+    const LayerStore& store_;
+    size_t            max_threads_;
+
+    std::mutex                                   mutex_;
+    std::condition_variable                      work_cv_;
+    std::condition_variable                      done_cv_;
+    std::deque<std::string>                      queue_;
+    std::unordered_set<std::string>              requested_;
+    std::unordered_map<std::string, std::string> ready_;
+    std::vector<std::thread>                     workers_;
+    bool                                         stopping_ = false;
+};
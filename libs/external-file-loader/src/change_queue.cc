@@ -0,0 +1,81 @@
+#include "change_queue.h"
+
+#include <algorithm>
+
+ChangeQueue::ChangeQueue(std::chrono::milliseconds debounce, std::chrono::milliseconds max_delay,
+                         size_t max_paths)
+    : debounce_(debounce)
+    , max_delay_(std::max(max_delay, debounce))
+    , max_paths_(max_paths)
+{
+}
+
+void ChangeQueue::MarkPending()
+{
+    const auto now = Clock::now();
+    if (paths_.empty() && !full_) {
+        first_change_ = now;
+    }
+    last_change_ = now;
+}
+
+void ChangeQueue::Push(fs::path path)
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        MarkPending();
+        if (full_) {
+            // Everything gets reloaded anyway
+        } else if (paths_.size() >= max_paths_) {
+            // Too much going on to track individual files
+            paths_.clear();
+            full_ = true;
+        } else {
+            paths_.insert(std::move(path).lexically_normal());
+        }
+    }
+    cv_.notify_all();
+}
+
+void ChangeQueue::PushOverflow()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        MarkPending();
+        paths_.clear();
+        full_ = true;
+    }
+    cv_.notify_all();
+}
+
+std::optional<ChangeQueue::Batch> ChangeQueue::Wait()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    for (;;) {
+        cv_.wait(lk, [this] { return closed_ || full_ || !paths_.empty(); });
+        if (closed_) {
+            return {};
+        }
+
+        // Quiet for long enough or we waited long enough already
+        const auto ready_at = std::min(last_change_ + debounce_, first_change_ + max_delay_);
+        if (Clock::now() >= ready_at) {
+            Batch batch;
+            batch.full = full_;
+            batch.paths.assign(paths_.begin(), paths_.end());
+            paths_.clear();
+            full_ = false;
+            return batch;
+        }
+        cv_.wait_until(lk, ready_at, [this] { return closed_; });
+    }
+}
+
+void ChangeQueue::Close()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        closed_ = true;
+    }
+    cv_.notify_all();
+}
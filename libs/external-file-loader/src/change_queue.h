@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Collects file change notifications from a directory watcher and hands them out in batches.
+// A batch is only released once no new change arrived for the debounce window (or the changes
+// have been piling up for `max_delay`), so saving in an editor or copying a whole mod results in
+// one reload. Changes that arrive while a batch is processed end up in the next batch.
+class ChangeQueue
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Batch {
+        // Relative to the watched directory, every path at most once
+        std::vector<fs::path> paths;
+        // The watcher lost track of changes, everything has to be reloaded
+        bool full = false;
+    };
+
+    ChangeQueue(std::chrono::milliseconds debounce, std::chrono::milliseconds max_delay,
+                size_t max_paths = 10000);
+
+    void Push(fs::path path);
+    // The watcher dropped events, e.g. because its buffer overflowed
+    void PushOverflow();
+
+    // Blocks until a batch is ready, returns nothing once the queue is closed
+    std::optional<Batch> Wait();
+    void                 Close();
+
+  private:
+    void MarkPending();
+
+    const std::chrono::milliseconds debounce_;
+    const std::chrono::milliseconds max_delay_;
+    const size_t                    max_paths_;
+
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    std::set<fs::path>      paths_;
+    bool                    full_   = false;
+    bool                    closed_ = false;
+    Clock::time_point       first_change_;
+    Clock::time_point       last_change_;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "change_queue.h"
+
+#include <functional>
+#include <memory>
+
+// Watches a directory tree on a background thread and pushes every change into a ChangeQueue,
+// relative to the watched root. ReadDirectoryChangesW on Windows, inotify on Linux.
+class DirectoryWatcher
+{
+  public:
+    // Returns true for paths that should not be reported
+    using Filter = std::function<bool(const fs::path&)>;
+
+    virtual ~DirectoryWatcher() = default;
+
+    // Returns nullptr if `root` can't be watched
+    static std::unique_ptr<DirectoryWatcher> Create(const fs::path& root, ChangeQueue& queue,
+                                                    Filter ignore = {});
+};
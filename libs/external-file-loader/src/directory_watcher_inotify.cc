@@ -0,0 +1,144 @@
+#if defined(__linux__)
+
+#include "directory_watcher.h"
+
+#include "spdlog/spdlog.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_FROM
+                                | IN_MOVED_TO | IN_ATTRIB;
+
+class InotifyWatcher final : public DirectoryWatcher
+{
+  public:
+    InotifyWatcher(fs::path root, ChangeQueue& queue, Filter ignore)
+        : root_(std::move(root))
+        , queue_(queue)
+        , ignore_(std::move(ignore))
+    {
+    }
+
+    ~InotifyWatcher() override
+    {
+        if (thread_.joinable()) {
+            const char stop = 0;
+            (void)!write(stop_pipe_[1], &stop, 1);
+            thread_.join();
+        }
+        for (auto fd : {fd_, stop_pipe_[0], stop_pipe_[1]}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool Start()
+    {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0 || pipe(stop_pipe_) != 0) {
+            return false;
+        }
+        if (!AddWatches({})) {
+            return false;
+        }
+        thread_ = std::thread([this]() { Run(); });
+        return true;
+    }
+
+  private:
+    // inotify is not recursive, every directory needs its own watch
+    bool AddWatches(const fs::path& relative)
+    {
+        const auto directory = relative.empty() ? root_ : root_ / relative;
+        const auto wd        = inotify_add_watch(fd_, directory.c_str(), WATCH_MASK);
+        if (wd < 0) {
+            spdlog::warn("Failed to watch {}", directory.string());
+            return false;
+        }
+        directories_[wd] = relative;
+
+        std::error_code ec;
+        for (auto&& entry : fs::directory_iterator(directory, ec)) {
+            if (entry.is_directory(ec)) {
+                AddWatches(relative / entry.path().filename());
+            }
+        }
+        return true;
+    }
+
+    void Run()
+    {
+        alignas(inotify_event) char buffer[16 * 1024];
+        pollfd                        fds[] = {{fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+        for (;;) {
+            if (poll(fds, 2, -1) < 0 || fds[1].revents != 0) {
+                return;
+            }
+            for (;;) {
+                const auto length = read(fd_, buffer, sizeof(buffer));
+                if (length <= 0) {
+                    break;
+                }
+                for (ssize_t offset = 0; offset < length;) {
+                    const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    offset += sizeof(inotify_event) + event->len;
+                    Handle(*event);
+                }
+            }
+        }
+    }
+
+    void Handle(const inotify_event& event)
+    {
+        if (event.mask & IN_Q_OVERFLOW) {
+            queue_.PushOverflow();
+            return;
+        }
+        if (event.mask & IN_IGNORED) {
+            directories_.erase(event.wd);
+            return;
+        }
+        auto it = directories_.find(event.wd);
+        if (it == directories_.end()) {
+            return;
+        }
+        const auto path = event.len > 0 ? it->second / event.name : it->second;
+        if (path.empty() || (ignore_ && ignore_(path))) {
+            return;
+        }
+        if ((event.mask & IN_ISDIR) && (event.mask & (IN_CREATE | IN_MOVED_TO))) {
+            AddWatches(path);
+        }
+        queue_.Push(path);
+    }
+
+    fs::path     root_;
+    ChangeQueue& queue_;
+    Filter       ignore_;
+
+    int                               fd_           = -1;
+    int                               stop_pipe_[2] = {-1, -1};
+    std::unordered_map<int, fs::path> directories_;
+    std::thread                       thread_;
+};
+} // namespace
+
+std::unique_ptr<DirectoryWatcher> DirectoryWatcher::Create(const fs::path& root,
+                                                           ChangeQueue& queue, Filter ignore)
+{
+    auto watcher = std::make_unique<InotifyWatcher>(root, queue, std::move(ignore));
+    if (!watcher->Start()) {
+        return nullptr;
+    }
+    return watcher;
+}
+
+#endif
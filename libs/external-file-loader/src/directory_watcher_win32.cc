@@ -0,0 +1,125 @@
+#include "directory_watcher.h"
+
+#include "spdlog/spdlog.h"
+
+#include <Windows.h>
+
+#include <thread>
+
+namespace
+{
+class Win32Watcher final : public DirectoryWatcher
+{
+  public:
+    Win32Watcher(fs::path root, ChangeQueue& queue, Filter ignore)
+        : root_(std::move(root))
+        , queue_(queue)
+        , ignore_(std::move(ignore))
+    {
+    }
+
+    ~Win32Watcher() override
+    {
+        if (thread_.joinable()) {
+            SetEvent(stop_event_);
+            thread_.join();
+        }
+        for (auto handle : {directory_, overlapped_.hEvent, stop_event_}) {
+            if (handle && handle != INVALID_HANDLE_VALUE) {
+                CloseHandle(handle);
+            }
+        }
+    }
+
+    bool Start()
+    {
+        directory_ = CreateFileW(root_.wstring().c_str(), FILE_LIST_DIRECTORY,
+                                 FILE_SHARE_WRITE | FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                                 OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                 NULL);
+        if (directory_ == INVALID_HANDLE_VALUE) {
+            spdlog::warn("Failed to watch {}", root_.string());
+            return false;
+        }
+        overlapped_.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        stop_event_        = CreateEvent(NULL, TRUE, FALSE, NULL);
+        thread_            = std::thread([this]() { Run(); });
+        return true;
+    }
+
+  private:
+    void Run()
+    {
+        // DWORD aligned as required by ReadDirectoryChangesW
+        static_assert(sizeof(FILE_NOTIFY_INFORMATION) % sizeof(DWORD) == 0);
+        FILE_NOTIFY_INFORMATION buffer[1024];
+
+        for (;;) {
+            ResetEvent(overlapped_.hEvent);
+            if (!ReadDirectoryChangesW(directory_, buffer, sizeof(buffer), true,
+                                       FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME
+                                           | FILE_NOTIFY_CHANGE_SIZE
+                                           | FILE_NOTIFY_CHANGE_LAST_WRITE
+                                           | FILE_NOTIFY_CHANGE_CREATION,
+                                       NULL, &overlapped_, NULL)) {
+                spdlog::warn("Watching {} failed", root_.string());
+                return;
+            }
+
+            HANDLE     events[] = {overlapped_.hEvent, stop_event_};
+            const auto result   = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+            if (result != WAIT_OBJECT_0) {
+                // The read still owns buffer and overlapped_ until it has completed, wait for
+                // that before they go away. It fails with ERROR_OPERATION_ABORTED once cancelled.
+                DWORD bytes = 0;
+                CancelIoEx(directory_, &overlapped_);
+                GetOverlappedResult(directory_, &overlapped_, &bytes, TRUE);
+                return;
+            }
+
+            DWORD bytes = 0;
+            GetOverlappedResult(directory_, &overlapped_, &bytes, FALSE);
+            if (bytes == 0) {
+                // Too many changes for the buffer, the individual changes are lost
+                queue_.PushOverflow();
+                continue;
+            }
+
+            auto* base = reinterpret_cast<const BYTE*>(buffer);
+            for (;;) {
+                const auto& info = *reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(base);
+                const fs::path path(
+                    std::wstring(info.FileName, info.FileNameLength / sizeof(wchar_t)));
+                // Added, removed, modified and both halves of a rename all just mark the path as
+                // changed, the reload compares against what it loaded before
+                if (!ignore_ || !ignore_(path)) {
+                    queue_.Push(path);
+                }
+                if (!info.NextEntryOffset) {
+                    break;
+                }
+                base += info.NextEntryOffset;
+            }
+        }
+    }
+
+    fs::path     root_;
+    ChangeQueue& queue_;
+    Filter       ignore_;
+
+    HANDLE      directory_  = INVALID_HANDLE_VALUE;
+    HANDLE      stop_event_ = NULL;
+    OVERLAPPED  overlapped_ = {};
+    std::thread thread_;
+};
+} // namespace
+
+std::unique_ptr<DirectoryWatcher> DirectoryWatcher::Create(const fs::path& root,
+                                                           ChangeQueue& queue, Filter ignore)
+{
+    auto watcher = std::make_unique<Win32Watcher>(root, queue, std::move(ignore));
+    if (!watcher->Start()) {
+        return nullptr;
+    }
+    return watcher;
+}
@@ -0,0 +1,60 @@
+#include "dom_checkpoints.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+DomCheckpoints::DomCheckpoints(size_t per_file)
+    : per_file_(per_file)
+{
+}
+
+std::shared_ptr<pugi::xml_document> DomCheckpoints::Take(const fs::path&    game_path,
+                                                         const std::string& layer_hash)
+{
+    auto file = files_.find(game_path);
+    if (file == files_.end()) {
+        return nullptr;
+    }
+    auto& checkpoints = file->second;
+    for (auto it = checkpoints.begin(); it != checkpoints.end(); ++it) {
+        if (it->layer_hash == layer_hash) {
+            spdlog::debug("Resuming {} from checkpoint {}", game_path.string(), layer_hash);
+            auto document = std::move(it->document);
+            checkpoints.erase(it);
+            return document;
+        }
+    }
+    return nullptr;
+}
+
+void DomCheckpoints::Store(const fs::path& game_path, const std::string& layer_hash,
+                           const pugi::xml_document& document)
+{
+    if (per_file_ == 0) {
+        return;
+    }
+    auto& checkpoints = files_[game_path];
+    // Documents for the same layer are identical, the one we have is good enough
+    if (std::any_of(checkpoints.begin(), checkpoints.end(),
+                    [&](const auto& checkpoint) { return checkpoint.layer_hash == layer_hash; })) {
+        return;
+    }
+
+    auto copy = std::make_shared<pugi::xml_document>();
+    copy->reset(document);
+    checkpoints.push_back({layer_hash, std::move(copy)});
+    while (checkpoints.size() > per_file_) {
+        checkpoints.pop_front();
+    }
+}
+
+size_t DomCheckpoints::ConfiguredCount()
+{
+    const auto* value = std::getenv("MOD_LOADER_CHECKPOINTS");
+    if (!value) {
+        return 0;
+    }
+    return std::strtoul(value, nullptr, 10);
+}
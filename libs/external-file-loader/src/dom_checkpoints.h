@@ -0,0 +1,40 @@
+#pragma once
+
+#include "pugixml.hpp"
+
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Parsed documents of recent cache layers, kept around in developer mode.
+// When a patch file is edited the chain resumes from the layer right before it, taking that
+// layer's document is a lot cheaper than reading, decompressing and parsing it again.
+class DomCheckpoints
+{
+  public:
+    explicit DomCheckpoints(size_t per_file);
+
+    // Hands out the document for `layer_hash` without copying it, nullptr if it is not kept.
+    // It is not kept anymore afterwards, whoever patches it has to store it again.
+    std::shared_ptr<pugi::xml_document> Take(const fs::path&    game_path,
+                                             const std::string& layer_hash);
+    // Keeps a copy of `document`, dropping the oldest checkpoint of `game_path` if needed
+    void Store(const fs::path& game_path, const std::string& layer_hash,
+               const pugi::xml_document& document);
+
+    // Number of checkpoints per file requested through MOD_LOADER_CHECKPOINTS, 0 if disabled
+    static size_t ConfiguredCount();
+
+  private:
+    struct Checkpoint {
+        std::string                         layer_hash;
+        std::shared_ptr<pugi::xml_document> document;
+    };
+
+    size_t                                     per_file_;
+    std::map<fs::path, std::deque<Checkpoint>> files_;
+};
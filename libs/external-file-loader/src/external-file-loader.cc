@@ -38,9 +38,10 @@ bool       ReadFileFromContainer(__int64 archive_file_map, const std::wstring& f
         spdlog::debug(L"Read Modded File From Container {} {}", mapped_path.wstring(),
                       *output_data_size);
 #endif
-        auto info = ModManager::instance().GetModdedFileInfo(mapped_path);
+        const auto& info = ModManager::instance().GetModdedFileInfo(mapped_path);
         if (info.is_patched) {
-            memcpy(*output_data_pointer, info.data.data(), info.data.size());
+            const auto data = info.data;
+            memcpy(*output_data_pointer, data->data(), data->size());
         } else {
             // This is not a file that we can patch
             // Just load it from disk
@@ -71,7 +72,7 @@ inline size_t GetFileSize(fs::path m)
     if (ModManager::instance().IsFileModded(mapped_path)) {
         const auto& info = ModManager::instance().GetModdedFileInfo(mapped_path);
         if (info.is_patched) {
-            size = info.data.size();
+            size = info.data->size();
         } else {
             // This is not a file that we can patch
             // Just load it from disk
@@ -114,7 +115,7 @@ inline bool FileGetSize(uintptr_t a1, std::wstring& file_path, size_t* output_si
     if (ModManager::instance().IsFileModded(mapped_path)) {
         const auto& info = ModManager::instance().GetModdedFileInfo(mapped_path);
         if (info.is_patched) {
-            *output_size = info.data.size();
+            *output_size = info.data->size();
         } else {
             // This is not a file that we can patch
             // Just load it from disk
@@ -204,7 +205,8 @@ uint64_t ReadGameFile(anno::rdsdk::CFile* file, LPVOID lpBuffer, DWORD nNumberOf
     if (ModManager::instance().IsFileModded(mapped_path)) {
         const auto& info = ModManager::instance().GetModdedFileInfo(mapped_path);
         if (info.is_patched) {
-            auto    current_offset = file->offset;
+            const auto data           = info.data;
+            auto       current_offset = file->offset;
             int64_t bytes_left_in_buffer_read_count = 0;
 
             if (file->size != current_offset) {
@@ -225,10 +227,10 @@ uint64_t ReadGameFile(anno::rdsdk::CFile* file, LPVOID lpBuffer, DWORD nNumberOf
 #endif
 
             if (bytes_left_in_buffer_read_count) {
-                if (info.data.size() - file->offset < bytes_left_in_buffer_read_count) {
-                    bytes_left_in_buffer_read_count = info.data.size() - file->offset;
+                if (data->size() - file->offset < bytes_left_in_buffer_read_count) {
+                    bytes_left_in_buffer_read_count = data->size() - file->offset;
                 }
-                memcpy(lpBuffer, info.data.data() + file->offset, bytes_left_in_buffer_read_count);
+                memcpy(lpBuffer, data->data() + file->offset, bytes_left_in_buffer_read_count);
                 file->offset += bytes_left_in_buffer_read_count;
             }
 
@@ -0,0 +1,114 @@
+#include "fingerprint.h"
+
+#include "spdlog/spdlog.h"
+
+#include <fstream>
+
+FingerprintCache::FingerprintCache(fs::path state_file, std::string version, DataHasher hasher)
+    : state_file_(std::move(state_file))
+    , version_(std::move(version))
+    , hasher_(std::move(hasher))
+{
+}
+
+void FingerprintCache::Load()
+{
+    files_.clear();
+    chains_.clear();
+    seen_files_.clear();
+
+    if (!fs::exists(state_file_)) {
+        return;
+    }
+
+    std::ifstream ifs(state_file_);
+    try {
+        const auto& data = nlohmann::json::parse(ifs);
+        if (data.at("version").get<std::string>() != version_) {
+            return;
+        }
+        files_  = data.at("files").get<std::unordered_map<std::string, FileEntry>>();
+        chains_ = data.at("chains").get<std::unordered_map<std::string, ChainEntry>>();
+    } catch (const nlohmann::json::exception& e) {
+        spdlog::warn("Failed to read fingerprints {}", e.what());
+        files_.clear();
+        chains_.clear();
+    }
+}
+
+void FingerprintCache::Save()
+{
+    nlohmann::json j;
+    j["version"] = version_;
+    j["files"]   = nlohmann::json::object();
+    for (auto&& [path, entry] : files_) {
+        // Forget about files that don't exist anymore
+        if (seen_files_.count(path) > 0) {
+            j["files"][path] = entry;
+        }
+    }
+    j["chains"] = chains_;
+
+    fs::create_directories(state_file_.parent_path());
+    std::ofstream ofs(state_file_);
+    ofs << j.dump();
+    ofs.close();
+}
+
+static int64_t GetModificationTime(const fs::path& file)
+{
+    return fs::last_write_time(file).time_since_epoch().count();
+}
+
+std::string FingerprintCache::FileHash(const fs::path& file)
+{
+    const auto key   = file.u8string();
+    const auto size  = fs::file_size(file);
+    const auto mtime = GetModificationTime(file);
+    seen_files_.insert(key);
+
+    auto& entry = files_[key];
+    if (!entry.hash.empty() && entry.size == size && entry.mtime == mtime) {
+        return entry.hash;
+    }
+
+    spdlog::debug("Hashing changed file {}", file.string());
+    std::ifstream file_stream(file, std::ios::binary);
+    std::string   buffer;
+    buffer.resize(size);
+    if (!file_stream.read(buffer.data(), size)) {
+        throw std::runtime_error("Failed to read file");
+    }
+    entry = {size, mtime, hasher_(buffer)};
+    return entry.hash;
+}
+
+std::string FingerprintCache::MetadataHash(const fs::path& file) const
+{
+    return hasher_(file.u8string() + ":" + std::to_string(fs::file_size(file)) + ":"
+                   + std::to_string(GetModificationTime(file)));
+}
+
+std::string FingerprintCache::Combine(const std::vector<std::string>& hashes) const
+{
+    std::string node;
+    for (const auto& hash : hashes) {
+        node += hash;
+        node += ';';
+    }
+    return hasher_(node);
+}
+
+std::optional<FingerprintCache::ChainEntry>
+FingerprintCache::GetChain(const std::string& game_path) const
+{
+    if (auto it = chains_.find(game_path); it != chains_.end()) {
+        return it->second;
+    }
+    return {};
+}
+
+void FingerprintCache::SetChain(const std::string& game_path, ChainEntry chain)
+{
+    chains_[game_path] = std::move(chain);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Metadata based fingerprints of the mod tree.
+// Content hashes are remembered together with the size and modification time of the file they
+// were computed from, so a file is only read and hashed again once its metadata changed.
+// Fingerprints of a whole patch chain (base game data + every patch file in load order) map
+// straight to the final output layer that was produced for it.
+class FingerprintCache
+{
+  public:
+    using DataHasher = std::function<std::string(const std::string&)>;
+
+    struct FileEntry {
+        uintmax_t   size  = 0;
+        int64_t     mtime = 0;
+        std::string hash;
+    };
+
+    // The transitions of a chain are its patch hashes, which are part of `key`, followed from
+    // `input_hash`, the original game file
+    struct ChainEntry {
+        std::string key;
+        std::string input_hash;
+        std::string output_hash;
+    };
+
+    FingerprintCache(fs::path state_file, std::string version, DataHasher hasher);
+
+    void Load();
+    void Save();
+
+    // Content hash of `file`, only reads the file if size or mtime changed
+    std::string FileHash(const fs::path& file);
+    // Hash of the size and mtime of `file`, never reads it
+    std::string MetadataHash(const fs::path& file) const;
+    // Merkle node over `hashes`, order matters
+    std::string Combine(const std::vector<std::string>& hashes) const;
+
+    std::optional<ChainEntry> GetChain(const std::string& game_path) const;
+    void                      SetChain(const std::string& game_path, ChainEntry chain);
+
+  private:
+    fs::path    state_file_;
+    std::string version_;
+    DataHasher  hasher_;
+
+    std::unordered_map<std::string, FileEntry>  files_;
+    std::unordered_map<std::string, ChainEntry> chains_;
+    std::unordered_set<std::string>             seen_files_;
+};
+
+inline void to_json(nlohmann::json& j, const FingerprintCache::FileEntry& p)
+{
+    j = nlohmann::json{{"size", p.size}, {"mtime", p.mtime}, {"hash", p.hash}};
+}
+
+inline void from_json(const nlohmann::json& j, FingerprintCache::FileEntry& p)
+{
+    j.at("size").get_to(p.size);
+    j.at("mtime").get_to(p.mtime);
+    j.at("hash").get_to(p.hash);
+}
+
+inline void to_json(nlohmann::json& j, const FingerprintCache::ChainEntry& p)
+{
+    j = nlohmann::json{
+        {"key", p.key}, {"input_hash", p.input_hash}, {"output_hash", p.output_hash}};
+}
+
+inline void from_json(const nlohmann::json& j, FingerprintCache::ChainEntry& p)
+{
+    j.at("key").get_to(p.key);
+    j.at("input_hash").get_to(p.input_hash);
+    j.at("output_hash").get_to(p.output_hash);
+}
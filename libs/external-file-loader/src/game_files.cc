@@ -0,0 +1,93 @@
+#include "game_files.h"
+
+#include "nlohmann/json.hpp"
+#include "spdlog/spdlog.h"
+
+#include <fstream>
+
+BaseFileCache::BaseFileCache(const GameFileSource& source, fs::path state_file, DataHasher hasher)
+    : source_(source)
+    , state_file_(std::move(state_file))
+    , hasher_(std::move(hasher))
+{
+}
+
+void BaseFileCache::Load()
+{
+    entries_.clear();
+    loaded_.clear();
+
+    if (!fs::exists(state_file_)) {
+        return;
+    }
+
+    std::ifstream ifs(state_file_);
+    try {
+        const auto& data = nlohmann::json::parse(ifs);
+        for (auto&& [game_path, value] : data.at("files").items()) {
+            entries_[game_path] = {value.at("identity").get<std::string>(),
+                                   value.at("hash").get<std::string>()};
+        }
+    } catch (const nlohmann::json::exception& e) {
+        spdlog::warn("Failed to read base file hashes {}", e.what());
+        entries_.clear();
+    }
+}
+
+void BaseFileCache::Save()
+{
+    nlohmann::json j;
+    j["files"] = nlohmann::json::object();
+    for (auto&& [game_path, entry] : entries_) {
+        j["files"][game_path] = {{"identity", entry.identity}, {"hash", entry.hash}};
+    }
+
+    fs::create_directories(state_file_.parent_path());
+    std::ofstream ofs(state_file_);
+    ofs << j.dump(4);
+    ofs.close();
+}
+
+bool BaseFileCache::Exists(const fs::path& game_path) const
+{
+    return source_.Identity(game_path).has_value();
+}
+
+std::string BaseFileCache::Hash(const fs::path& game_path)
+{
+    const auto identity = source_.Identity(game_path);
+    if (!identity) {
+        return "";
+    }
+
+    const auto key = game_path.generic_u8string();
+    if (auto it = entries_.find(key); it != entries_.end() && it->second.identity == *identity) {
+        return it->second.hash;
+    }
+
+    spdlog::debug("Hashing original game file {}", game_path.string());
+    auto data = source_.Read(game_path);
+    if (data.empty()) {
+        return "";
+    }
+    auto hash     = hasher_(data);
+    entries_[key] = {*identity, hash};
+    loaded_[key]  = std::move(data);
+    return hash;
+}
+
+std::string BaseFileCache::Read(const fs::path& game_path)
+{
+    const auto key = game_path.generic_u8string();
+    if (auto it = loaded_.find(key); it != loaded_.end()) {
+        auto data = std::move(it->second);
+        loaded_.erase(it);
+        return data;
+    }
+    return source_.Read(game_path);
+}
+
+void BaseFileCache::Release(const fs::path& game_path)
+{
+    loaded_.erase(game_path.generic_u8string());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// Where original game files come from, in game this is the RDA archive set.
+class GameFileSource
+{
+  public:
+    virtual ~GameFileSource() = default;
+
+    // Cheap identity of the file inside its container (archive, size, timestamps, game version).
+    // Returns nothing if the file doesn't exist.
+    virtual std::optional<std::string> Identity(const fs::path& game_path) const = 0;
+    virtual std::string                Read(const fs::path& game_path) const    = 0;
+};
+
+// Remembers the hash of original game files keyed by their container identity, so the original
+// only has to be read once a patch actually needs to be replayed on top of it.
+class BaseFileCache
+{
+  public:
+    using DataHasher = std::function<std::string(const std::string&)>;
+
+    BaseFileCache(const GameFileSource& source, fs::path state_file, DataHasher hasher);
+
+    void Load();
+    void Save();
+
+    bool        Exists(const fs::path& game_path) const;
+    std::string Hash(const fs::path& game_path);
+    // Hands out the original, data that was already read while hashing is moved out
+    std::string Read(const fs::path& game_path);
+
+    // Drop data that was read while hashing
+    void Release(const fs::path& game_path);
+
+  private:
+    struct Entry {
+        std::string identity;
+        std::string hash;
+    };
+
+    const GameFileSource& source_;
+    fs::path              state_file_;
+    DataHasher            hasher_;
+
+    std::unordered_map<std::string, Entry>       entries_;
+    std::unordered_map<std::string, std::string> loaded_;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+// Read-only view of a whole file, mapped into memory for as long as this lives.
+// MapViewOfFile on Windows, mmap everywhere else.
+class MappedFile
+{
+  public:
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    // Returns nullptr if `path` can't be opened or is empty
+    static std::unique_ptr<MappedFile> Open(const fs::path& path);
+
+    std::string_view Data() const
+    {
+        return {data_, size_};
+    }
+
+  private:
+    MappedFile() = default;
+
+    const char* data_ = nullptr;
+    size_t      size_ = 0;
+#ifdef _WIN32
+    void* mapping_ = nullptr;
+#endif
+};
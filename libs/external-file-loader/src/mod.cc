@@ -1,19 +1,18 @@
 #include "mod.h"
 
 Mod::Mod(const fs::path& root)
+    : Mod(fs::canonical(root), ModListingCache::Scan(fs::canonical(root)))
+{
+}
+
+Mod::Mod(const fs::path& root, const ModListing& listing)
     : root_path(root)
 {
-    // We have a mods directory
-    std::vector<fs::path> mod_roots;
-    for (const auto& file : fs::recursive_directory_iterator(root_path)) {
-        if (file.is_regular_file()) {
-            try {
-                const auto game_path = fs::relative(fs::canonical(file), fs::canonical(root_path));
-                file_mappings[game_path] = fs::canonical(file);
-            } catch (const fs::filesystem_error& error) {
-                // TODO(alexander): Logging
-            }
-        }
+    file_mappings.reserve(listing.files.size());
+    for (const auto& file : listing.files) {
+        auto game_path = fs::u8path(file);
+        game_path.make_preferred();
+        file_mappings[game_path] = root_path / game_path;
     }
 }
 
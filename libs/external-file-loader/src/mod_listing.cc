@@ -0,0 +1,138 @@
+#include "mod_listing.h"
+
+#include "spdlog/spdlog.h"
+
+#include <fstream>
+
+namespace
+{
+constexpr static auto LISTING_VERSION = 1;
+
+int64_t GetModificationTime(const fs::path& path, std::error_code& ec)
+{
+    return fs::last_write_time(path, ec).time_since_epoch().count();
+}
+} // namespace
+
+ModListingCache::ModListingCache(fs::path state_file)
+    : state_file_(std::move(state_file))
+{
+}
+
+void ModListingCache::Load()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    listings_.clear();
+    seen_roots_.clear();
+    rescans_ = 0;
+
+    if (!fs::exists(state_file_)) {
+        return;
+    }
+
+    std::ifstream ifs(state_file_);
+    try {
+        const auto& data = nlohmann::json::parse(ifs);
+        if (data.at("version").get<int>() != LISTING_VERSION) {
+            return;
+        }
+        listings_ = data.at("mods").get<std::unordered_map<std::string, ModListing>>();
+    } catch (const nlohmann::json::exception& e) {
+        spdlog::warn("Failed to read mod listings {}", e.what());
+        listings_.clear();
+    }
+}
+
+void ModListingCache::Save()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+
+    nlohmann::json j;
+    j["version"] = LISTING_VERSION;
+    j["mods"]    = nlohmann::json::object();
+    for (auto&& [root, listing] : listings_) {
+        // Forget about mods that were removed or disabled
+        if (seen_roots_.count(root) > 0) {
+            j["mods"][root] = listing;
+        }
+    }
+
+    fs::create_directories(state_file_.parent_path());
+    std::ofstream ofs(state_file_);
+    ofs << j.dump();
+    ofs.close();
+}
+
+ModListing ModListingCache::Get(const fs::path& root)
+{
+    const auto                key = root.u8string();
+    std::optional<ModListing> cached;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        seen_roots_.insert(key);
+        if (auto it = listings_.find(key); it != listings_.end()) {
+            cached = it->second;
+        }
+    }
+    if (cached && IsUpToDate(root, *cached)) {
+        return std::move(*cached);
+    }
+
+    spdlog::debug("Scanning mod {}", root.string());
+    auto listing = Scan(root);
+
+    std::lock_guard<std::mutex> lk(mutex_);
+    rescans_ += 1;
+    listings_[key] = listing;
+    return listing;
+}
+
+bool ModListingCache::IsUpToDate(const fs::path& root, const ModListing& listing)
+{
+    if (listing.directories.empty()) {
+        return false;
+    }
+    for (auto&& [directory, mtime] : listing.directories) {
+        std::error_code ec;
+        const auto      current = GetModificationTime(root / fs::u8path(directory), ec);
+        if (ec || current != mtime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ModListing ModListingCache::Scan(const fs::path& root)
+{
+    ModListing listing;
+
+    std::error_code ec;
+    listing.directories[""] = GetModificationTime(root, ec);
+    if (ec) {
+        spdlog::warn("Failed to scan mod {}: {}", root.string(), ec.message());
+        listing.directories.clear();
+        return listing;
+    }
+
+    // Entries are built from `root`, so the relative part is everything after it
+    const auto prefix = root.native().size() + 1;
+    for (auto it = fs::recursive_directory_iterator(root, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        const auto relative = fs::path(it->path().native().substr(prefix)).generic_u8string();
+        if (it->is_directory(ec)) {
+            listing.directories[relative] = GetModificationTime(it->path(), ec);
+        } else if (it->is_regular_file(ec)) {
+            listing.files.push_back(relative);
+        }
+        if (ec) {
+            spdlog::warn("Failed to read {}: {}", it->path().string(), ec.message());
+            ec.clear();
+        }
+    }
+    if (ec) {
+        spdlog::warn("Failed to scan mod {}: {}", root.string(), ec.message());
+        // Don't keep a listing we could not fully verify
+        listing.directories.clear();
+    }
+    return listing;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Files of a single mod, relative to its root
+struct ModListing {
+    // Every directory of the mod (including the root as "") and its modification time
+    std::unordered_map<std::string, int64_t> directories;
+    std::vector<std::string>                 files;
+};
+
+// Remembers the file listing of every mod together with the modification times of its
+// directories. Adding, removing or renaming a file touches the directory containing it, so as
+// long as no directory changed the listing can be reused without walking the mod again.
+// Get can be called from multiple threads.
+class ModListingCache
+{
+  public:
+    explicit ModListingCache(fs::path state_file);
+
+    void Load();
+    void Save();
+
+    // `root` has to be canonical already
+    ModListing Get(const fs::path& root);
+    size_t     Rescans() const
+    {
+        return rescans_;
+    }
+
+    // Walks `root` once, paths are built by joining strings and never canonicalized per file
+    static ModListing Scan(const fs::path& root);
+
+  private:
+    static bool IsUpToDate(const fs::path& root, const ModListing& listing);
+
+    fs::path state_file_;
+
+    std::mutex                                  mutex_;
+    std::unordered_map<std::string, ModListing> listings_;
+    std::unordered_set<std::string>             seen_roots_;
+    size_t                                      rescans_ = 0;
+};
+
+inline void to_json(nlohmann::json& j, const ModListing& p)
+{
+    j = nlohmann::json{{"directories", p.directories}, {"files", p.files}};
+}
+
+inline void from_json(const nlohmann::json& j, ModListing& p)
+{
+    j.at("directories").get_to(p.directories);
+    j.at("files").get_to(p.files);
+}
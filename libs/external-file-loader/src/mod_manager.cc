@@ -1,18 +1,23 @@
 #include "mod_manager.h"
 
+#include "cache.h"
+#include "change_queue.h"
+#include "directory_watcher.h"
+#include "dom_checkpoints.h"
+#include "fingerprint.h"
+#include "game_files.h"
 #include "meow_hash_x64_aesni.h"
 
 #include "anno/random_game_functions.h"
+#include "anno/rdsdk/file.h"
+#include "xml_lazy_document.h"
 #include "xml_operations.h"
+#include "xml_parts.h"
+#include "xml_sharded_document.h"
 
 #include "absl/strings/str_cat.h"
 #include "spdlog/spdlog.h"
 
-#define ZSTD_STATIC_LINKING_ONLY /* ZSTD_compressContinue, ZSTD_compressBlock */
-#include "fse.h"
-#include "zstd.h"
-// #include "zstd_errors.h" /* ZSTD_getErrorCode */
-
 // Prevent preprocess errors with boringssl
 #undef X509_NAME
 #undef X509_CERT_PAIR
@@ -21,6 +26,8 @@
 
 #include <Windows.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <optional>
 #include <sstream>
@@ -29,13 +36,39 @@
 #pragma comment(lib, "Ole32.lib")
 
 constexpr static auto PATCH_OP_VERSION = "1.17";
+// Number of game starts a cache transition may go unused before it's dropped, the layer store is
+// loaded once per start
+constexpr static uint64_t MAX_UNUSED_CACHE_SESSIONS = 5;
 
-Mod& ModManager::Create(const fs::path& root)
+namespace
 {
-    spdlog::info("Loading mod {}", root.stem().string());
-    auto& mod = this->mods_.emplace_back(root);
-    return mod;
-}
+class ArchiveGameFileSource : public GameFileSource
+{
+  public:
+    explicit ArchiveGameFileSource(std::string game_data_hash)
+        : game_data_hash_(std::move(game_data_hash))
+    {
+    }
+
+    std::optional<std::string> Identity(const fs::path& game_path) const override
+    {
+        // Looking up the size only touches the archive index
+        const auto size = anno::rdsdk::CFile::GetFileSize(game_path);
+        if (size == 0) {
+            return {};
+        }
+        return absl::StrCat(game_data_hash_, ":", size);
+    }
+
+    std::string Read(const fs::path& game_path) const override
+    {
+        return ModManager::ReadGameFile(game_path);
+    }
+
+  private:
+    std::string game_data_hash_;
+};
+} // namespace
 
 static bool IsModEnabled(fs::path path)
 {
@@ -43,35 +76,233 @@ static bool IsModEnabled(fs::path path)
     return path.stem().wstring().find(L'-') != 0;
 }
 
-void ModManager::LoadMods()
+// Opt-in, parsing only the assets that are patched keeps the formatting of the rest
+static bool IsLazyParsingEnabled()
 {
-    this->mods_.clear();
-    this->file_cache_.clear();
-    this->modded_patchable_files_.clear();
+    const auto* value = std::getenv("MOD_LOADER_LAZY_ASSETS");
+    return value && std::string_view(value) != "" && std::string_view(value) != "0";
+}
+
+static const std::pair<const wchar_t*, const wchar_t*> ALIASED_PATHS[] = {
+    {L"data/config/game/asset/assets.xml", L"data/config/export/main/asset/assets.xml"},
+    {L"data/config/game/asset/properties.xml", L"data/config/export/main/asset/properties.xml"},
+    {L"data/config/game/asset/templates.xml", L"data/config/export/main/asset/templates.xml"},
+};
 
-    auto mods_directory = ModManager::GetModsDirectory();
+std::vector<fs::path> ModManager::FindModRoots()
+{
+    std::vector<fs::path> mod_roots;
+    auto                  mods_directory = ModManager::GetModsDirectory();
     if (mods_directory.empty()) {
-        return;
+        return mod_roots;
     }
 
     // We have a mods directory
     // Now create a mod for each of these
-    std::vector<fs::path> mod_roots;
     for (auto&& root : fs::directory_iterator(mods_directory)) {
         if (root.is_directory()) {
             if (root.path().stem().wstring() == L".cache") {
                 continue;
             }
             if (IsModEnabled(root.path())) {
-                this->Create(root.path());
+                spdlog::info("Loading mod {}", root.path().stem().string());
+                std::error_code ec;
+                auto            canonical_root = fs::canonical(root.path(), ec);
+                if (!ec) {
+                    mod_roots.emplace_back(std::move(canonical_root));
+                }
             } else {
                 spdlog::info("Disabled mod {}", root.path().stem().string());
             }
         }
     }
-    if (this->mods_.empty()) {
+    if (mod_roots.empty()) {
         spdlog::info("No mods found in {}", mods_directory.string());
     }
+    return mod_roots;
+}
+
+std::vector<Mod> ModManager::ScanMods(const std::vector<fs::path>& mod_roots,
+                                      const std::vector<Mod>&      previous_mods,
+                                      const PathSet&               changed_mods)
+{
+    std::vector<Mod> mods(mod_roots.size());
+    std::vector<fs::path> scan_roots;
+    std::vector<size_t>   scan_indices;
+    for (size_t i = 0; i < mod_roots.size(); ++i) {
+        const auto previous =
+            std::find_if(begin(previous_mods), end(previous_mods),
+                         [&](const auto& mod) { return mod.Path() == mod_roots[i]; });
+        if (previous != end(previous_mods) && changed_mods.count(mod_roots[i]) == 0) {
+            mods[i] = *previous;
+        } else {
+            scan_roots.push_back(mod_roots[i]);
+            scan_indices.push_back(i);
+        }
+    }
+
+    // Unchanged mods come straight from the listing cache, the rest is scanned in parallel
+    ModListingCache listings(GetCacheDirectory() / "mod_listings.json");
+    listings.Load();
+    std::atomic_size_t next_mod = 0;
+    const auto         worker   = [&]() {
+        for (auto i = next_mod++; i < scan_roots.size(); i = next_mod++) {
+            mods[scan_indices[i]] = Mod(scan_roots[i], listings.Get(scan_roots[i]));
+        }
+    };
+    std::vector<std::thread> workers;
+    const auto               thread_count =
+        std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), scan_roots.size());
+    for (size_t i = 1; i < thread_count; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    if (scan_roots.size() == mod_roots.size()) {
+        // Only a full load sees every mod, saving after a partial one would forget the rest
+        listings.Save();
+    }
+    spdlog::debug("Scanned {} of {} mods", listings.Rescans(), mods.size());
+
+    sort(begin(mods), end(mods), [](const auto& l, const auto& r) {
+        return stricmp(l.Name().c_str(), r.Name().c_str()) < 0;
+    });
+    return mods;
+}
+
+void ModManager::LoadMods()
+{
+    // Game threads keep reading the previous snapshot until the new one is published, so the
+    // state below is free to change
+    this->file_cache_.clear();
+    this->modded_patchable_files_.clear();
+    this->path_index_.Clear();
+    this->modded_paths_.clear();
+
+    mods_ = std::make_shared<const std::vector<Mod>>(ScanMods(FindModRoots(), {}, {}));
+
+    BuildPathIndex();
+    PublishSnapshot();
+}
+
+PathSet ModManager::ReloadMods(const std::vector<fs::path>& changes)
+{
+    // Changes are relative to the mods directory, the first segment is the mod folder and the
+    // rest is the game path of the changed file
+    // Mod roots are canonical, the watcher reports the folder as it is named in the mods directory
+    // which differs for symlinks and junctions
+    PathSet    changed_mods;
+    PathSet    changed_files;
+    const auto mods_directory = GetModsDirectory();
+    for (const auto& change : changes) {
+        auto segment = change.begin();
+        if (segment == change.end()) {
+            continue;
+        }
+        std::error_code ec;
+        auto            mod_root = fs::canonical(mods_directory / *segment, ec);
+        changed_mods.insert(ec ? mods_directory / *segment : std::move(mod_root));
+        fs::path game_path;
+        for (++segment; segment != change.end(); ++segment) {
+            game_path /= *segment;
+        }
+        if (!game_path.empty()) {
+            changed_files.insert(std::move(game_path));
+        }
+    }
+
+    const auto previous_mods = mods_;
+    mods_ = std::make_shared<const std::vector<Mod>>(
+        ScanMods(FindModRoots(), *previous_mods, changed_mods));
+
+    // Files a changed mod gained or lost resolve differently now, mods that were added or
+    // removed count with all of their files
+    PathSet    dirty;
+    const auto find_mod = [](const std::vector<Mod>& mods, const fs::path& root) -> const Mod* {
+        for (const auto& mod : mods) {
+            if (mod.Path() == root) {
+                return &mod;
+            }
+        }
+        return nullptr;
+    };
+    const auto add_difference = [&](const Mod& mod, const Mod* other) {
+        mod.ForEachFile([&](const fs::path& game_path, const fs::path&) {
+            if (!other || !other->HasFile(game_path)) {
+                dirty.insert(game_path);
+            }
+        });
+    };
+    for (const auto& mod : *mods_) {
+        if (changed_mods.count(mod.Path()) > 0) {
+            add_difference(mod, find_mod(*previous_mods, mod.Path()));
+        }
+    }
+    for (const auto& mod : *previous_mods) {
+        const auto current = find_mod(*mods_, mod.Path());
+        if (!current || changed_mods.count(mod.Path()) > 0) {
+            add_difference(mod, current);
+        }
+    }
+
+    this->modded_patchable_files_.clear();
+    this->path_index_.Clear();
+    this->modded_paths_.clear();
+    BuildPathIndex();
+
+    for (const auto& game_path : changed_files) {
+        if (path_index_.Contains(game_path.native())) {
+            dirty.insert(game_path);
+        }
+    }
+
+    // Outputs of clean files stay as they are, the patch thread only fills in what is missing
+    for (const auto& game_path : dirty) {
+        file_cache_.erase(game_path);
+    }
+    PublishSnapshot();
+
+    spdlog::info("Reloading {} of {} modded files", dirty.size(), modded_paths_.size());
+    for (const auto& game_path : dirty) {
+        spdlog::debug("Dirty {}", game_path.string());
+    }
+    return dirty;
+}
+
+void ModManager::BuildPathIndex()
+{
+    // Mods are sorted by now, the last mod containing a file wins
+    for (uint32_t mod_index = 0; mod_index < mods_->size(); ++mod_index) {
+        (*mods_)[mod_index].ForEachFile([&](const fs::path& game_path, const fs::path& file_path) {
+            const auto id = path_index_.Find(game_path.native());
+            if (id == PathIndex::npos) {
+                path_index_.Insert(game_path.native(), static_cast<uint32_t>(modded_paths_.size()));
+                modded_paths_.push_back({game_path, file_path, mod_index});
+            } else {
+                modded_paths_[id].disk_path = file_path;
+                modded_paths_[id].mod_index = mod_index;
+            }
+        });
+    }
+    for (auto&& [alias, target] : ALIASED_PATHS) {
+        path_index_.Alias(alias, target);
+    }
+}
+
+void ModManager::PublishSnapshot()
+{
+    auto snapshot        = std::make_unique<Snapshot>();
+    snapshot->mods       = mods_;
+    snapshot->path_index = path_index_;
+    snapshot->files.resize(modded_paths_.size());
+    for (size_t id = 0; id < modded_paths_.size(); ++id) {
+        if (auto it = file_cache_.find(modded_paths_[id].game_path); it != file_cache_.end()) {
+            snapshot->files[id] = it->second;
+        }
+    }
+    snapshot_.Publish(std::move(snapshot));
 }
 
 const std::vector<std::string>& ModManager::GetPythonScripts() const
@@ -81,7 +312,8 @@ const std::vector<std::string>& ModManager::GetPythonScripts() const
 
 void ModManager::CollectPatchableFiles()
 {
-    for (const auto& mod : mods_) {
+    python_scripts_.clear();
+    for (const auto& mod : *mods_) {
         mod.ForEachFile([this](const fs::path& game_path, const fs::path& file_path) {
             if (IsPatchableFile(game_path)) {
                 modded_patchable_files_[game_path].emplace_back(file_path);
@@ -93,7 +325,8 @@ void ModManager::CollectPatchableFiles()
                                                + "')";
                     spdlog::info("Loading ptyhon script {}", start_script);
                     python_scripts_.emplace_back(start_script);
-                } else {
+                } else if (file_cache_.count(game_path) == 0) {
+                    // Files kept from before a reload are still up to date
                     auto hFile = CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
                                              OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
                     if (hFile != INVALID_HANDLE_VALUE) {
@@ -111,99 +344,70 @@ void ModManager::CollectPatchableFiles()
 
 void ModManager::StartWatchingFiles()
 {
-    //
-    if (this->watch_file_thread_.joinable()) {
+    // Shutdown resets the watcher from another thread
+    std::lock_guard<std::mutex> lk(mods_ready_mx_);
+    if (this->watcher_ || shuttding_down_.load()) {
+        return;
+    }
+    const auto mods_directory = ModManager::GetModsDirectory();
+    if (mods_directory.empty()) {
         return;
     }
-    this->watch_file_thread_ = std::thread([this]() {
-        const auto cache_directory = ModManager::GetModsDirectory();
-        if (cache_directory.empty()) {
-            return;
-        }
 
-        HANDLE hDir = CreateFileW(cache_directory.wstring().c_str(), FILE_LIST_DIRECTORY,
-                                  FILE_SHARE_WRITE | FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
-                                  OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
-        watch_file_ov_.OffsetHigh = 0;
-        watch_file_ov_.hEvent     = CreateEvent(NULL, TRUE, FALSE, NULL);
-
-        while (TRUE) {
-            DWORD                   BytesReturned;
-            DWORD                   bytesRet = 0;
-            FILE_NOTIFY_INFORMATION Buffer[1024];
-            memset(Buffer, 0, sizeof(Buffer));
-
-            ReadDirectoryChangesW(hDir, Buffer, sizeof(Buffer), true,
-                                  FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME
-                                      | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE
-                                      | FILE_NOTIFY_CHANGE_CREATION,
-                                  &bytesRet, &watch_file_ov_, NULL);
-            WaitForSingleObject(watch_file_ov_.hEvent, INFINITE);
-            if (shuttding_down_.load()) {
-                return;
-            }
-            bool  need_recreate_mods = false;
-            BYTE* pBase              = (BYTE*)Buffer;
-
-            for (;;) {
-                FILE_NOTIFY_INFORMATION& info = (FILE_NOTIFY_INFORMATION&)*pBase;
-                std::wstring             filename(info.FileName);
-                if (filename.find(L".cache") == 0
-                    || filename.find(L"start_script.py") != std::wstring::npos) {
-                    if (!info.NextEntryOffset) {
-                        break;
-                    }
-                    continue;
-                }
-                /* switch (info->Action) {
-                     case FILE_ACTION_ADDED:
-                         break;
-                     case FILE_ACTION_MODIFIED:
-                         break;
-                     case FILE_ACTION_REMOVED:
-                         break;
-                     case FILE_ACTION_RENAMED_NEW_NAME:
-                         break;
-                     case FILE_ACTION_RENAMED_OLD_NAME:
-                         break;
-                 }*/
-                need_recreate_mods = true;
-                if (!info.NextEntryOffset) {
-                    break;
-                }
-                pBase += info.NextEntryOffset;
-            }
+    change_queue_ = std::make_unique<ChangeQueue>(std::chrono::milliseconds(200),
+                                                  std::chrono::seconds(5));
+    const auto ignore = [](const fs::path& path) {
+        return path.native().find(L".cache") == 0
+               || path.native().find(L"start_script.py") != std::wstring::npos;
+    };
+    watcher_ = DirectoryWatcher::Create(mods_directory, *change_queue_, ignore);
+    if (!watcher_) {
+        return;
+    }
 
-            if (need_recreate_mods) {
-                if (!this->reload_mods_thread_.joinable()) {
-                    this->reload_mods_thread_ = std::thread([this]() {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(200));
-                        {
-                            std::lock_guard<std::mutex> lk(mods_ready_mx_);
-                            mods_ready_.store(false);
-                        }
+    this->reload_mods_thread_ = std::thread([this]() {
+        // Changes that come in while we reload are picked up by the next iteration
+        while (auto batch = change_queue_->Wait()) {
+            PathSet dirty;
+            {
+                // Game threads asking for files wait until patching started on the new state
+                std::lock_guard<std::mutex> reload_lk(reload_mx_);
+                {
+                    std::lock_guard<std::mutex> lk(mods_ready_mx_);
+                    mods_ready_.store(false);
+                }
 
-                        spdlog::info("Reloading mods");
-                        LoadMods();
-                        GameFilesReady();
-                        spdlog::info("Waiting for mods to finish");
-                        WaitModsReady();
-                        spdlog::info("Triggering game reload");
-                        anno::ToolOneDataHelper::ReloadData();
-                        auto tool_one_helper =
-                            *(uint64_t*)GetAddress(anno::SOME_GLOBAL_STRUCT_TOOL_ONE_HELPER_MAYBE);
-                        auto magic_wait_time = *(uint64_t*)(tool_one_helper + 0x160);
-                        magic_wait_time      = magic_wait_time;
-                        *(uint64_t*)(tool_one_helper + 0x160) -=
-                            3000; // Remove stupid 5 second wait for reload
-                        // magic_wait_time
-                        this->reload_mods_thread_.detach();
-                        this->reload_mods_thread_ = {};
-                    });
+                spdlog::info("Reloading mods");
+                if (batch->full) {
+                    spdlog::info("Too many changes to track, reloading everything");
+                    LoadMods();
                 } else {
-                    mods_change_wile_reload_.store(true);
+                    dirty = ReloadMods(batch->paths);
                 }
+                StartPatching();
             }
+            spdlog::info("Waiting for mods to finish");
+            {
+                // Patching stops early on shutdown, the mods never get ready then
+                std::unique_lock<std::mutex> lk(mods_ready_mx_);
+                mods_ready_cv_.wait(
+                    lk, [this] { return mods_ready_.load() || shuttding_down_.load(); });
+            }
+            if (shuttding_down_.load()) {
+                return;
+            }
+            if (!batch->full && dirty.empty()) {
+                spdlog::info("No modded files changed, skipping game reload");
+                continue;
+            }
+            spdlog::info("Triggering game reload");
+            anno::ToolOneDataHelper::ReloadData();
+            auto tool_one_helper =
+                *(uint64_t*)GetAddress(anno::SOME_GLOBAL_STRUCT_TOOL_ONE_HELPER_MAYBE);
+            auto magic_wait_time = *(uint64_t*)(tool_one_helper + 0x160);
+            magic_wait_time      = magic_wait_time;
+            *(uint64_t*)(tool_one_helper + 0x160) -= 3000; // Remove stupid 5 second wait for reload
+            // magic_wait_time
         }
     });
 }
@@ -215,9 +419,9 @@ void ModManager::WaitModsReady() const
     this->mods_ready_cv_.wait(lk, [this] { return this->mods_ready_.load(); });
 }
 
-Mod& ModManager::GetModContainingFile(const fs::path& file)
+const Mod& ModManager::GetModContainingFile(const fs::path& file) const
 {
-    for (auto& mod : mods_) {
+    for (const auto& mod : *mods_) {
         if (file.lexically_normal().generic_string().find(
                 mod.Path().lexically_normal().generic_string())
             == 0) {
@@ -229,172 +433,6 @@ Mod& ModManager::GetModContainingFile(const fs::path& file)
     return null_mod;
 }
 
-void ModManager::ReadCache()
-{
-    const auto cache_directory = ModManager::GetCacheDirectory();
-    for (auto&& modded_file : modded_patchable_files_) {
-        auto [game_path, on_disk_files] = modded_file;
-        fs::create_directories(cache_directory / game_path);
-        auto json_path = cache_directory / game_path;
-        json_path += ".json";
-        if (fs::exists(json_path)) {
-            std::ifstream ifs(json_path);
-            try {
-                const auto&              data             = nlohmann::json::parse(ifs);
-                std::vector<std::string> layer_order      = data["layers"]["order"];
-                std::string              patch_op_version = data.at("version").get<std::string>();
-                if (PATCH_OP_VERSION == patch_op_version) {
-                    spdlog::debug("Loading from cache ({}) {} vs {}", game_path.string(),
-                                  patch_op_version, PATCH_OP_VERSION);
-                    std::vector<CacheLayer> cache_layers;
-                    for (auto&& layer : layer_order) {
-                        cache_layers.emplace_back(data["layers"].at(layer).get<CacheLayer>());
-                    }
-                    modded_file_cache_info_[game_path] = std::move(cache_layers);
-                } else {
-                    spdlog::debug("Skipping cache because Patch Op Version mismatch {} vs {}",
-                                  patch_op_version, PATCH_OP_VERSION);
-                }
-            } catch (const nlohmann::json::exception&) {
-            }
-        }
-    }
-}
-
-void ModManager::WriteCacheInfo(const fs::path& game_path)
-{
-    const auto cache_directory = ModManager::GetCacheDirectory();
-
-    auto json_path = cache_directory / game_path;
-    json_path += ".json";
-    std::ofstream            ofs(json_path);
-    nlohmann::json           j;
-    std::vector<std::string> order;
-    for (auto& layer : modded_file_cache_info_[game_path]) {
-        auto layer_id = layer.input_hash + "." + layer.patch_hash;
-        order.push_back(layer_id);
-        j["layers"][layer_id] = layer;
-    }
-    j["layers"]["order"] = order;
-    j["version"]         = PATCH_OP_VERSION;
-    ofs << j.dump(4);
-    ofs.close();
-
-    // Let's clean up old cache files
-    for (auto file : fs::directory_iterator(cache_directory / game_path)) {
-        const auto file_name = file.path().filename();
-        auto       it        = std::find_if(begin(modded_file_cache_info_[game_path]),
-                                            end(modded_file_cache_info_[game_path]),
-                                            [file_name](const auto& x) { return file_name == x.layer_file; });
-        //
-        if (it == end(modded_file_cache_info_[game_path])) {
-            fs::remove(file);
-        }
-    }
-}
-
-std::optional<std::string> ModManager::CheckCacheLayer(const fs::path&    game_path,
-                                                       const std::string& input_hash,
-                                                       const std::string& patch_hash)
-{
-    if (input_hash.empty()) {
-        return {};
-    }
-
-    spdlog::debug("Check cache {} {} {}", game_path.string(), input_hash, patch_hash);
-
-    for (auto&& cache : modded_file_cache_info_[game_path]) {
-        if (cache.input_hash == input_hash && cache.patch_hash == patch_hash) {
-            return cache.output_hash;
-        }
-    }
-    return {};
-}
-
-std::string ModManager::ReadCacheLayer(const fs::path& game_path, const std::string& input_hash)
-{
-    const auto cache_directory = ModManager::GetCacheDirectory();
-
-    for (auto&& cache : modded_file_cache_info_[game_path]) {
-        if (cache.output_hash == input_hash) {
-            const auto      cache_file      = cache.layer_file;
-            const auto      cache_file_path = (cache_directory / game_path / cache_file);
-            std::ifstream   file(cache_file_path, std::ios::binary | std::ios::ate);
-            std::streamsize size = file.tellg();
-            file.seekg(0, std::ios::beg);
-            std::string buffer;
-            buffer.resize(size);
-            if (file.read(buffer.data(), size)) {
-                std::string output;
-                size_t      rSize = ZSTD_getFrameContentSize(buffer.data(), buffer.size());
-                output.resize(rSize);
-                size_t dSize =
-                    ZSTD_decompress(output.data(), output.size(), buffer.data(), buffer.size());
-                output.resize(dSize);
-                return output;
-            }
-        }
-    }
-    return "";
-}
-
-ModManager::LayerId ModManager::PushCacheLayer(const fs::path&    game_path,
-                                               const LayerId&     last_valid_cache,
-                                               const std::string& patch_file_hash,
-                                               const std::string& buf, const std::string& mod_name)
-{
-    CacheLayer layer;
-    layer.input_hash  = last_valid_cache.output;
-    layer.output_hash = GetDataHash(buf);
-    layer.patch_hash  = patch_file_hash;
-    layer.layer_file  = layer.output_hash;
-    layer.mod_name    = mod_name;
-
-    spdlog::debug("PushCacheLayer {} {} {} {} {}", game_path.string(), last_valid_cache.output,
-                  patch_file_hash, layer.output_hash, mod_name);
-
-    auto& cache = modded_file_cache_info_[game_path];
-
-    for (const auto& layer : cache) {
-        spdlog::debug("  Layers {} {} {} {}", game_path.string(), layer.input_hash,
-                      layer.patch_hash, layer.output_hash);
-    }
-
-    auto it = find_if(begin(cache), end(cache), [&last_valid_cache](const auto& x) {
-        return x.output_hash == last_valid_cache.output && x.patch_hash == last_valid_cache.patch;
-    });
-    if (it == end(cache)) {
-        cache.clear();
-    } else {
-        std::advance(it, 1);
-        cache.erase(it, end(cache));
-    }
-
-    const auto cache_directory = ModManager::GetCacheDirectory();
-
-    fs::create_directories(cache_directory / game_path);
-    std::ofstream ofs((cache_directory / game_path / layer.layer_file), std::ofstream::binary);
-
-    size_t const                    cBuffSize = ZSTD_compressBound(buf.size());
-    static thread_local std::string CompressedBuffer;
-    CompressedBuffer.resize(cBuffSize);
-    size_t const cSize =
-        ZSTD_compress(CompressedBuffer.data(), CompressedBuffer.size(), buf.data(), buf.size(), 1);
-    CompressedBuffer.resize(cSize);
-
-    ofs.write(CompressedBuffer.data(), CompressedBuffer.size());
-    ofs.close();
-
-    cache.push_back(layer);
-
-    for (const auto& layer : cache) {
-        spdlog::debug("  New Layers {} {} {} {}", game_path.string(), layer.input_hash,
-                      layer.patch_hash, layer.output_hash);
-    }
-
-    return {layer.output_hash, patch_file_hash};
-}
-
 void ModManager::EnsureDummy()
 {
     static auto dummy_path = ModManager::GetDummyPath();
@@ -407,6 +445,12 @@ void ModManager::EnsureDummy()
 }
 
 void ModManager::GameFilesReady()
+{
+    std::lock_guard<std::mutex> lk(reload_mx_);
+    StartPatching();
+}
+
+void ModManager::StartPatching()
 {
     if (this->mods_ready_.load() || patching_file_thread_.joinable()) {
         // This gets very noisy
@@ -414,10 +458,6 @@ void ModManager::GameFilesReady()
         return;
     }
 
-    sort(begin(mods_), end(mods_), [](const auto& l, const auto& r) {
-        return stricmp(l.Name().c_str(), r.Name().c_str()) < 0;
-    });
-
     ModManager::EnsureDummy();
 
     patching_file_thread_ = std::thread([this]() {
@@ -425,18 +465,82 @@ void ModManager::GameFilesReady()
 
         const auto cache_directory = ModManager::GetCacheDirectory();
 
+        // Per file cache chains from older versions are superseded by the layer store
+        if (std::error_code ec; fs::exists(cache_directory / "data", ec)) {
+            fs::remove_all(cache_directory / "data", ec);
+        }
+
+        // Loading starts a new session, reloads keep using the store of this game start. Files a
+        // reload skips were looked up when the game started, trimming and saving keeps them.
+        if (!layer_store_) {
+            layer_store_ =
+                std::make_unique<LayerStore>(cache_directory / "layers", PATCH_OP_VERSION);
+            layer_store_->Load();
+            fingerprints_ = std::make_unique<FingerprintCache>(
+                cache_directory / "fingerprints.json", PATCH_OP_VERSION,
+                [this](const std::string& data) { return GetDataHash(data); });
+            fingerprints_->Load();
+        }
+        if (!checkpoints_) {
+            if (const auto count = DomCheckpoints::ConfiguredCount(); count > 0) {
+                spdlog::info("Keeping {} checkpoints per file in memory", count);
+                checkpoints_ = std::make_unique<DomCheckpoints>(count);
+            }
+        }
+
         CollectPatchableFiles();
-        ReadCache();
 
-        for (auto&& modded_file : modded_patchable_files_) {
+        const auto            game_data_hash = GetGameDataHash();
+        ArchiveGameFileSource game_file_source(game_data_hash);
+        BaseFileCache base_files(game_file_source, cache_directory / "base_files.json",
+                                 [this](const std::string& data) { return GetDataHash(data); });
+        base_files.Load();
+
+        struct PendingFile {
+            fs::path                 game_path;
+            std::vector<fs::path>    on_disk_files;
+            std::vector<std::string> patch_hashes;
+            std::string              chain_key;
+        };
+        std::vector<PendingFile>                       pending_files;
+        std::vector<std::pair<fs::path, std::string>> cached_files;
+        LayerPrefetcher                                prefetcher(*layer_store_);
+
+        for (auto&& [game_path, on_disk_files] : modded_patchable_files_) {
+            if (file_cache_.count(game_path) > 0) {
+                // Not touched by the reload that started this pass
+                continue;
+            }
+            std::vector<std::string> patch_hashes;
+            for (auto&& on_disk_file : on_disk_files) {
+                patch_hashes.emplace_back(fingerprints_->FileHash(on_disk_file));
+            }
+            std::vector<std::string> chain_nodes = {game_data_hash, game_path.u8string()};
+            chain_nodes.insert(end(chain_nodes), begin(patch_hashes), end(patch_hashes));
+            auto chain_key = fingerprints_->Combine(chain_nodes);
+
+            // Nothing in this chain changed since the last start, go straight to the final layer
+            // and let it decompress in the background while we patch everything else. Every
+            // transition on the way counts as used, editing the last patch later only replays it.
+            if (auto chain = fingerprints_->GetChain(game_path.u8string());
+                chain && chain->key == chain_key
+                && layer_store_->LookupChain(chain->input_hash, patch_hashes)
+                       == chain->output_hash) {
+                prefetcher.Request(chain->output_hash);
+                cached_files.emplace_back(game_path, chain->output_hash);
+                continue;
+            }
+            pending_files.push_back(
+                {game_path, on_disk_files, std::move(patch_hashes), std::move(chain_key)});
+        }
+
+        for (auto&& [game_path, on_disk_files, patch_hashes, chain_key] : pending_files) {
             if (shuttding_down_.load()) {
                 return;
             }
 
-            auto&& [game_path, on_disk_files] = modded_file;
-
-            auto game_file = ReadGameFile(game_path);
-            if (game_file.empty()) {
+            const auto game_file_hash = base_files.Hash(game_path);
+            if (game_file_hash.empty()) {
                 if (!IsIncludeFile(game_path)) {
                     for (auto& on_disk_file : on_disk_files) {
                         spdlog::error("Failed to get original game file {} {}", game_path.string(),
@@ -448,33 +552,62 @@ void ModManager::GameFilesReady()
                 }
                 continue;
             }
-            std::shared_ptr<pugi::xml_document> game_xml         = nullptr;
-            auto                                game_file_hash   = GetDataHash(game_file);
-            LayerId                             last_valid_cache = {"", ""};
-            std::string                         next_input_hash  = game_file_hash;
-
-            for (auto&& on_disk_file : on_disk_files) {
+            std::shared_ptr<pugi::xml_document> game_xml     = nullptr;
+            std::optional<XmlShardedDocument>   sharded_xml;
+            std::optional<XmlLazyDocument>      lazy_xml;
+            std::string                         current_hash = game_file_hash;
+            std::optional<std::string>          current_data;
+            FingerprintCache::ChainEntry        chain        = {chain_key, game_file_hash};
+            bool                                checkpointed = false;
+
+            for (size_t i = 0; i < on_disk_files.size(); ++i) {
                 if (shuttding_down_.load()) {
                     return;
                 }
-                auto       patch_file_hash = GetFileHash(on_disk_file);
-                const auto output_hash =
-                    CheckCacheLayer(game_path, next_input_hash, patch_file_hash);
+                const auto& on_disk_file    = on_disk_files[i];
+                const auto& patch_file_hash = patch_hashes[i];
+
+                const auto output_hash = layer_store_->Lookup(current_hash, patch_file_hash);
                 if (output_hash) {
-                    // Cache hit
-                    last_valid_cache.output = *output_hash;
-                    last_valid_cache.patch  = patch_file_hash;
-                    next_input_hash         = *output_hash;
-                } else {
-                    next_input_hash = "";
-
-                    if (!game_xml) {
-                        std::string cache_data = "";
-                        if (last_valid_cache.output.empty()) {
-                            cache_data = game_file;
-                        } else {
-                            cache_data = ReadCacheLayer(game_path, last_valid_cache.output);
+                    // Cache hit, whatever we parsed so far is outdated now
+                    current_hash = *output_hash;
+                    current_data = {};
+                    game_xml     = nullptr;
+                    sharded_xml  = {};
+                    lazy_xml     = {};
+                    continue;
+                }
+
+                spdlog::debug("Cache miss {} {}", current_hash, patch_file_hash);
+
+                const bool parsed = game_xml || sharded_xml || lazy_xml;
+                if (!parsed && checkpoints_) {
+                    game_xml = checkpoints_->Take(game_path, current_hash);
+                }
+                if (!parsed && !game_xml) {
+                    std::string cache_data = "";
+                    if (current_hash == game_file_hash) {
+                        cache_data = base_files.Read(game_path);
+                    } else {
+                        cache_data = layer_store_->Read(current_hash);
+                    }
+                    // Checkpoints keep whole documents, there is no point in splitting it then
+                    if (!checkpoints_) {
+                        // Layers keep an index of their assets, see below
+                        std::optional<XmlPartIndex> index;
+                        if (auto sidecar = layer_store_->ReadSidecar(current_hash)) {
+                            index = XmlPartIndex::Load(sidecar->data);
                         }
+                        if (IsLazyParsingEnabled()) {
+                            lazy_xml = index ? XmlLazyDocument::Open(cache_data, *index)
+                                             : XmlLazyDocument::Scan(cache_data);
+                        }
+                        if (!lazy_xml) {
+                            sharded_xml = index ? XmlShardedDocument::Open(cache_data, *index)
+                                                : XmlShardedDocument::Parse(cache_data);
+                        }
+                    }
+                    if (!lazy_xml && !sharded_xml) {
                         game_xml = std::make_shared<pugi::xml_document>();
                         auto parse_result =
                             game_xml->load_buffer(cache_data.data(), cache_data.size());
@@ -483,79 +616,117 @@ void ModManager::GameFilesReady()
                                           parse_result.description());
                         }
                     }
+                }
 
-                    spdlog::debug("Cache miss {} {}", next_input_hash, patch_file_hash);
-
-                    // Cache miss
-                    auto& mod        = GetModContainingFile(on_disk_file);
-                    auto  operations = XmlOperation::GetXmlOperationsFromFile(
-                         on_disk_file, mod.Name(), game_path, on_disk_file);
-                    for (auto&& operation : operations) {
-                        operation.Apply(game_xml);
-                    }
+                // Only the layer before the first patch that changed, that is where editing it
+                // again resumes. Later layers would cost a copy each and are never resumed from.
+                if (checkpoints_ && !checkpointed) {
+                    checkpoints_->Store(game_path, current_hash, *game_xml);
+                    checkpointed = true;
+                }
 
-                    struct xml_string_writer : pugi::xml_writer {
-                        std::string result;
+                // Cache miss
+                const auto& mod  = GetModContainingFile(on_disk_file);
+                auto  operations = XmlOperation::GetXmlOperationsFromFile(
+                    on_disk_file, mod.Name(), game_path, on_disk_file);
+                if (lazy_xml) {
+                    lazy_xml->ApplyAll(operations);
+                } else if (sharded_xml) {
+                    sharded_xml->ApplyAll(operations);
+                } else {
+                    XmlOperation::ApplyAll(game_xml, operations);
+                }
 
-                        virtual void write(const void* data, size_t size)
-                        {
-                            absl::StrAppend(&result, std::string_view{(const char*)data, size});
-                        }
-                    };
+                struct xml_string_writer : pugi::xml_writer {
+                    std::string result;
 
-                    spdlog::debug("Write XML output");
-                    xml_string_writer writer;
+                    virtual void write(const void* data, size_t size)
+                    {
+                        absl::StrAppend(&result, std::string_view{(const char*)data, size});
+                    }
+                };
+
+                spdlog::debug("Write XML output");
+                xml_string_writer writer;
+                if (lazy_xml) {
+                    writer.result = lazy_xml->Print();
+                } else if (sharded_xml) {
+                    writer.result = sharded_xml->Print();
+                } else {
                     writer.result.reserve(100 * 1024 * 1024);
                     game_xml->print(writer, "", pugi::format_raw);
-                    std::string& buf = writer.result;
-                    spdlog::debug("Write XML output...Finished");
-
-                    if (last_valid_cache.output.empty()) {
-                        last_valid_cache.output = game_file_hash;
-                        last_valid_cache.patch  = "";
+                }
+                std::string& buf = writer.result;
+                spdlog::debug("Write XML output...Finished");
+
+                const auto buf_hash = GetDataHash(buf);
+                layer_store_->Push(current_hash, patch_file_hash, buf_hash, buf,
+                                   on_disk_file.string());
+                if (!layer_store_->ReadSidecar(buf_hash)) {
+                    if (const auto index = XmlPartIndex::Scan(buf)) {
+                        layer_store_->PushSidecar(buf_hash, index->Save());
                     }
-                    last_valid_cache = PushCacheLayer(game_path, last_valid_cache, patch_file_hash,
-                                                      buf, on_disk_file.string());
-                    file_cache_[game_path] = {buf.size(), true, buf};
                 }
+                current_hash = buf_hash;
+                current_data = std::move(buf);
             }
-            if (!game_xml) {
-                auto cache_data        = ReadCacheLayer(game_path, last_valid_cache.output);
-                file_cache_[game_path] = {cache_data.size(), true, cache_data};
+            if (!current_data) {
+                if (current_hash == game_file_hash) {
+                    current_data = base_files.Read(game_path);
+                } else {
+                    current_data = layer_store_->Read(current_hash);
+                }
             }
+            auto buffer = std::make_shared<const std::string>(std::move(*current_data));
+            file_cache_[game_path] = {buffer->size(), true, std::move(buffer)};
+
+            chain.output_hash = current_hash;
+            fingerprints_->SetChain(game_path.u8string(), std::move(chain));
 
-            WriteCacheInfo(game_path);
+            base_files.Release(game_path);
+            game_xml    = nullptr;
+            sharded_xml = {};
+            lazy_xml    = {};
+        }
 
-            game_xml = nullptr;
+        for (auto&& [game_path, output_hash] : cached_files) {
+            auto data              = prefetcher.Take(output_hash);
+            file_cache_[game_path] = {data.size(), true,
+                                      std::make_shared<const std::string>(std::move(data))};
         }
 
+        layer_store_->Trim(MAX_UNUSED_CACHE_SESSIONS);
+        layer_store_->Save();
+        fingerprints_->Save();
+        base_files.Save();
+
+        PublishSnapshot();
         StartWatchingFiles();
 
         {
+            // StartPatching sees either this thread running or the mods ready, never neither.
+            // Shutdown may have taken the thread over to join it.
+            std::lock_guard<std::mutex> reload_lk(reload_mx_);
+            if (patching_file_thread_.get_id() == std::this_thread::get_id()) {
+                patching_file_thread_.detach();
+                patching_file_thread_ = {};
+            }
             std::lock_guard<std::mutex> lk(mods_ready_mx_);
             mods_ready_.store(true);
         }
         spdlog::info("Finished applying xml operations");
 
         mods_ready_cv_.notify_all();
-
-        patching_file_thread_.detach();
-        patching_file_thread_ = {};
     });
 }
 
 bool ModManager::IsFileModded(const fs::path& path) const
 {
-    auto normalized_path = path.lexically_normal();
-    for (const auto& mod : mods_) {
-        if (mod.HasFile(normalized_path)) {
-            return true;
-        }
-    }
-    return false;
+    const auto snapshot = snapshot_.Read();
+    return snapshot && snapshot->path_index.Contains(path.native());
 }
 
-const ModManager::File& ModManager::GetModdedFileInfo(const fs::path& path) const
+ModManager::File ModManager::GetModdedFileInfo(const fs::path& path) const
 {
     // This _should_ be fine, I think
     ModManager::instance().GameFilesReady();
@@ -564,15 +735,20 @@ const ModManager::File& ModManager::GetModdedFileInfo(const fs::path& path) cons
     // wait for it to finish
     WaitModsReady();
     {
-        std::scoped_lock lk{file_cache_mutex_};
-        if (file_cache_.count(path) > 0) {
-            return file_cache_.at(path);
+        const auto snapshot = snapshot_.Read();
+        if (snapshot) {
+            const auto id = snapshot->path_index.Find(path.native());
+            if (id != PathIndex::npos && snapshot->files[id]) {
+                return *snapshot->files[id];
+            }
         }
     }
     // File not in cache, yet?
     throw std::logic_error("GetModdedFileInfo shouldn't be called on a file that is not modded");
 }
 
+ModManager::ModManager() = default;
+
 ModManager::~ModManager()
 {
     Shutdown();
@@ -580,21 +756,30 @@ ModManager::~ModManager()
 
 void ModManager::Shutdown()
 {
-    shuttding_down_.store(true);
-    //
+    std::unique_ptr<DirectoryWatcher> watcher;
+    {
+        // Nothing starts watching after this
+        std::lock_guard<std::mutex> lk(mods_ready_mx_);
+        shuttding_down_.store(true);
+        watcher = std::move(watcher_);
+    }
+    mods_ready_cv_.notify_all();
     // Trigger watch abort
-    if (watch_file_thread_.joinable()) {
-        std::thread thread = {};
-        std::swap(thread, watch_file_thread_);
-        SetEvent(watch_file_ov_.hEvent);
-        thread.join();
-        thread = {};
+    watcher = nullptr;
+    // The reload thread is done with the queue and the watcher once it is joined
+    if (change_queue_) {
+        change_queue_->Close();
     }
-    if (patching_file_thread_.joinable()) {
-        std::thread thread = {};
-        std::swap(thread, patching_file_thread_);
-        thread.join();
-        thread = {};
+    if (reload_mods_thread_.joinable()) {
+        reload_mods_thread_.join();
+    }
+    std::thread patching_thread;
+    {
+        std::lock_guard<std::mutex> lk(reload_mx_);
+        std::swap(patching_thread, patching_file_thread_);
+    }
+    if (patching_thread.joinable()) {
+        patching_thread.join();
     }
 }
 
@@ -642,6 +827,19 @@ fs::path ModManager::GetModsDirectory()
     return mods_directory;
 }
 
+fs::path ModManager::GetGameExecutablePath()
+{
+    WCHAR path[0x7FFF] = {};
+    GetModuleFileNameW(NULL, path, sizeof(path) / sizeof(WCHAR));
+    return path;
+}
+
+fs::path ModManager::GetGameDirectory()
+{
+    // Game executable lives in Bin/Win64
+    return GetGameExecutablePath().parent_path().parent_path().parent_path();
+}
+
 fs::path ModManager::GetCacheDirectory()
 {
     return ModManager::GetModsDirectory() / ".cache";
@@ -674,18 +872,30 @@ bool ModManager::IsIncludeFile(const fs::path& file) const
     return secondaryExtension == ".include";
 }
 
-std::string ModManager::GetFileHash(const fs::path& path) const
+std::string ModManager::GetGameDataHash() const
 {
-    std::ifstream   file(path, std::ios::binary | std::ios::ate);
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::string buffer;
-    buffer.resize(size);
-    if (file.read(buffer.data(), size)) {
-        return GetDataHash(buffer);
+    // The archives and the executable only change with game updates, their metadata is enough to
+    // tell whether the original game files could have changed
+    std::vector<std::string> hashes;
+    const auto               game_directory = ModManager::GetGameDirectory();
+    try {
+        hashes.emplace_back(fingerprints_->MetadataHash(GetGameExecutablePath()));
+        std::vector<fs::path> archives;
+        for (auto&& file : fs::directory_iterator(game_directory / "maindata")) {
+            if (file.is_regular_file() && file.path().extension() == ".rda") {
+                archives.emplace_back(file.path());
+            }
+        }
+        sort(begin(archives), end(archives));
+        for (auto&& archive : archives) {
+            hashes.emplace_back(fingerprints_->MetadataHash(archive));
+        }
+    } catch (const fs::filesystem_error& e) {
+        spdlog::warn("Failed to fingerprint game data {}", e.what());
+        // Make sure nothing matches
+        hashes.emplace_back(std::to_string(GetTickCount64()));
     }
-    throw new std::runtime_error("Failed to read file");
-    return {};
+    return fingerprints_->Combine(hashes);
 }
 
 std::string ModManager::GetDataHash(const std::string& data) const
@@ -733,14 +943,10 @@ std::string ModManager::ReadGameFile(fs::path path)
 
 fs::path ModManager::MapAliasedPath(fs::path path)
 {
-    if (path == L"data/config/game/asset/assets.xml") {
-        return L"data/config/export/main/asset/assets.xml";
-    }
-    if (path == L"data/config/game/asset/properties.xml") {
-        return L"data/config/export/main/asset/properties.xml";
-    }
-    if (path == L"data/config/game/asset/templates.xml") {
-        return L"data/config/export/main/asset/templates.xml";
+    for (auto&& [alias, target] : ALIASED_PATHS) {
+        if (path == alias) {
+            return target;
+        }
     }
     return path;
 }
@@ -0,0 +1,171 @@
+#include "path_index.h"
+
+#include <algorithm>
+#include <cwctype>
+
+namespace
+{
+// Longest path we normalize on the stack, longer ones fall back to the heap
+constexpr size_t MAX_STACK_PATH = 1024;
+} // namespace
+
+void PathIndex::Clear()
+{
+    slots_.clear();
+    pool_.clear();
+    size_ = 0;
+}
+
+void PathIndex::Reserve(size_t count)
+{
+    size_t capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    if (capacity <= slots_.size()) {
+        return;
+    }
+    auto old_slots = std::move(slots_);
+    slots_.assign(capacity, {});
+    for (const auto& slot : old_slots) {
+        if (slot.value == npos) {
+            continue;
+        }
+        auto index = slot.hash & (slots_.size() - 1);
+        while (slots_[index].value != npos) {
+            index = (index + 1) & (slots_.size() - 1);
+        }
+        slots_[index] = slot;
+    }
+}
+
+void PathIndex::Grow()
+{
+    Reserve(std::max<size_t>(size_ + 1, slots_.size()));
+}
+
+size_t PathIndex::Normalize(std::wstring_view path, wchar_t* out, size_t capacity)
+{
+    size_t length = 0;
+    size_t i      = 0;
+    while (i < path.size()) {
+        // Start of a segment
+        size_t end = i;
+        while (end < path.size() && path[end] != L'/' && path[end] != L'\\') {
+            ++end;
+        }
+        const auto segment = path.substr(i, end - i);
+        if (segment.empty() && i != 0) {
+            // Repeated separator
+        } else if (segment == L".") {
+            //
+        } else if (segment == L"..") {
+            // Drop the previous segment
+            if (length > 0) {
+                --length;
+                while (length > 0 && out[length - 1] != L'/') {
+                    --length;
+                }
+            }
+        } else {
+            if (length + segment.size() + 1 > capacity) {
+                return capacity + 1;
+            }
+            for (auto c : segment) {
+                out[length++] = static_cast<wchar_t>(std::towlower(c));
+            }
+            if (end < path.size()) {
+                out[length++] = L'/';
+            }
+        }
+        i = end + 1;
+    }
+    // Trailing separators don't matter
+    while (length > 1 && out[length - 1] == L'/') {
+        --length;
+    }
+    return length;
+}
+
+uint64_t PathIndex::Hash(std::wstring_view key)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : key) {
+        hash ^= static_cast<uint64_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::wstring_view PathIndex::Key(const Slot& slot) const
+{
+    return std::wstring_view(pool_).substr(slot.offset, slot.length);
+}
+
+const PathIndex::Slot* PathIndex::FindSlot(std::wstring_view key, uint64_t hash) const
+{
+    if (slots_.empty()) {
+        return nullptr;
+    }
+    auto index = hash & (slots_.size() - 1);
+    while (slots_[index].value != npos) {
+        const auto& slot = slots_[index];
+        if (slot.hash == hash && Key(slot) == key) {
+            return &slot;
+        }
+        index = (index + 1) & (slots_.size() - 1);
+    }
+    return &slots_[index];
+}
+
+void PathIndex::Insert(std::wstring_view path, uint32_t value)
+{
+    std::wstring key(path.size() + 1, L'\0');
+    key.resize(Normalize(path, key.data(), key.size()));
+
+    if ((size_ + 1) * 2 > slots_.size()) {
+        Grow();
+    }
+
+    const auto hash = Hash(key);
+    auto*      slot = const_cast<Slot*>(FindSlot(key, hash));
+    if (slot->value == npos) {
+        slot->hash   = hash;
+        slot->offset = static_cast<uint32_t>(pool_.size());
+        slot->length = static_cast<uint32_t>(key.size());
+        pool_ += key;
+        size_ += 1;
+    }
+    slot->value = value;
+}
+
+bool PathIndex::Alias(std::wstring_view alias, std::wstring_view target)
+{
+    const auto value = Find(target);
+    if (value == npos) {
+        return false;
+    }
+    Insert(alias, value);
+    return true;
+}
+
+uint32_t PathIndex::Find(std::wstring_view path) const
+{
+    if (size_ == 0) {
+        return npos;
+    }
+
+    wchar_t buffer[MAX_STACK_PATH];
+    size_t  length = Normalize(path, buffer, MAX_STACK_PATH);
+    if (length > MAX_STACK_PATH) {
+        std::wstring key(path.size() + 1, L'\0');
+        key.resize(Normalize(path, key.data(), key.size()));
+        const auto* slot = FindSlot(key, Hash(key));
+        return slot ? slot->value : npos;
+    }
+
+    const std::wstring_view key(buffer, length);
+    const auto*             slot = FindSlot(key, Hash(key));
+    return slot ? slot->value : npos;
+}
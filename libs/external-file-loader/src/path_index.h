@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Case folded, normalized lookup table for game paths.
+// Keys are normalized once when they are inserted and interned into a single string pool.
+// Lookups normalize the probe into a stack buffer and never allocate, which matters because every
+// file the game opens goes through here.
+class PathIndex
+{
+  public:
+    static constexpr uint32_t npos = ~uint32_t(0);
+
+    void Clear();
+    void Reserve(size_t count);
+
+    // Overwrites the value if `path` is already present
+    void Insert(std::wstring_view path, uint32_t value);
+    // Makes `alias` resolve to whatever `target` resolves to, if `target` is present
+    bool Alias(std::wstring_view alias, std::wstring_view target);
+
+    uint32_t Find(std::wstring_view path) const;
+    bool     Contains(std::wstring_view path) const
+    {
+        return Find(path) != npos;
+    }
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    // Lower case, forward slashes, no `.` or `..` segments and no repeated separators
+    static size_t Normalize(std::wstring_view path, wchar_t* out, size_t capacity);
+
+  private:
+    struct Slot {
+        uint64_t hash   = 0;
+        uint32_t offset = 0;
+        uint32_t length = 0;
+        uint32_t value  = npos;
+    };
+
+    static uint64_t  Hash(std::wstring_view key);
+    const Slot*      FindSlot(std::wstring_view key, uint64_t hash) const;
+    void             Grow();
+    std::wstring_view Key(const Slot& slot) const;
+
+    std::vector<Slot> slots_;
+    std::wstring      pool_;
+    size_t            size_ = 0;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Pointer to an immutable object that readers can access without taking a lock.
+// Writers publish a new object and the old one is reclaimed once every reader that could still
+// see it is done with it (epoch based, two reader counters that are flipped on every publish).
+// Readers never block, publishing waits for the readers of the previous epoch.
+template <typename T> class SnapshotPtr
+{
+  public:
+    class ReadGuard
+    {
+      public:
+        ReadGuard(ReadGuard&& other) noexcept
+            : counter_(other.counter_)
+            , value_(other.value_)
+        {
+            other.counter_ = nullptr;
+        }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ReadGuard& operator=(ReadGuard&&) = delete;
+
+        ~ReadGuard()
+        {
+            if (counter_) {
+                counter_->fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        const T* get() const
+        {
+            return value_;
+        }
+        const T* operator->() const
+        {
+            return value_;
+        }
+        const T& operator*() const
+        {
+            return *value_;
+        }
+        explicit operator bool() const
+        {
+            return value_ != nullptr;
+        }
+
+      private:
+        friend class SnapshotPtr;
+        ReadGuard(std::atomic<uint64_t>* counter, const T* value)
+            : counter_(counter)
+            , value_(value)
+        {
+        }
+
+        std::atomic<uint64_t>* counter_;
+        const T*               value_;
+    };
+
+    SnapshotPtr() = default;
+    explicit SnapshotPtr(std::unique_ptr<T> value)
+        : current_(value.release())
+    {
+    }
+    SnapshotPtr(const SnapshotPtr&) = delete;
+    SnapshotPtr& operator=(const SnapshotPtr&) = delete;
+
+    ~SnapshotPtr()
+    {
+        delete current_.load();
+    }
+
+    ReadGuard Read() const
+    {
+        for (;;) {
+            const auto epoch   = epoch_.load();
+            auto&      counter = readers_[epoch & 1];
+            counter.fetch_add(1);
+            // If a writer flipped the epoch in between it might not wait for us, try again
+            if (epoch_.load() == epoch) {
+                return ReadGuard(&counter, current_.load());
+            }
+            counter.fetch_sub(1);
+        }
+    }
+
+    void Publish(std::unique_ptr<T> value)
+    {
+        std::lock_guard<std::mutex> lk(writer_mutex_);
+        T*                          previous = current_.exchange(value.release());
+
+        const auto epoch = epoch_.fetch_add(1);
+        while (readers_[epoch & 1].load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+        delete previous;
+    }
+
+  private:
+    std::atomic<T*>               current_ = nullptr;
+    mutable std::atomic<uint64_t> epoch_   = 0;
+    mutable std::atomic<uint64_t> readers_[2] = {};
+    std::mutex                    writer_mutex_;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "pugixml.hpp"
+#include "xml_plan.h"
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class XmlArenaDocument;
+
+// Declares that elements named `element` are found by the text of `path` below them, names
+// separated by '/'. Equality predicates on it, like `//Asset[Template='X']`, then look the value
+// up instead of testing every such element. Only XmlArenaDocument keeps these, the loader's
+// pugixml documents still test every element.
+struct XmlValueIndex {
+    std::string element;
+    std::string path;
+};
+
+// Handle of a node in an XmlArenaDocument. It has the parts of the pugi::xml_node interface that
+// XmlOperation uses, under the same names, so both backends share one implementation. Like
+// pugi::xml_node, a default constructed handle is null and handles of removed nodes dangle.
+class XmlArenaNode
+{
+  public:
+    XmlArenaNode() = default;
+    XmlArenaNode(XmlArenaDocument *document, uint32_t index);
+
+    explicit operator bool() const;
+    bool     operator==(const XmlArenaNode &other) const;
+    bool     operator!=(const XmlArenaNode &other) const;
+
+    pugi::xml_node_type type() const;
+    // Empty for everything but elements
+    const char *name() const;
+    // Text of pcdata and cdata nodes, only valid until the document changes
+    std::string_view value() const;
+    // Text of the first pcdata or cdata child
+    std::string_view child_value() const;
+
+    XmlArenaNode parent() const;
+    XmlArenaNode first_child() const;
+    XmlArenaNode next_sibling() const;
+    XmlArenaNode child(const char *name) const;
+
+    XmlArenaNode append_copy(pugi::xml_node source);
+    XmlArenaNode insert_copy_after(pugi::xml_node source, XmlArenaNode node);
+    XmlArenaNode insert_copy_before(pugi::xml_node source, XmlArenaNode node);
+    bool         remove_child(XmlArenaNode node);
+    bool         set_value(const char *value);
+    // Moves `name` to the end if it was set, like removing and appending it does in pugixml
+    void set_attribute(const char *name, const char *value);
+
+    uint32_t          Index() const { return index_; }
+    XmlArenaDocument *Document() const { return document_; }
+
+  private:
+    XmlArenaDocument *document_ = nullptr;
+    uint32_t          index_    = 0;
+};
+
+// A document kept as flat arrays instead of linked nodes. Element names are interned to ids,
+// text and attribute values are slices of the source buffer unless they had to be decoded or were
+// added later. Nodes are stored in document order as parsed, so walking the whole tree mostly
+// reads memory front to back. Removed nodes are only unlinked, their slots stay.
+// Parses like pugixml with its default flags and prints like pugi::format_raw.
+// Only xmltest and xmlbench use it so far. The loader applies ops with pugixml, to the whole
+// document or to its shards and parts, so the name postings below don't speed up the loader.
+class XmlArenaDocument
+{
+  public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    // name_ids_ points into names_, copies would point into the original
+    XmlArenaDocument(const XmlArenaDocument &)            = delete;
+    XmlArenaDocument &operator=(const XmlArenaDocument &) = delete;
+    XmlArenaDocument(XmlArenaDocument &&)                 = default;
+    XmlArenaDocument &operator=(XmlArenaDocument &&)      = default;
+
+    // Asset Template, Standard Name and Item ItemType, and what XmlOperation looks GUIDs and
+    // templates up by
+    static const std::vector<XmlValueIndex> DEFAULT_INDEXES;
+
+    // Empty if `buffer` is not well-formed enough for WalkMarkup
+    static std::optional<XmlArenaDocument>
+    Parse(std::string buffer, const std::vector<XmlValueIndex> &indexes = DEFAULT_INDEXES);
+
+    XmlArenaNode Root();
+    std::string  Print() const;
+    // Number of node slots, removed ones included
+    size_t Size() const { return types_.size(); }
+
+    // Evaluates a subset of XPath from `context`, the root if null: child and descendant steps
+    // with name tests or *, filtered by predicates that compare a relative path of names,
+    // optionally ending in an attribute, to a literal or test that it exists. `self::node()`
+    // alone selects `context`. Results are in document order. Empty if `path` is beyond that.
+    // A leading descendant step with a name, like in `//Asset[...]`, only looks at the elements
+    // of that name, or only at those with the value if it compares an indexed path to one.
+    // A path may also start with `guid('X')` or `template('X')`, the asset or template with that
+    // GUID or name, which seeks like `//Asset[Values/Standard/GUID='X']` does.
+    // Results are kept by path and context and returned again while nothing they depend on has
+    // changed: what is below the context, or the elements a leading named step starts from.
+    // The loader's pugixml documents keep nothing, they evaluate every path again.
+    std::optional<std::vector<XmlArenaNode>> Select(std::string_view path,
+                                                    XmlArenaNode     context = {});
+    // Same as Select, but the result is neither taken from nor kept in the cache and the nodes
+    // visited are not counted. Looks ahead for Explain without changing what Apply measures.
+    std::optional<std::vector<XmlArenaNode>> Peek(std::string_view path,
+                                                  XmlArenaNode     context = {});
+    // How Select would evaluate `path` and about how many nodes it would visit doing so
+    XmlPlan Plan(std::string_view path, XmlArenaNode context = {});
+    // Nodes Select visited so far
+    size_t Visits() const { return visits_; }
+    // Select calls answered from earlier results, and those evaluated
+    size_t CacheHits() const { return cache_hits_; }
+    size_t CacheMisses() const { return cache_misses_; }
+
+  private:
+    friend class XmlArenaNode;
+    friend class XmlArenaBuilder;
+    friend class XmlArenaQuery;
+
+    // Position in text_
+    struct Slice {
+        uint32_t begin = 0;
+        uint32_t size  = 0;
+    };
+
+    // Elements of one name in document order. Removed ones are flagged in removed_ and only
+    // dropped once something is inserted into the list.
+    struct Postings {
+        std::vector<uint32_t> nodes;
+        size_t                removed = 0;
+        // Of the last time one was added, removed or changed its indexed values
+        uint64_t generation = 0;
+    };
+
+    // Elements by the distinct texts of an XmlValueIndex path below them
+    struct ValueIndex {
+        uint32_t              element = 0;
+        std::vector<uint32_t> path;
+        // Each in document order, removed elements are skipped
+        std::unordered_map<std::string, std::vector<uint32_t>> nodes;
+        std::unordered_map<uint32_t, std::vector<std::string>> values;
+    };
+
+    // A Select result, valid as long as the generations it depends on stay the same: the postings
+    // of `leading` unless that is NONE, and those of the nodes in `scopes`
+    struct CachedResult {
+        uint32_t                                   leading = NONE;
+        uint64_t                                   members = 0;
+        std::vector<std::pair<uint32_t, uint64_t>> scopes;
+        std::vector<uint32_t>                      nodes;
+    };
+    // Distinct paths to keep results of, the cache starts over past that
+    static constexpr size_t MAX_CACHED_PATHS = 4096;
+
+    XmlArenaDocument() = default;
+
+    uint32_t         Intern(std::string_view name);
+    uint32_t         Lookup(std::string_view name) const;
+    Slice            Store(std::string_view text);
+    std::string_view Text(Slice slice) const;
+
+    uint32_t AddNode(pugi::xml_node_type type, uint32_t name, Slice value);
+    void     Link(uint32_t node, uint32_t parent, uint32_t after);
+    void     Unlink(uint32_t node);
+    uint32_t Copy(pugi::xml_node source);
+    void     SetAttribute(uint32_t node, std::string_view name, std::string_view value);
+
+    template <typename Visit> void ForEachBelow(uint32_t root, Visit visit) const;
+    // Whether `a` comes before `b` in document order
+    bool Before(uint32_t a, uint32_t b) const;
+    void InsertSorted(std::vector<uint32_t> &nodes, uint32_t node) const;
+    // Adds `node` and everything below it to postings_ and value_indexes_
+    void Post(uint32_t node);
+    // Updates the value indexes of the elements whose values may include `node`
+    void Reindex(uint32_t node);
+    void Reindex(ValueIndex &index, uint32_t element);
+    // Null if no value index covers `path` below `element`
+    const std::vector<uint32_t> *FindByValue(uint32_t element, const std::vector<uint32_t> &path,
+                                             const std::string &value) const;
+    // All text below `node`, in order
+    std::string StringValue(uint32_t node) const;
+    // Starts a new generation for `node` and everything above it
+    void Touch(uint32_t node);
+    bool Valid(const CachedResult &cached) const;
+    // Handles to the nodes at `indexes`
+    std::vector<XmlArenaNode> Nodes(const std::vector<uint32_t> &indexes);
+
+    void PrintNode(std::string &output, uint32_t node) const;
+
+    // The source buffer, followed by decoded and added text
+    std::string text_;
+
+    // Interned element and attribute names, ids index names_. A deque keeps c_str() stable.
+    std::deque<std::string>                        names_;
+    std::unordered_map<std::string_view, uint32_t> name_ids_;
+
+    // Nodes, 0 is the document
+    std::vector<pugi::xml_node_type> types_;
+    std::vector<uint32_t>            node_names_;
+    std::vector<Slice>               values_;
+    std::vector<uint32_t>            parents_;
+    std::vector<uint32_t>            first_children_;
+    std::vector<uint32_t>            last_children_;
+    std::vector<uint32_t>            next_siblings_;
+    std::vector<uint32_t>            previous_siblings_;
+    std::vector<uint32_t>            first_attributes_;
+    std::vector<char>                removed_;
+    // Of the last change at or below each node
+    std::vector<uint64_t> generations_;
+    // Nodes before this were parsed, their indexes are in document order
+    uint32_t parsed_        = 0;
+    size_t   removed_nodes_ = 0;
+    size_t   visits_        = 0;
+    uint64_t generation_    = 0;
+
+    // By name id
+    std::vector<Postings>   postings_;
+    std::vector<ValueIndex> value_indexes_;
+
+    // By path, then context
+    std::unordered_map<std::string, std::unordered_map<uint32_t, CachedResult>> results_;
+    size_t cache_hits_   = 0;
+    size_t cache_misses_ = 0;
+
+    // Attributes, in a list per node
+    std::vector<uint32_t> attribute_names_;
+    std::vector<Slice>    attribute_values_;
+    std::vector<uint32_t> next_attributes_;
+};
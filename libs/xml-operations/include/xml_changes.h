@@ -0,0 +1,50 @@
+#pragma once
+
+#include "pugixml.hpp"
+
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+// The names an XPath expression looks at. Text nodes go by "#text".
+struct XmlQuery {
+    explicit XmlQuery(std::string_view path = "");
+
+    // Element names tested along the way, in predicates as well
+    std::unordered_set<std::string> names;
+    // Elements whose text is compared to something
+    std::unordered_set<std::string> compared;
+    std::unordered_set<std::string> attributes;
+
+    // Matches elements by something else than their name: *, node(), ...
+    bool any_name = false;
+    // Looks at text it cannot attribute to an element name: ., string functions, ...
+    bool any_value     = false;
+    bool any_attribute = false;
+};
+
+// What a number of XmlOperation::Apply calls changed, by name. Tells whether an XPath resolved
+// before those changes would still select the same nodes.
+class XmlChanges
+{
+  public:
+    // Mirror the XmlJournal calls, attributes only matter by name
+    void Inserted(pugi::xml_node node);
+    void Removing(pugi::xml_node node);
+    void ChangingAttribute(const char *name);
+    void ChangingValue(pugi::xml_node node);
+
+    bool Empty() const;
+    // Whether `query` may select something else than before the changes
+    bool Affects(const XmlQuery &query) const;
+
+  private:
+    // Everything inside inserted or removed subtrees
+    std::unordered_set<std::string> structure_;
+    // Elements whose text changed, i.e. all ancestors of a change
+    std::unordered_set<std::string> values_;
+    std::unordered_set<std::string> attributes_;
+
+    void Subtree(pugi::xml_node node);
+    void Ancestors(pugi::xml_node node);
+};
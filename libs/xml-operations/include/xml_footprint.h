@@ -0,0 +1,39 @@
+#pragma once
+
+#include "pugixml.hpp"
+
+#include <set>
+#include <string>
+
+// The parts of a document an XmlOperation read and wrote.
+// A part is a single asset ("asset:<GUID>"), a single template ("template:<Name>"), the order of
+// the assets or templates directly inside one container ("container:<location>") or, whenever
+// an op cannot be pinned down that precisely, the whole document (EVERYTHING). Ops without GUID
+// or Template lookup read the whole document, their XPath can match anywhere.
+struct XmlFootprint {
+    static constexpr auto EVERYTHING = "*";
+
+    std::set<std::string> reads;
+    std::set<std::string> writes;
+
+    // Whether anything read or written is in `region`
+    bool Touches(const std::set<std::string> &region) const;
+    bool Precise() const;
+
+    // Mirror the XmlJournal calls
+    void Inserted(pugi::xml_node node);
+    void Removing(pugi::xml_node node);
+    void ChangingAttribute(pugi::xml_node node);
+    void ChangingValue(pugi::xml_node node);
+
+    static std::string Asset(const std::string &guid);
+    static std::string Template(const std::string &name);
+    // Part `node` is the root of, empty if it is neither an asset nor a template
+    static std::string Key(pugi::xml_node node);
+    // Part a change to `node` writes to
+    static std::string RegionOf(pugi::xml_node node);
+    // Part holding the order of `node` and its siblings
+    static std::string ContainerOf(pugi::xml_node node);
+    // Position of `node` in its document, like /AssetList[1]/Groups[1]/Group[3]/Assets[1]
+    static std::string Location(pugi::xml_node node);
+};
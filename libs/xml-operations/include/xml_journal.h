@@ -0,0 +1,81 @@
+#pragma once
+
+#include "pugixml.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Undo log for the changes XmlOperation::Apply makes to a document.
+// Changes are grouped into segments (usually one per patch file). A segment can be rolled back
+// on its own, later segments are only rolled back as well if they wrote to an overlapping part of
+// the document, everything else stays applied. Removed subtrees are kept as copies, node handles
+// recorded in the journal always point to live nodes, either in the document or in those copies.
+class XmlJournal
+{
+  public:
+    XmlJournal();
+    XmlJournal(const XmlJournal &) = delete;
+    XmlJournal &operator=(const XmlJournal &) = delete;
+
+    // Starts a new segment, changes are recorded into it until the next Begin or Reopen
+    size_t Begin(std::string name);
+    // Records into a segment that was rolled back before, e.g. to apply it again
+    void               Reopen(size_t segment);
+    size_t             Segments() const;
+    const std::string &Name(size_t segment) const;
+    size_t             Changes(size_t segment) const;
+
+    void Inserted(pugi::xml_node node);
+    // Call right before `node` is removed from the document
+    void Removing(pugi::xml_node node);
+    // Call right before attribute `name` of `node` is changed, added or removed
+    void ChangingAttribute(pugi::xml_node node, const char *name);
+    // Call right before the value of `node` is changed
+    void ChangingValue(pugi::xml_node node);
+
+    // Rolls back `segment` and every segment recorded after it that wrote to an overlapping part
+    // of the document. Returns those later segments in the order they were recorded, they have to
+    // be applied again. All rolled back segments are empty afterwards.
+    std::vector<size_t> Rollback(size_t segment);
+
+  private:
+    enum class Kind { Inserted, Removed, Attribute, Value };
+
+    struct Entry {
+        Kind           kind = Kind::Inserted;
+        pugi::xml_node node = {};
+        // Removed: where the node was and the copy that keeps it
+        pugi::xml_node parent   = {};
+        pugi::xml_node previous = {};
+        // Attribute: name, the attribute in front of it and the old value if it existed
+        std::string                name          = {};
+        std::string                previous_name = {};
+        std::optional<std::string> before        = {};
+    };
+
+    struct Segment {
+        std::string       name;
+        uint64_t          sequence = 0;
+        std::deque<Entry> entries;
+    };
+
+    void Record(Entry entry);
+    void Track(pugi::xml_node *handle);
+    void Untrack(pugi::xml_node *handle);
+    // Points every tracked handle into `from` to the matching node in `to`
+    void Retarget(pugi::xml_node from, pugi::xml_node to);
+    void Undo(Entry &entry);
+    bool Overlaps(const Segment &a, const Segment &b) const;
+
+    // Removed subtrees live on here until they are restored
+    pugi::xml_document  graveyard_;
+    std::deque<Segment> segments_;
+    size_t              current_  = 0;
+    uint64_t            sequence_ = 0;
+    // Every recorded handle, by the node it points to, so they can follow a node when it moves
+    std::unordered_map<pugi::xml_node_struct *, std::vector<pugi::xml_node *>> handles_;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "pugixml.hpp"
+#include "xml_operations.h"
+#include "xml_parts.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// A large document like assets.xml kept as raw bytes. Only the assets and templates ops are
+// confined to (see XmlOperation::Confinement) are parsed, each into a document of its own.
+// Printing copies everything else verbatim, so the output is equivalent to printing the whole
+// document but keeps the original formatting of untouched parts. The first op that may reach
+// further parses the whole document, so does an asset that does not parse on its own.
+class XmlLazyDocument
+{
+  public:
+    // Empty if `buffer` cannot be scanned. `threads` defaults to the number of cores.
+    static std::optional<XmlLazyDocument> Scan(std::string buffer, size_t threads = 0);
+    // Same with an index of `buffer` that was scanned before
+    static std::optional<XmlLazyDocument> Open(std::string buffer, XmlPartIndex index,
+                                               size_t threads = 0);
+
+    // Same as XmlOperation::ApplyAll on the whole document
+    void        ApplyAll(std::vector<XmlOperation> &operations);
+    std::string Print() const;
+    // Parses the whole document and returns it, all ops go there from then on
+    std::shared_ptr<pugi::xml_document> Materialize();
+
+    // Number of assets and templates parsed so far
+    size_t Parsed() const;
+
+  private:
+    XmlLazyDocument() = default;
+
+    std::string  buffer_;
+    XmlPartIndex index_;
+    // Parsed parts by index, nullptr while untouched
+    std::vector<std::shared_ptr<pugi::xml_document>> documents_;
+    std::shared_ptr<pugi::xml_document>              whole_;
+
+    size_t threads_ = 1;
+};
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "pugixml.hpp"
+#include "xml_arena_document.h"
+#include "xml_changes.h"
+#include "xml_footprint.h"
+#include "xml_journal.h"
+#include "xml_plan.h"
 
 #include <filesystem>
 #include <optional>
@@ -9,6 +14,16 @@
 
 namespace fs = std::filesystem;
 
+// Optional extras for XmlOperation::Apply
+struct ApplyContext {
+    // Records every change so it can be rolled back
+    XmlJournal *journal = nullptr;
+    // Collects what the op read and wrote
+    XmlFootprint *footprint = nullptr;
+    // Collects the names of everything the op changed
+    XmlChanges *changes = nullptr;
+};
+
 class XmlOperation
 {
   public:
@@ -21,8 +36,27 @@ class XmlOperation
     pugi::xml_object_range<pugi::xml_node_iterator> GetContentNode();
     Type                                            GetType() const;
     std::string                                     GetPath();
-
-    void Apply(std::shared_ptr<pugi::xml_document> doc);
+    // The asset or template (see XmlFootprint) everything the op reads and writes is inside of,
+    // EVERYTHING if it may reach further, empty if the op does nothing
+    std::string Confinement() const;
+
+    void Apply(std::shared_ptr<pugi::xml_document> doc, const ApplyContext &context = {});
+    // Apply in two steps. Resolve only reads the document and returns nothing if the op does
+    // nothing or its path is broken, ApplyTo changes the targets Resolve found.
+    std::optional<pugi::xpath_node_set> Resolve(std::shared_ptr<pugi::xml_document> doc);
+    // How the last Resolve found the targets, RelativeXPath if the path below the asset or
+    // template did and FullScan if it went over the whole document
+    XmlPlan::Kind LastLookup() const;
+    void ApplyTo(const pugi::xpath_node_set &targets, const ApplyContext &context = {});
+    // Apply on the arena backend, without extras. Returns false, having changed nothing, if the
+    // op's path is beyond what XmlArenaDocument::Select evaluates.
+    bool Apply(XmlArenaDocument &doc);
+    // How Apply on `doc` would find the targets, without changing anything. GUID and Template
+    // ops seek their asset or template in an index, then walk their path relative to it and the
+    // whole path if that finds nothing. Arena only, pugixml walks the document for the asset.
+    XmlPlan Explain(XmlArenaDocument &doc);
+    // Whether Resolve may find something else after `changes`
+    bool Affected(const XmlChanges &changes) const;
 
   public:
     static std::vector<XmlOperation> GetXmlOperations(std::shared_ptr<pugi::xml_document> doc,
@@ -30,6 +64,14 @@ class XmlOperation
                                                       fs::path    game_path = {},
                                                       fs::path    mod_path  = {},
                                                       fs::path    doc_path  = {});
+    // Applies `operations` in order. Runs of GUID and Template ops confined to different assets
+    // are applied concurrently, each to a copy of its asset in a document of its own. The targets
+    // of all other ops are resolved concurrently up front and only resolved again if an op before
+    // changed something they look at. The result is the same as applying them one by one.
+    // `threads` defaults to the number of cores.
+    static void ApplyAll(std::shared_ptr<pugi::xml_document> doc,
+                         std::vector<XmlOperation> &operations, const ApplyContext &context = {},
+                         size_t threads = 0);
     static std::vector<XmlOperation> GetXmlOperationsFromFile(fs::path    path,
                                                               std::string mod_name  = "",
                                                               fs::path    game_path = {},
@@ -38,10 +80,12 @@ class XmlOperation
   private:
     Type        type_;
     std::string path_;
+    XmlQuery    query_;
 
-    std::string speculative_path_;
-    std::string guid_;
-    std::string template_;
+    std::string   speculative_path_;
+    std::string   guid_;
+    std::string   template_;
+    XmlPlan::Kind last_lookup_ = XmlPlan::FullScan;
 
     std::optional<pugi::xml_object_range<pugi::xml_node_iterator>> nodes_;
 
@@ -68,18 +112,25 @@ class XmlOperation
     {
         return node.attribute(prop_name.c_str()).as_string();
     }
-    void RecursiveMerge(pugi::xml_node root_game_node, pugi::xml_node game_node,
-                        pugi::xml_node patching_node);
+    template <typename Targets>
+    void ApplyToTargets(const Targets &targets, const ApplyContext &context);
+    template <typename Node>
+    void RecursiveMerge(Node root_game_node, Node game_node, pugi::xml_node patching_node,
+                        const ApplyContext &context);
+    void WarnNoMatch();
     void ReadPath(pugi::xml_node node, std::string guid = "", std::string temp = "");
     void ReadType(pugi::xml_node node, std::string mod_name, fs::path game_path, fs::path mod_path);
 
-    std::optional<pugi::xml_node> FindAsset(std::string guid, pugi::xml_node node);
-    std::optional<pugi::xml_node> FindTemplate(std::string temp, pugi::xml_node node);
+    template <typename Node> std::optional<Node> FindAsset(std::string guid, Node node);
+    template <typename Node> std::optional<Node> FindTemplate(std::string temp, Node node);
 
     std::optional<pugi::xml_node> FindAsset(std::shared_ptr<pugi::xml_document> doc,
                                             std::string                         guid);
     std::optional<pugi::xml_node> FindTemplate(std::shared_ptr<pugi::xml_document> doc,
                                                std::string                         temp);
+    // The same from the value indexes of `doc`
+    std::optional<XmlArenaNode> FindAsset(XmlArenaDocument &doc, std::string guid);
+    std::optional<XmlArenaNode> FindTemplate(XmlArenaDocument &doc, std::string temp);
 
     pugi::xpath_node_set ReadGuidNodes(std::shared_ptr<pugi::xml_document> doc);
     pugi::xpath_node_set ReadTemplateNodes(std::shared_ptr<pugi::xml_document> doc);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Byte range of an outermost asset or template in a raw XML buffer
+struct XmlPart {
+    size_t begin = 0;
+    size_t end   = 0;
+};
+
+// Where the asset or template with `key` (see XmlFootprint::Key) is
+struct XmlPartKey {
+    std::string key;
+    // Byte range of the element itself, nested ones included
+    size_t begin = 0;
+    size_t end   = 0;
+    // Outermost part it is in, XmlPartIndex::DUPLICATE if the key is in more than one place
+    size_t part = 0;
+};
+
+// How often an element name occurs
+struct XmlNameCount {
+    std::string name;
+    size_t      count = 0;
+};
+
+// Where the assets and templates of a raw XML buffer are, found without parsing it
+struct XmlPartIndex {
+    static constexpr size_t DUPLICATE = std::numeric_limits<size_t>::max();
+    static constexpr size_t NOT_FOUND = DUPLICATE - 1;
+
+    // In document order
+    std::vector<XmlPart> parts;
+    // Every asset and template, nested ones included, sorted by key
+    std::vector<XmlPartKey> keys;
+    // Every element name, sorted
+    std::vector<XmlNameCount> names;
+
+    // Part the key is in, NOT_FOUND or DUPLICATE
+    size_t Find(std::string_view key) const;
+    // The element with `key` cut out of `buffer`, empty if there is not exactly one
+    std::string_view Extract(std::string_view buffer, std::string_view key) const;
+    // Number of elements named `name`
+    size_t Count(std::string_view name) const;
+
+    // Empty if the buffer is not well-formed enough to tell or a key is not plain text
+    static std::optional<XmlPartIndex> Scan(std::string_view buffer);
+
+    // Binary form to keep the index next to the buffer it was scanned from
+    std::string                        Save() const;
+    static std::optional<XmlPartIndex> Load(std::string_view data);
+};
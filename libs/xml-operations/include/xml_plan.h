@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// How a path finds its targets in an XmlArenaDocument, for EXPLAIN output. Visits count the nodes
+// tested against a step of the path.
+struct XmlPlan {
+    enum Kind {
+        // Looked up by value, see XmlValueIndex
+        IndexSeek,
+        // Only the elements of the name the path starts with
+        PostingScan,
+        // Walks down from the root or a node looked up before
+        RelativeXPath,
+        // Every node, in the arena or with pugixml
+        FullScan,
+    };
+
+    Kind        kind = FullScan;
+    std::string path;
+    size_t      estimated_visits = 0;
+    // The arena can't evaluate the path, pugixml does
+    bool pugixml = false;
+
+    static const char *Name(Kind kind);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "pugixml.hpp"
+#include "xml_operations.h"
+#include "xml_parts.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A large document like assets.xml, split into its outermost Group and Assets elements.
+// Every shard is parsed into a document of its own, everything around them goes into a
+// skeleton document. Parsing, printing and ops confined to a single asset or template (see
+// XmlOperation::Confinement) run on all shards concurrently. Any other op needs the whole
+// document, the shards are joined into the skeleton the first time one comes along.
+class XmlShardedDocument
+{
+  public:
+    // Empty if `buffer` does not split into at least two shards or does not parse.
+    // `threads` defaults to the number of cores.
+    static std::optional<XmlShardedDocument> Parse(std::string_view buffer, size_t threads = 0);
+    // Same with an index of `buffer` that was scanned before, which tells the shards of the
+    // assets and templates instead of looking through the parsed shards for them
+    static std::optional<XmlShardedDocument> Open(std::string_view    buffer,
+                                                  const XmlPartIndex &index, size_t threads = 0);
+
+    // Same as XmlOperation::ApplyAll on the whole document
+    void ApplyAll(std::vector<XmlOperation> &operations);
+    // Same as printing the whole document with pugi::format_raw. Joins the shards if their
+    // placeholders can't be told apart in the printed skeleton.
+    std::string Print();
+    // Joins the shards into the skeleton and returns it, it is the whole document from then on
+    std::shared_ptr<pugi::xml_document> Materialize();
+
+    size_t Shards() const;
+
+  private:
+    XmlShardedDocument() = default;
+
+    static std::optional<XmlShardedDocument> Parse(std::string_view buffer,
+                                                   const XmlPartIndex *index, size_t threads);
+
+    std::shared_ptr<pugi::xml_document>              skeleton_;
+    std::vector<std::shared_ptr<pugi::xml_document>> shards_;
+    // Where shards_[i] goes in skeleton_
+    std::vector<pugi::xml_node> placeholders_;
+    // Keys (see XmlFootprint::Key) of all assets and templates to the shard they are in,
+    // shards_.size() for the skeleton
+    std::unordered_map<std::string, size_t> index_;
+
+    size_t threads_      = 1;
+    bool   materialized_ = false;
+};
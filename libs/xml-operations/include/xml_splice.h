@@ -0,0 +1,34 @@
+#pragma once
+
+#include "pugixml.hpp"
+#include "xml_footprint.h"
+#include "xml_operations.h"
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Patches a document again after one patch file in a chain changed, without replaying every
+// later patch on the full document.
+// The new version of the changed patch is applied to the document it was applied to before.
+// Later ops only run again if their footprint overlaps what the old or new version wrote, every
+// other asset and template is taken over from the previous result of the whole chain.
+struct XmlSplice {
+    std::shared_ptr<pugi::xml_document> document;
+    // One per op of the new version of the changed patch
+    std::vector<XmlFootprint> footprints;
+    // One per later op, updated for those that ran again
+    std::vector<XmlFootprint> later_footprints;
+    size_t                    rerun = 0;
+
+    // `base` is the document the changed patch was applied to, `cached` the previous result of
+    // the chain. `old_footprints` were recorded by the old version of the changed patch,
+    // `later_footprints` by the `later` ops while `cached` was built.
+    // Returns nothing if a footprint is not precise enough, replay the chain in that case.
+    static std::optional<XmlSplice> Apply(const pugi::xml_document &base,
+                                          const pugi::xml_document &cached,
+                                          const std::vector<XmlFootprint> &old_footprints,
+                                          std::vector<XmlOperation> &changed,
+                                          std::vector<XmlOperation *> later,
+                                          const std::vector<XmlFootprint> &later_footprints);
+};
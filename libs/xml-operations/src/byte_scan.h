@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define XML_BYTE_SCAN_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XML_BYTE_SCAN_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace byte_scan
+{
+inline unsigned CountTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+} // namespace byte_scan
+
+// Position of the first `a`, `b` or `c` at or after `position`, npos if there is none. Compares
+// 32 (AVX2) or 16 (SSE2) bytes at once, whatever the build targets, the rest byte by byte.
+inline size_t FindAnyOf(std::string_view buffer, size_t position, char a, char b, char c)
+{
+    const char  *data = buffer.data();
+    const size_t size = buffer.size();
+    if (position >= size) {
+        return std::string_view::npos;
+    }
+
+#ifdef XML_BYTE_SCAN_AVX2
+    {
+        const auto wide_a = _mm256_set1_epi8(a);
+        const auto wide_b = _mm256_set1_epi8(b);
+        const auto wide_c = _mm256_set1_epi8(c);
+        for (; size - position >= 32; position += 32) {
+            const auto chunk =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + position));
+            const auto found = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, wide_a), _mm256_cmpeq_epi8(chunk, wide_b)),
+                _mm256_cmpeq_epi8(chunk, wide_c));
+            const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(found));
+            if (mask != 0) {
+                return position + byte_scan::CountTrailingZeros(mask);
+            }
+        }
+    }
+#endif
+#ifdef XML_BYTE_SCAN_SSE2
+    {
+        const auto wide_a = _mm_set1_epi8(a);
+        const auto wide_b = _mm_set1_epi8(b);
+        const auto wide_c = _mm_set1_epi8(c);
+        for (; size - position >= 16; position += 16) {
+            const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position));
+            const auto found = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, wide_a), _mm_cmpeq_epi8(chunk, wide_b)),
+                _mm_cmpeq_epi8(chunk, wide_c));
+            const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(found));
+            if (mask != 0) {
+                return position + byte_scan::CountTrailingZeros(mask);
+            }
+        }
+    }
+#endif
+    for (; position < size; ++position) {
+        const char current = data[position];
+        if (current == a || current == b || current == c) {
+            return position;
+        }
+    }
+    return std::string_view::npos;
+}
+
+inline size_t FindByte(std::string_view buffer, size_t position, char c)
+{
+    return FindAnyOf(buffer, position, c, c, c);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Runs `work(i)` for every i in [0, count) on up to `threads` threads, the calling one included
+template <typename Work> void ParallelFor(size_t count, size_t threads, const Work &work)
+{
+    std::atomic<size_t> next = 0;
+    const auto          run  = [&]() {
+        for (size_t i; (i = next++) < count;) {
+            work(i);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(threads, count); ++i) {
+        workers.emplace_back(run);
+    }
+    run();
+    for (auto &&worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pugixml.hpp"
+
+#include <string>
+
+// Collects what pugi prints
+struct StringWriter : pugi::xml_writer {
+    std::string result;
+
+    void write(const void *data, size_t size) override
+    {
+        result.append(static_cast<const char *>(data), size);
+    }
+};
+
+// How pugi ends an empty element with format_raw, " />" or "/>" depending on its version
+inline const std::string &EmptyElementEnd()
+{
+    static const std::string end = [] {
+        pugi::xml_document document;
+        document.append_child("e");
+        StringWriter writer;
+        document.print(writer, "", pugi::format_raw);
+        return writer.result.substr(2);
+    }();
+    return end;
+}
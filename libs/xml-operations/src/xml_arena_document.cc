@@ -0,0 +1,1333 @@
+#include "string_writer.h"
+#include "xml_arena_document.h"
+#include "xml_markup.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+constexpr auto npos = std::string_view::npos;
+
+bool IsNameStart(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_'
+           || static_cast<unsigned char>(c) >= 0x80;
+}
+
+bool IsNameChar(char c)
+{
+    return IsNameStart(c) || (c >= '0' && c <= '9') || c == '-' || c == '.';
+}
+
+bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+void AppendUtf8(std::string &output, unsigned long code)
+{
+    if (code < 0x80) {
+        output += static_cast<char>(code);
+    } else if (code < 0x800) {
+        output += static_cast<char>(0xC0 | (code >> 6));
+        output += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        output += static_cast<char>(0xE0 | (code >> 12));
+        output += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        output += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        output += static_cast<char>(0xF0 | (code >> 18));
+        output += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        output += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        output += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+// Whether pugixml's default flags change `text` while parsing
+bool NeedsDecoding(std::string_view text, bool attribute)
+{
+    return text.find_first_of(attribute ? "&\r\n\t" : "&\r") != npos;
+}
+
+// Appends `text` the way pugixml's default flags parse it: entities and character references
+// decoded, line endings normalized and, in attributes, whitespace turned into spaces
+void Decode(std::string &output, std::string_view text, bool attribute)
+{
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        if (c == '\r') {
+            if (i + 1 < text.size() && text[i + 1] == '\n') {
+                ++i;
+            }
+            output += attribute ? ' ' : '\n';
+        } else if (attribute && (c == '\n' || c == '\t')) {
+            output += ' ';
+        } else if (c == '&') {
+            const auto end    = text.find(';', i);
+            const auto entity = text.substr(i + 1, end == npos ? 0 : end - i - 1);
+            if (entity == "lt") {
+                output += '<';
+            } else if (entity == "gt") {
+                output += '>';
+            } else if (entity == "amp") {
+                output += '&';
+            } else if (entity == "apos") {
+                output += '\'';
+            } else if (entity == "quot") {
+                output += '"';
+            } else if (entity.size() > 1 && entity[0] == '#') {
+                const bool hex   = entity[1] == 'x';
+                const auto value = std::string(entity.substr(hex ? 2 : 1));
+                AppendUtf8(output, std::strtoul(value.c_str(), nullptr, hex ? 16 : 10));
+            } else {
+                // Left as it is, like pugixml does
+                output += c;
+                continue;
+            }
+            i = end;
+        } else {
+            output += c;
+        }
+    }
+}
+
+// Appends `text` escaped like pugixml prints it
+void Escape(std::string &output, std::string_view text, bool attribute)
+{
+    for (const char c : text) {
+        const auto code = static_cast<unsigned char>(c);
+        if (c == '&') {
+            output += "&amp;";
+        } else if (c == '<') {
+            output += "&lt;";
+        } else if (c == '>') {
+            output += "&gt;";
+        } else if (c == '"' && attribute) {
+            output += "&quot;";
+        } else if (code < 32 && (attribute || (c != '\t' && c != '\n' && c != '\r'))) {
+            output += "&#";
+            output += static_cast<char>('0' + code / 10);
+            output += static_cast<char>('0' + code % 10);
+            output += ';';
+        } else {
+            output += c;
+        }
+    }
+}
+} // namespace
+
+// Fills a document from WalkMarkup. The walk reads text_, so decoded text is collected aside
+// and appended once it is done.
+class XmlArenaBuilder
+{
+  public:
+    explicit XmlArenaBuilder(XmlArenaDocument &document)
+        : document_(document)
+        , source_(document.text_)
+        , open_{0}
+    {
+    }
+
+    bool Open(std::string_view name, size_t begin)
+    {
+        const auto id   = document_.Intern(name);
+        const auto node = document_.AddNode(pugi::node_element, id, {});
+        document_.Link(node, open_.back(), document_.last_children_[open_.back()]);
+        document_.postings_[id].nodes.push_back(node);
+        open_.push_back(node);
+        return ReadAttributes(node, begin + 1 + name.size());
+    }
+
+    bool Close(std::string_view, size_t)
+    {
+        open_.pop_back();
+        return true;
+    }
+
+    bool Text(size_t begin, size_t end)
+    {
+        const auto text  = source_.substr(begin, end - begin);
+        const bool cdata = begin > 0 && source_[begin - 1] == '[';
+        if (open_.size() == 1) {
+            return true;
+        }
+        if (!cdata) {
+            size_t i = 0;
+            while (i < text.size() && IsSpace(text[i])) {
+                ++i;
+            }
+            if (i == text.size()) {
+                // Dropped by pugixml without parse_ws_pcdata
+                return true;
+            }
+        }
+        const auto node =
+            document_.AddNode(cdata ? pugi::node_cdata : pugi::node_pcdata, 0, Value(text, false));
+        document_.Link(node, open_.back(), document_.last_children_[open_.back()]);
+        return true;
+    }
+
+    void Finish() { document_.text_ += decoded_; }
+
+  private:
+    XmlArenaDocument::Slice Value(std::string_view text, bool attribute)
+    {
+        if (!NeedsDecoding(text, attribute)) {
+            return {static_cast<uint32_t>(text.data() - source_.data()),
+                    static_cast<uint32_t>(text.size())};
+        }
+        const auto begin = source_.size() + decoded_.size();
+        Decode(decoded_, text, attribute);
+        return {static_cast<uint32_t>(begin),
+                static_cast<uint32_t>(source_.size() + decoded_.size() - begin)};
+    }
+
+    bool ReadAttributes(uint32_t node, size_t position)
+    {
+        uint32_t last = XmlArenaDocument::NONE;
+        for (;;) {
+            while (position < source_.size() && IsSpace(source_[position])) {
+                ++position;
+            }
+            if (position >= source_.size()) {
+                return false;
+            }
+            if (source_[position] == '>' || source_[position] == '/') {
+                return true;
+            }
+
+            const auto name_begin = position;
+            while (position < source_.size() && IsNameChar(source_[position])) {
+                ++position;
+            }
+            const auto name = source_.substr(name_begin, position - name_begin);
+            while (position < source_.size() && IsSpace(source_[position])) {
+                ++position;
+            }
+            if (name.empty() || position >= source_.size() || source_[position] != '=') {
+                return false;
+            }
+            ++position;
+            while (position < source_.size() && IsSpace(source_[position])) {
+                ++position;
+            }
+            if (position >= source_.size()
+                || (source_[position] != '"' && source_[position] != '\'')) {
+                return false;
+            }
+            const auto end = source_.find(source_[position], position + 1);
+            if (end == npos) {
+                return false;
+            }
+
+            const auto attribute = static_cast<uint32_t>(document_.attribute_names_.size());
+            document_.attribute_names_.push_back(document_.Intern(name));
+            document_.attribute_values_.push_back(
+                Value(source_.substr(position + 1, end - position - 1), true));
+            document_.next_attributes_.push_back(XmlArenaDocument::NONE);
+            if (last == XmlArenaDocument::NONE) {
+                document_.first_attributes_[node] = attribute;
+            } else {
+                document_.next_attributes_[last] = attribute;
+            }
+            last     = attribute;
+            position = end + 1;
+        }
+    }
+
+    XmlArenaDocument     &document_;
+    std::string_view      source_;
+    std::string           decoded_;
+    std::vector<uint32_t> open_;
+};
+
+// Visits everything below `root` in document order, without recursing
+template <typename Visit> void XmlArenaDocument::ForEachBelow(uint32_t root, Visit visit) const
+{
+    auto node = first_children_[root];
+    while (node != NONE) {
+        visit(node);
+        if (first_children_[node] != NONE) {
+            node = first_children_[node];
+            continue;
+        }
+        while (node != root && next_siblings_[node] == NONE) {
+            node = parents_[node];
+        }
+        node = node == root ? NONE : next_siblings_[node];
+    }
+}
+
+// The XPath subset of XmlArenaDocument::Select
+class XmlArenaQuery
+{
+  public:
+    explicit XmlArenaQuery(XmlArenaDocument &document)
+        : document_(document)
+    {
+    }
+
+    bool Compile(std::string_view path)
+    {
+        size_t position = 0;
+        absolute_       = !path.empty() && path[0] == '/';
+        if (auto step = ReadFunction(path, position)) {
+            if (!ReadPredicates(path, position, *step)) {
+                return false;
+            }
+            steps_.push_back(std::move(*step));
+            absolute_ = true;
+        }
+        while (position < path.size() || steps_.empty()) {
+            Step step;
+            if (path.substr(position, 2) == "//") {
+                step.descendant = true;
+                position += 2;
+            } else if (path.substr(position, 1) == "/") {
+                position += 1;
+            } else if (position > 0) {
+                return false;
+            }
+
+            if (path.substr(position, 1) == "*") {
+                ++position;
+            } else {
+                step.name = ReadName(path, position);
+                if (step.name.empty()) {
+                    return false;
+                }
+                step.id = document_.Lookup(step.name);
+            }
+            if (!ReadPredicates(path, position, step)) {
+                return false;
+            }
+            steps_.push_back(std::move(step));
+        }
+        return true;
+    }
+
+    std::vector<uint32_t> Evaluate(uint32_t context)
+    {
+        std::vector<uint32_t> current{absolute_ ? 0 : context};
+        size_t                visits = 0;
+        leading_                     = XmlArenaDocument::NONE;
+        scopes_                      = current;
+        for (const auto &step : steps_) {
+            if (step.descendant && !step.name.empty() && current.size() == 1 && current[0] == 0) {
+                // Every element of the name is below the root
+                std::vector<uint32_t> next;
+                if (step.id != XmlArenaDocument::NONE) {
+                    const auto *indexed    = Indexed(step);
+                    const auto *candidates =
+                        indexed ? indexed : &document_.postings_[step.id].nodes;
+                    // The candidates only change with the postings. Unless they are all there is
+                    // to the path, what they have below them matters too.
+                    const bool members_only = steps_.size() == 1
+                                              && step.predicates.size() == (indexed ? 1 : 0);
+                    leading_ = step.id;
+                    scopes_.clear();
+                    visits += candidates->size();
+                    for (const auto node : *candidates) {
+                        if (document_.removed_[node]) {
+                            continue;
+                        }
+                        if (!members_only) {
+                            scopes_.push_back(node);
+                        }
+                        if (Matches(node, step)) {
+                            next.push_back(node);
+                        }
+                    }
+                }
+                current = std::move(next);
+                continue;
+            }
+
+            // Contexts inside other contexts are reached walking those, in document order
+            std::vector<char>     marked;
+            std::vector<uint32_t> outer = current;
+            if (current.size() > 1) {
+                marked.resize(document_.Size());
+                for (const auto node : current) {
+                    marked[node] = true;
+                }
+                outer.clear();
+                for (const auto node : current) {
+                    auto parent = document_.parents_[node];
+                    while (parent != XmlArenaDocument::NONE && !marked[parent]) {
+                        parent = document_.parents_[parent];
+                    }
+                    if (parent == XmlArenaDocument::NONE) {
+                        outer.push_back(node);
+                    }
+                }
+            }
+            const bool nested = outer.size() != current.size();
+
+            std::vector<uint32_t> next;
+            for (const auto node : outer) {
+                if (step.descendant) {
+                    document_.ForEachBelow(node, [&](uint32_t descendant) {
+                        visits++;
+                        if (Matches(descendant, step)) {
+                            next.push_back(descendant);
+                        }
+                    });
+                } else if (nested) {
+                    document_.ForEachBelow(node, [&](uint32_t descendant) {
+                        visits++;
+                        if (marked[document_.parents_[descendant]] && Matches(descendant, step)) {
+                            next.push_back(descendant);
+                        }
+                    });
+                } else {
+                    for (auto child = document_.first_children_[node];
+                         child != XmlArenaDocument::NONE;
+                         child = document_.next_siblings_[child]) {
+                        visits++;
+                        if (Matches(child, step)) {
+                            next.push_back(child);
+                        }
+                    }
+                }
+            }
+            current = std::move(next);
+        }
+        document_.visits_ += visits;
+        return current;
+    }
+
+    // Estimates what Evaluate visits. The leading step is counted from the postings and value
+    // indexes, child steps by the average number of children of an element, and descendant
+    // steps by the number of nodes below where the path starts.
+    // What the last Evaluate result depends on: the postings of Leading() unless that is NONE,
+    // and everything at or below Scopes()
+    uint32_t                     Leading() const { return leading_; }
+    const std::vector<uint32_t> &Scopes() const { return scopes_; }
+
+    XmlPlan Plan(uint32_t context) const
+    {
+        XmlPlan    plan;
+        const auto start = absolute_ ? 0 : context;
+        size_t     below = 0;
+        if (start == 0) {
+            below = document_.Size() - document_.removed_nodes_ - 1;
+        } else {
+            document_.ForEachBelow(start, [&](uint32_t) { below++; });
+        }
+        size_t elements = 0;
+        for (const auto &postings : document_.postings_) {
+            elements += postings.nodes.size() - postings.removed;
+        }
+        const double fanout = elements ? double(document_.Size() - document_.removed_nodes_ - 1)
+                                             / elements
+                                       : 0;
+
+        plan.kind       = start == 0 && steps_[0].descendant ? XmlPlan::FullScan
+                                                             : XmlPlan::RelativeXPath;
+        double contexts = 1;
+        double visits   = 0;
+        for (size_t i = 0; i < steps_.size(); ++i) {
+            const auto &step  = steps_[i];
+            const auto  named = [&](size_t count) {
+                if (step.name.empty()) {
+                    return double(count);
+                }
+                const auto &postings = document_.postings_[step.id];
+                return step.id == XmlArenaDocument::NONE
+                           ? 0.0
+                           : double(std::min(count, postings.nodes.size() - postings.removed));
+            };
+
+            double tested = 0;
+            if (i == 0 && start == 0 && step.descendant && !step.name.empty()) {
+                const auto *indexed = Indexed(step);
+                tested              = indexed ? indexed->size() : named(below);
+                plan.kind           = indexed ? XmlPlan::IndexSeek : XmlPlan::PostingScan;
+                contexts            = tested;
+            } else {
+                tested   = std::min<double>(below, step.descendant ? below : contexts * fanout);
+                contexts = named(static_cast<size_t>(tested));
+            }
+            visits += tested;
+        }
+        plan.estimated_visits = static_cast<size_t>(visits);
+        return plan;
+    }
+
+  private:
+    struct Predicate;
+    struct Step;
+
+    // Elements a value index has for an equality predicate of `step`, null if there is none
+    const std::vector<uint32_t> *Indexed(const Step &step) const
+    {
+        if (step.id == XmlArenaDocument::NONE) {
+            return nullptr;
+        }
+        for (const auto &predicate : step.predicates) {
+            if (predicate.literal && predicate.attribute == XmlArenaDocument::NONE
+                && !predicate.unknown) {
+                if (const auto *found =
+                        document_.FindByValue(step.id, predicate.path, *predicate.literal)) {
+                    return found;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    struct Predicate {
+        // Child element names to walk down
+        std::vector<uint32_t> path;
+        // Attribute of the last one, NONE for the element itself
+        uint32_t                   attribute = XmlArenaDocument::NONE;
+        bool                       unknown   = false;
+        std::optional<std::string> literal;
+    };
+
+    struct Step {
+        bool        descendant = false;
+        std::string name;
+        // NONE for * or names the document does not have
+        uint32_t               id = XmlArenaDocument::NONE;
+        std::vector<Predicate> predicates;
+    };
+
+    static std::string ReadName(std::string_view path, size_t &position)
+    {
+        if (position >= path.size() || !IsNameStart(path[position])) {
+            return {};
+        }
+        const auto begin = position;
+        while (position < path.size() && IsNameChar(path[position])) {
+            ++position;
+        }
+        return std::string(path.substr(begin, position - begin));
+    }
+
+    // `guid('X')` and `template('X')` select the assets and templates XmlOperation looks up for
+    // GUID and Template attributes, so they seek through the value indexes on those
+    std::optional<Step> ReadFunction(std::string_view path, size_t &position)
+    {
+        const auto open = path.find('(');
+        if (open == npos) {
+            return {};
+        }
+        const auto function = path.substr(0, open);
+        const bool asset    = function == "guid";
+        if (!asset && function != "template") {
+            return {};
+        }
+        const auto quote = path.substr(open + 1, 1);
+        if (quote != "'" && quote != "\"") {
+            return {};
+        }
+        const auto close = path.find(quote, open + 2);
+        if (close == npos || path.substr(close + 1, 1) != ")") {
+            return {};
+        }
+
+        Step step;
+        step.descendant = true;
+        step.name       = asset ? "Asset" : "Template";
+        step.id         = document_.Lookup(step.name);
+        auto predicate  = ReadPredicate(std::string(asset ? "Values/Standard/GUID=" : "Name=")
+                                       + std::string(path.substr(open + 1, close - open)));
+        if (!predicate) {
+            return {};
+        }
+        step.predicates.push_back(std::move(*predicate));
+        position = close + 2;
+        return step;
+    }
+
+    bool ReadPredicates(std::string_view path, size_t &position, Step &step)
+    {
+        while (path.substr(position, 1) == "[") {
+            const auto end = PredicateEnd(path, position + 1);
+            if (end == npos) {
+                return false;
+            }
+            auto predicate = ReadPredicate(path.substr(position + 1, end - position - 1));
+            if (!predicate) {
+                return false;
+            }
+            step.predicates.push_back(std::move(*predicate));
+            position = end + 1;
+        }
+        return true;
+    }
+
+    static size_t PredicateEnd(std::string_view path, size_t position)
+    {
+        for (; position < path.size(); ++position) {
+            const char c = path[position];
+            if (c == '\'' || c == '"') {
+                position = path.find(c, position + 1);
+                if (position == npos) {
+                    return npos;
+                }
+            } else if (c == '[') {
+                return npos;
+            } else if (c == ']') {
+                return position;
+            }
+        }
+        return npos;
+    }
+
+    std::optional<Predicate> ReadPredicate(std::string_view text)
+    {
+        Predicate predicate;
+        size_t    position = 0;
+        const auto skip    = [&] {
+            while (position < text.size() && IsSpace(text[position])) {
+                ++position;
+            }
+        };
+
+        skip();
+        for (;;) {
+            const bool attribute = text.substr(position, 1) == "@";
+            position += attribute;
+            const auto name = ReadName(text, position);
+            if (name.empty()) {
+                return {};
+            }
+            const auto id = document_.Lookup(name);
+            predicate.unknown |= id == XmlArenaDocument::NONE;
+            if (attribute) {
+                predicate.attribute = id;
+                break;
+            }
+            predicate.path.push_back(id);
+            if (text.substr(position, 1) != "/") {
+                break;
+            }
+            ++position;
+        }
+        skip();
+        if (position < text.size()) {
+            if (text[position] != '=') {
+                return {};
+            }
+            ++position;
+            skip();
+            if (position >= text.size() || (text[position] != '\'' && text[position] != '"')) {
+                return {};
+            }
+            const auto end = text.find(text[position], position + 1);
+            predicate.literal = std::string(text.substr(position + 1, end - position - 1));
+            position          = end + 1;
+            skip();
+        }
+        if (position < text.size()) {
+            return {};
+        }
+        return predicate;
+    }
+
+    bool Matches(uint32_t node, const Step &step) const
+    {
+        if (document_.types_[node] != pugi::node_element
+            || (!step.name.empty() && document_.node_names_[node] != step.id)) {
+            return false;
+        }
+        for (const auto &predicate : step.predicates) {
+            if (predicate.unknown || !Matches(node, predicate, 0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether any node `predicate.path` leads to from `node` satisfies it
+    bool Matches(uint32_t node, const Predicate &predicate, size_t depth) const
+    {
+        if (depth < predicate.path.size()) {
+            for (auto child = document_.first_children_[node]; child != XmlArenaDocument::NONE;
+                 child       = document_.next_siblings_[child]) {
+                if (document_.types_[child] == pugi::node_element
+                    && document_.node_names_[child] == predicate.path[depth]
+                    && Matches(child, predicate, depth + 1)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (predicate.attribute != XmlArenaDocument::NONE) {
+            for (auto attribute = document_.first_attributes_[node];
+                 attribute != XmlArenaDocument::NONE;
+                 attribute = document_.next_attributes_[attribute]) {
+                if (document_.attribute_names_[attribute] == predicate.attribute) {
+                    return !predicate.literal
+                           || document_.Text(document_.attribute_values_[attribute])
+                                  == *predicate.literal;
+                }
+            }
+            return false;
+        }
+        return !predicate.literal || document_.StringValue(node) == *predicate.literal;
+    }
+
+    XmlArenaDocument &document_;
+    bool              absolute_ = false;
+    std::vector<Step> steps_;
+
+    uint32_t              leading_ = XmlArenaDocument::NONE;
+    std::vector<uint32_t> scopes_;
+};
+
+const std::vector<XmlValueIndex> XmlArenaDocument::DEFAULT_INDEXES = {
+    {"Asset", "Template"},
+    {"Standard", "Name"},
+    {"Item", "ItemType"},
+    {"Asset", "Values/Standard/GUID"},
+    {"Template", "Name"},
+};
+
+std::optional<XmlArenaDocument> XmlArenaDocument::Parse(std::string                       buffer,
+                                                        const std::vector<XmlValueIndex> &indexes)
+{
+    if (buffer.size() >= NONE / 2) {
+        return {};
+    }
+    XmlArenaDocument document;
+    document.text_ = std::move(buffer);
+    document.Intern("");
+    document.AddNode(pugi::node_document, 0, {});
+
+    XmlArenaBuilder builder(document);
+    if (!WalkMarkup(document.text_, builder)) {
+        return {};
+    }
+    builder.Finish();
+    document.parsed_ = static_cast<uint32_t>(document.Size());
+
+    for (const auto &declared : indexes) {
+        ValueIndex index;
+        index.element = document.Intern(declared.element);
+        std::string_view path = declared.path;
+        for (auto slash = path.find('/'); slash != npos; slash = path.find('/')) {
+            index.path.push_back(document.Intern(path.substr(0, slash)));
+            path.remove_prefix(slash + 1);
+        }
+        index.path.push_back(document.Intern(path));
+        for (const auto element : document.postings_[index.element].nodes) {
+            document.Reindex(index, element);
+        }
+        document.value_indexes_.push_back(std::move(index));
+    }
+    return document;
+}
+
+XmlArenaNode XmlArenaDocument::Root()
+{
+    return {this, 0};
+}
+
+std::string XmlArenaDocument::Print() const
+{
+    std::string output;
+    output.reserve(text_.size());
+    for (auto child = first_children_[0]; child != NONE; child = next_siblings_[child]) {
+        PrintNode(output, child);
+    }
+    return output;
+}
+
+std::vector<XmlArenaNode> XmlArenaDocument::Nodes(const std::vector<uint32_t> &indexes)
+{
+    std::vector<XmlArenaNode> result;
+    result.reserve(indexes.size());
+    for (const auto node : indexes) {
+        result.emplace_back(this, node);
+    }
+    return result;
+}
+
+std::optional<std::vector<XmlArenaNode>> XmlArenaDocument::Select(std::string_view path,
+                                                                  XmlArenaNode     context)
+{
+    const auto start = context ? context.Index() : 0;
+    if (path == "self::node()") {
+        return std::vector<XmlArenaNode>{{this, start}};
+    }
+
+    // Keyed by the text, compiling it again costs about as much as checking the result
+    std::string key(path);
+    if (const auto paths = results_.find(key); paths != results_.end()) {
+        const auto cached = paths->second.find(start);
+        if (cached != paths->second.end() && Valid(cached->second)) {
+            cache_hits_++;
+            return Nodes(cached->second.nodes);
+        }
+    }
+    XmlArenaQuery query(*this);
+    if (!query.Compile(path)) {
+        return {};
+    }
+    cache_misses_++;
+
+    CachedResult result;
+    result.nodes   = query.Evaluate(start);
+    result.leading = query.Leading();
+    if (result.leading != NONE) {
+        result.members = postings_[result.leading].generation;
+    }
+    result.scopes.reserve(query.Scopes().size());
+    for (const auto node : query.Scopes()) {
+        result.scopes.emplace_back(node, generations_[node]);
+    }
+    if (results_.size() >= MAX_CACHED_PATHS && !results_.count(key)) {
+        results_.clear();
+    }
+    auto &cached = results_[std::move(key)][start];
+    cached       = std::move(result);
+    return Nodes(cached.nodes);
+}
+
+std::optional<std::vector<XmlArenaNode>> XmlArenaDocument::Peek(std::string_view path,
+                                                                XmlArenaNode     context)
+{
+    const auto start = context ? context.Index() : 0;
+    if (path == "self::node()") {
+        return std::vector<XmlArenaNode>{{this, start}};
+    }
+    XmlArenaQuery query(*this);
+    if (!query.Compile(path)) {
+        return {};
+    }
+    const auto visits = visits_;
+    const auto nodes  = query.Evaluate(start);
+    visits_           = visits;
+    return Nodes(nodes);
+}
+
+XmlPlan XmlArenaDocument::Plan(std::string_view path, XmlArenaNode context)
+{
+    XmlPlan plan;
+    if (path == "self::node()") {
+        plan.kind = XmlPlan::RelativeXPath;
+    } else if (XmlArenaQuery query(*this); query.Compile(path)) {
+        plan = query.Plan(context ? context.Index() : 0);
+    } else {
+        plan.estimated_visits = Size() - removed_nodes_;
+        plan.pugixml          = true;
+    }
+    plan.path = std::string(path);
+    return plan;
+}
+
+uint32_t XmlArenaDocument::Intern(std::string_view name)
+{
+    if (const auto it = name_ids_.find(name); it != name_ids_.end()) {
+        return it->second;
+    }
+    const auto id = static_cast<uint32_t>(names_.size());
+    names_.emplace_back(name);
+    name_ids_.emplace(names_.back(), id);
+    postings_.emplace_back();
+    return id;
+}
+
+uint32_t XmlArenaDocument::Lookup(std::string_view name) const
+{
+    const auto it = name_ids_.find(name);
+    return it == name_ids_.end() ? NONE : it->second;
+}
+
+XmlArenaDocument::Slice XmlArenaDocument::Store(std::string_view text)
+{
+    const Slice slice{static_cast<uint32_t>(text_.size()), static_cast<uint32_t>(text.size())};
+    text_.append(text);
+    return slice;
+}
+
+std::string_view XmlArenaDocument::Text(Slice slice) const
+{
+    return std::string_view(text_).substr(slice.begin, slice.size);
+}
+
+uint32_t XmlArenaDocument::AddNode(pugi::xml_node_type type, uint32_t name, Slice value)
+{
+    const auto node = static_cast<uint32_t>(types_.size());
+    types_.push_back(type);
+    node_names_.push_back(name);
+    values_.push_back(value);
+    parents_.push_back(NONE);
+    first_children_.push_back(NONE);
+    last_children_.push_back(NONE);
+    next_siblings_.push_back(NONE);
+    previous_siblings_.push_back(NONE);
+    first_attributes_.push_back(NONE);
+    removed_.push_back(false);
+    generations_.push_back(0);
+    return node;
+}
+
+void XmlArenaDocument::Link(uint32_t node, uint32_t parent, uint32_t after)
+{
+    const auto next          = after == NONE ? first_children_[parent] : next_siblings_[after];
+    parents_[node]           = parent;
+    previous_siblings_[node] = after;
+    next_siblings_[node]     = next;
+    if (after == NONE) {
+        first_children_[parent] = node;
+    } else {
+        next_siblings_[after] = node;
+    }
+    if (next == NONE) {
+        last_children_[parent] = node;
+    } else {
+        previous_siblings_[next] = node;
+    }
+}
+
+void XmlArenaDocument::Unlink(uint32_t node)
+{
+    Touch(node);
+    const auto parent   = parents_[node];
+    const auto previous = previous_siblings_[node];
+    const auto next     = next_siblings_[node];
+    if (previous == NONE) {
+        first_children_[parent] = next;
+    } else {
+        next_siblings_[previous] = next;
+    }
+    if (next == NONE) {
+        last_children_[parent] = previous;
+    } else {
+        previous_siblings_[next] = previous;
+    }
+    parents_[node] = NONE;
+
+    const auto remove = [this](uint32_t removed) {
+        if (removed_[removed]) {
+            // Below a node removed before
+            return;
+        }
+        removed_[removed] = true;
+        removed_nodes_++;
+        if (types_[removed] == pugi::node_element) {
+            auto &postings = postings_[node_names_[removed]];
+            postings.removed++;
+            postings.generation = generation_;
+        }
+    };
+    remove(node);
+    ForEachBelow(node, remove);
+    Reindex(parent);
+}
+
+bool XmlArenaDocument::Before(uint32_t a, uint32_t b) const
+{
+    if (a < parsed_ && b < parsed_) {
+        // Inserting and removing nodes does not move any others
+        return a < b;
+    }
+
+    // Compare the children of the closest ancestor both are below
+    std::vector<uint32_t> a_path;
+    std::vector<uint32_t> b_path;
+    for (auto node = a; node != NONE; node = parents_[node]) {
+        a_path.push_back(node);
+    }
+    for (auto node = b; node != NONE; node = parents_[node]) {
+        b_path.push_back(node);
+    }
+    while (!a_path.empty() && !b_path.empty() && a_path.back() == b_path.back()) {
+        a_path.pop_back();
+        b_path.pop_back();
+    }
+    if (a_path.empty() || b_path.empty()) {
+        // Ancestors come first
+        return a_path.empty() && !b_path.empty();
+    }
+    const auto a_sibling = a_path.back();
+    const auto b_sibling = b_path.back();
+    if (a_sibling < parsed_ && b_sibling < parsed_) {
+        return a_sibling < b_sibling;
+    }
+    for (auto node = next_siblings_[a_sibling]; node != NONE; node = next_siblings_[node]) {
+        if (node == b_sibling) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void XmlArenaDocument::InsertSorted(std::vector<uint32_t> &nodes, uint32_t node) const
+{
+    const auto position = std::upper_bound(nodes.begin(), nodes.end(), node,
+                                           [this](uint32_t a, uint32_t b) { return Before(a, b); });
+    nodes.insert(position, node);
+}
+
+void XmlArenaDocument::Post(uint32_t node)
+{
+    const auto post = [this](uint32_t element) {
+        if (types_[element] != pugi::node_element) {
+            return;
+        }
+        auto &postings = postings_[node_names_[element]];
+        if (postings.removed > 0) {
+            const auto removed = [this](uint32_t posted) { return removed_[posted]; };
+            postings.nodes.erase(
+                std::remove_if(postings.nodes.begin(), postings.nodes.end(), removed),
+                postings.nodes.end());
+            postings.removed = 0;
+        }
+        InsertSorted(postings.nodes, element);
+        postings.generation = generation_;
+        for (auto &index : value_indexes_) {
+            if (node_names_[element] == index.element) {
+                Reindex(index, element);
+            }
+        }
+    };
+    Touch(node);
+    post(node);
+    ForEachBelow(node, post);
+    Reindex(node);
+}
+
+void XmlArenaDocument::Reindex(uint32_t node)
+{
+    for (auto &index : value_indexes_) {
+        // Text at the end of the path is one below its last element
+        auto ancestor = node;
+        for (size_t level = 0; level <= index.path.size() + 1 && ancestor != NONE; ++level) {
+            if (node_names_[ancestor] == index.element && types_[ancestor] == pugi::node_element
+                && !removed_[ancestor]) {
+                Reindex(index, ancestor);
+            }
+            ancestor = parents_[ancestor];
+        }
+    }
+}
+
+void XmlArenaDocument::Reindex(ValueIndex &index, uint32_t element)
+{
+    std::vector<std::string> values;
+    const auto               collect = [&](auto &&self, uint32_t node, size_t depth) -> void {
+        if (depth == index.path.size()) {
+            auto value = StringValue(node);
+            if (std::find(values.begin(), values.end(), value) == values.end()) {
+                values.push_back(std::move(value));
+            }
+            return;
+        }
+        for (auto child = first_children_[node]; child != NONE; child = next_siblings_[child]) {
+            if (types_[child] == pugi::node_element && node_names_[child] == index.path[depth]) {
+                self(self, child, depth + 1);
+            }
+        }
+    };
+    collect(collect, element, 0);
+
+    const auto indexed = index.values.find(element);
+    if (indexed == index.values.end() ? values.empty() : indexed->second == values) {
+        return;
+    }
+    if (indexed != index.values.end()) {
+        for (const auto &value : indexed->second) {
+            auto &nodes = index.nodes[value];
+            nodes.erase(std::find(nodes.begin(), nodes.end(), element));
+        }
+    }
+    for (const auto &value : values) {
+        InsertSorted(index.nodes[value], element);
+    }
+    index.values[element]                = std::move(values);
+    postings_[index.element].generation = ++generation_;
+}
+
+const std::vector<uint32_t> *XmlArenaDocument::FindByValue(uint32_t                     element,
+                                                           const std::vector<uint32_t> &path,
+                                                           const std::string &value) const
+{
+    static const std::vector<uint32_t> NOTHING;
+    for (const auto &index : value_indexes_) {
+        if (index.element == element && index.path == path) {
+            const auto it = index.nodes.find(value);
+            return it == index.nodes.end() ? &NOTHING : &it->second;
+        }
+    }
+    return nullptr;
+}
+
+std::string XmlArenaDocument::StringValue(uint32_t node) const
+{
+    std::string value;
+    const auto  append = [&](auto &&self, uint32_t parent) -> void {
+        for (auto child = first_children_[parent]; child != NONE; child = next_siblings_[child]) {
+            if (types_[child] == pugi::node_element) {
+                self(self, child);
+            } else {
+                value += Text(values_[child]);
+            }
+        }
+    };
+    append(append, node);
+    return value;
+}
+
+void XmlArenaDocument::Touch(uint32_t node)
+{
+    ++generation_;
+    for (; node != NONE; node = parents_[node]) {
+        generations_[node] = generation_;
+    }
+}
+
+bool XmlArenaDocument::Valid(const CachedResult &cached) const
+{
+    if (cached.leading != NONE && postings_[cached.leading].generation != cached.members) {
+        return false;
+    }
+    for (const auto &[node, generation] : cached.scopes) {
+        if (generations_[node] != generation) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t XmlArenaDocument::Copy(pugi::xml_node source)
+{
+    if (source.type() == pugi::node_pcdata || source.type() == pugi::node_cdata) {
+        return AddNode(source.type(), 0, Store(source.value()));
+    }
+    if (source.type() != pugi::node_element) {
+        return NONE;
+    }
+    const auto node = AddNode(pugi::node_element, Intern(source.name()), {});
+    for (auto attribute : source.attributes()) {
+        SetAttribute(node, attribute.name(), attribute.value());
+    }
+    for (auto child : source.children()) {
+        if (const auto copy = Copy(child); copy != NONE) {
+            Link(copy, node, last_children_[node]);
+        }
+    }
+    return node;
+}
+
+void XmlArenaDocument::SetAttribute(uint32_t node, std::string_view name, std::string_view value)
+{
+    // Like pugixml's remove_attribute and append_attribute, the attribute moves to the end
+    const auto id       = Intern(name);
+    auto       previous = NONE;
+    auto       last     = NONE;
+    for (auto attribute = first_attributes_[node]; attribute != NONE;
+         attribute      = next_attributes_[attribute]) {
+        if (attribute_names_[attribute] == id) {
+            if (previous == NONE) {
+                first_attributes_[node] = next_attributes_[attribute];
+            } else {
+                next_attributes_[previous] = next_attributes_[attribute];
+            }
+            continue;
+        }
+        previous = attribute;
+        last     = attribute;
+    }
+
+    const auto attribute = static_cast<uint32_t>(attribute_names_.size());
+    attribute_names_.push_back(id);
+    attribute_values_.push_back(Store(value));
+    next_attributes_.push_back(NONE);
+    if (last == NONE) {
+        first_attributes_[node] = attribute;
+    } else {
+        next_attributes_[last] = attribute;
+    }
+}
+
+void XmlArenaDocument::PrintNode(std::string &output, uint32_t node) const
+{
+    if (types_[node] == pugi::node_pcdata) {
+        Escape(output, Text(values_[node]), false);
+        return;
+    }
+    if (types_[node] == pugi::node_cdata) {
+        output += "<![CDATA[";
+        output += Text(values_[node]);
+        output += "]]>";
+        return;
+    }
+
+    const auto &name = names_[node_names_[node]];
+    output += '<';
+    output += name;
+    for (auto attribute = first_attributes_[node]; attribute != NONE;
+         attribute      = next_attributes_[attribute]) {
+        output += ' ';
+        output += names_[attribute_names_[attribute]];
+        output += "=\"";
+        Escape(output, Text(attribute_values_[attribute]), true);
+        output += '"';
+    }
+    if (first_children_[node] == NONE) {
+        output += EmptyElementEnd();
+        return;
+    }
+    output += '>';
+    for (auto child = first_children_[node]; child != NONE; child = next_siblings_[child]) {
+        PrintNode(output, child);
+    }
+    output += "</";
+    output += name;
+    output += '>';
+}
+
+XmlArenaNode::XmlArenaNode(XmlArenaDocument *document, uint32_t index)
+    : document_(document)
+    , index_(index)
+{
+}
+
+XmlArenaNode::operator bool() const
+{
+    return document_ && index_ != XmlArenaDocument::NONE;
+}
+
+bool XmlArenaNode::operator==(const XmlArenaNode &other) const
+{
+    if (!*this || !other) {
+        return !*this && !other;
+    }
+    return document_ == other.document_ && index_ == other.index_;
+}
+
+bool XmlArenaNode::operator!=(const XmlArenaNode &other) const
+{
+    return !(*this == other);
+}
+
+pugi::xml_node_type XmlArenaNode::type() const
+{
+    return *this ? document_->types_[index_] : pugi::node_null;
+}
+
+const char *XmlArenaNode::name() const
+{
+    return *this ? document_->names_[document_->node_names_[index_]].c_str() : "";
+}
+
+std::string_view XmlArenaNode::value() const
+{
+    if (type() != pugi::node_pcdata && type() != pugi::node_cdata) {
+        return {};
+    }
+    return document_->Text(document_->values_[index_]);
+}
+
+std::string_view XmlArenaNode::child_value() const
+{
+    for (auto child = first_child(); child; child = child.next_sibling()) {
+        if (child.type() == pugi::node_pcdata || child.type() == pugi::node_cdata) {
+            return child.value();
+        }
+    }
+    return {};
+}
+
+XmlArenaNode XmlArenaNode::parent() const
+{
+    return *this ? XmlArenaNode(document_, document_->parents_[index_]) : XmlArenaNode();
+}
+
+XmlArenaNode XmlArenaNode::first_child() const
+{
+    return *this ? XmlArenaNode(document_, document_->first_children_[index_]) : XmlArenaNode();
+}
+
+XmlArenaNode XmlArenaNode::next_sibling() const
+{
+    return *this ? XmlArenaNode(document_, document_->next_siblings_[index_]) : XmlArenaNode();
+}
+
+XmlArenaNode XmlArenaNode::child(const char *name) const
+{
+    for (auto child = first_child(); child; child = child.next_sibling()) {
+        if (child.type() == pugi::node_element && strcmp(child.name(), name) == 0) {
+            return child;
+        }
+    }
+    return {};
+}
+
+XmlArenaNode XmlArenaNode::append_copy(pugi::xml_node source)
+{
+    if (!*this) {
+        return {};
+    }
+    const auto copy = document_->Copy(source);
+    if (copy == XmlArenaDocument::NONE) {
+        return {};
+    }
+    document_->Link(copy, index_, document_->last_children_[index_]);
+    document_->Post(copy);
+    return {document_, copy};
+}
+
+XmlArenaNode XmlArenaNode::insert_copy_after(pugi::xml_node source, XmlArenaNode node)
+{
+    if (!*this || node.parent() != *this) {
+        return {};
+    }
+    const auto copy = document_->Copy(source);
+    if (copy == XmlArenaDocument::NONE) {
+        return {};
+    }
+    document_->Link(copy, index_, node.index_);
+    document_->Post(copy);
+    return {document_, copy};
+}
+
+XmlArenaNode XmlArenaNode::insert_copy_before(pugi::xml_node source, XmlArenaNode node)
+{
+    if (!*this || node.parent() != *this) {
+        return {};
+    }
+    const auto copy = document_->Copy(source);
+    if (copy == XmlArenaDocument::NONE) {
+        return {};
+    }
+    document_->Link(copy, index_, document_->previous_siblings_[node.index_]);
+    document_->Post(copy);
+    return {document_, copy};
+}
+
+bool XmlArenaNode::remove_child(XmlArenaNode node)
+{
+    if (!*this || node.parent() != *this) {
+        return false;
+    }
+    document_->Unlink(node.index_);
+    return true;
+}
+
+bool XmlArenaNode::set_value(const char *value)
+{
+    if (type() != pugi::node_pcdata && type() != pugi::node_cdata) {
+        return false;
+    }
+    document_->values_[index_] = document_->Store(value);
+    document_->Touch(index_);
+    document_->Reindex(index_);
+    return true;
+}
+
+void XmlArenaNode::set_attribute(const char *name, const char *value)
+{
+    if (type() == pugi::node_element) {
+        document_->SetAttribute(index_, name, value);
+        document_->Touch(index_);
+    }
+}
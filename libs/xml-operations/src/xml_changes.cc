@@ -0,0 +1,250 @@
+#include "xml_changes.h"
+
+#include <cctype>
+
+namespace
+{
+constexpr auto TEXT = "#text";
+
+bool IsDigit(char c)
+{
+    return std::isdigit(static_cast<unsigned char>(c));
+}
+
+bool IsNameStart(char c)
+{
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool IsNameChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.';
+}
+
+// Functions that only look at positions, counts or booleans
+bool IsStructural(std::string_view function)
+{
+    for (std::string_view name : {"position", "last", "count", "not", "true", "false", "boolean"}) {
+        if (function == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// What the value left of a comparison is
+enum class Operand { None, Element, Attribute, Unknown };
+} // namespace
+
+XmlQuery::XmlQuery(std::string_view path)
+{
+    // An operand right before tells `*` and `and` apart from name tests, see XPath 1.0 3.7
+    bool        after_operand = false;
+    Operand     operand       = Operand::None;
+    std::string element;
+    // Names right of a comparison are compared as well
+    bool compare_right = false;
+
+    const auto compare = [&](const std::string &name) {
+        if (compare_right) {
+            compared.insert(name);
+        }
+    };
+
+    size_t i = 0;
+    while (i < path.size()) {
+        const char c = path[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (c == '\'' || c == '"') {
+            const auto end = path.find(c, i + 1);
+            i              = end == std::string_view::npos ? path.size() : end + 1;
+            after_operand  = true;
+            operand        = Operand::None;
+        } else if (IsDigit(c) || (c == '.' && i + 1 < path.size() && IsDigit(path[i + 1]))) {
+            while (i < path.size() && (IsDigit(path[i]) || path[i] == '.')) {
+                ++i;
+            }
+            after_operand = true;
+            operand       = Operand::None;
+        } else if (c == '.') {
+            i += path.compare(i, 2, "..") == 0 ? 2 : 1;
+            after_operand = true;
+            operand       = Operand::Unknown;
+            any_value |= compare_right;
+        } else if (c == '@') {
+            ++i;
+            const auto begin = i;
+            while (i < path.size() && (IsNameChar(path[i]) || path[i] == ':')) {
+                ++i;
+            }
+            if (i == begin && i < path.size() && path[i] == '*') {
+                ++i;
+                any_attribute = true;
+            } else {
+                attributes.emplace(path.substr(begin, i - begin));
+            }
+            after_operand = true;
+            operand       = Operand::Attribute;
+        } else if (c == '*' && !after_operand) {
+            ++i;
+            any_name      = true;
+            after_operand = true;
+            operand       = Operand::Unknown;
+            any_value |= compare_right;
+        } else if (IsNameStart(c)) {
+            const auto begin = i;
+            while (i < path.size()
+                   && (IsNameChar(path[i])
+                       || (path[i] == ':' && path.compare(i, 2, "::") != 0))) {
+                ++i;
+            }
+            const std::string name(path.substr(begin, i - begin));
+            auto              next = i;
+            while (next < path.size() && std::isspace(static_cast<unsigned char>(path[next]))) {
+                ++next;
+            }
+
+            if (after_operand && (name == "and" || name == "or")) {
+                after_operand = false;
+                compare_right = false;
+            } else if (after_operand && (name == "div" || name == "mod")) {
+                after_operand = false;
+            } else if (path.compare(next, 2, "::") == 0) {
+                i = next + 2;
+                if (name == "attribute") {
+                    // Same as @
+                    any_attribute = true;
+                }
+                after_operand = false;
+            } else if (next < path.size() && path[next] == '(') {
+                i = next + 1;
+                if (name == "text") {
+                    // Keeps comparing the element before
+                    names.insert(TEXT);
+                } else if (name == "node" || name == "comment"
+                           || name == "processing-instruction") {
+                    any_name = true;
+                    operand  = Operand::Unknown;
+                } else if (IsStructural(name)) {
+                    operand = Operand::None;
+                } else {
+                    any_value = true;
+                    operand   = Operand::None;
+                }
+                after_operand = false;
+            } else {
+                names.insert(name);
+                compare(name);
+                element       = name;
+                after_operand = true;
+                operand       = Operand::Element;
+            }
+        } else if (c == '=' || c == '!' || c == '<' || c == '>') {
+            i += i + 1 < path.size() && path[i + 1] == '=' ? 2 : 1;
+            if (operand == Operand::Element) {
+                compared.insert(element);
+            } else if (operand == Operand::Unknown) {
+                any_value = true;
+            }
+            compare_right = true;
+            after_operand = false;
+            operand       = Operand::None;
+        } else if (c == ')') {
+            // Closes a function call or a grouping we did not look into
+            ++i;
+            after_operand = true;
+        } else if (c == ']') {
+            ++i;
+            compare_right = false;
+            after_operand = true;
+            operand       = Operand::Unknown;
+        } else if (c == '(') {
+            // Grouping, its value is whatever is inside
+            ++i;
+            any_value |= compare_right;
+            operand       = Operand::Unknown;
+            after_operand = false;
+        } else if (c == '/' || c == '[' || c == '|' || c == ',' || c == '+' || c == '-'
+                   || c == '*') {
+            ++i;
+            if (c == '[' || c == '|' || c == ',') {
+                compare_right = false;
+            }
+            after_operand = false;
+        } else {
+            // Variables and whatever else we do not know about
+            ++i;
+            any_name  = true;
+            any_value = true;
+        }
+    }
+}
+
+void XmlChanges::Inserted(pugi::xml_node node)
+{
+    if (!node) {
+        return;
+    }
+    Subtree(node);
+    Ancestors(node.parent());
+}
+
+void XmlChanges::Removing(pugi::xml_node node)
+{
+    Inserted(node);
+}
+
+void XmlChanges::ChangingAttribute(const char *name)
+{
+    attributes_.insert(name);
+}
+
+void XmlChanges::ChangingValue(pugi::xml_node node)
+{
+    Ancestors(node);
+}
+
+bool XmlChanges::Empty() const
+{
+    return structure_.empty() && values_.empty() && attributes_.empty();
+}
+
+bool XmlChanges::Affects(const XmlQuery &query) const
+{
+    if ((query.any_name && !structure_.empty()) || (query.any_value && !values_.empty())
+        || (query.any_attribute && !attributes_.empty())) {
+        return true;
+    }
+    const auto intersect = [](const auto &changed, const auto &looked_at) {
+        for (const auto &name : looked_at) {
+            if (changed.count(name) > 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    return intersect(structure_, query.names) || intersect(values_, query.compared)
+           || intersect(attributes_, query.attributes);
+}
+
+void XmlChanges::Subtree(pugi::xml_node node)
+{
+    if (node.type() == pugi::node_element) {
+        structure_.insert(node.name());
+    } else if (node.type() == pugi::node_pcdata || node.type() == pugi::node_cdata) {
+        structure_.insert(TEXT);
+    }
+    for (auto child : node.children()) {
+        Subtree(child);
+    }
+}
+
+void XmlChanges::Ancestors(pugi::xml_node node)
+{
+    for (; node; node = node.parent()) {
+        if (node.type() == pugi::node_element) {
+            values_.insert(node.name());
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#include "xml_footprint.h"
+
+#include <cstring>
+
+namespace
+{
+#ifndef _WIN32
+int stricmp(const char *a, const char *b)
+{
+    return strcasecmp(a, b);
+}
+#endif
+
+// The element holding the GUID or Name a part is known by
+pugi::xml_node KeyNode(pugi::xml_node node)
+{
+    if (stricmp(node.name(), "Asset") == 0) {
+        return node.child("Values").child("Standard").child("GUID");
+    }
+    if (stricmp(node.name(), "Template") == 0) {
+        return node.child("Name");
+    }
+    return {};
+}
+} // namespace
+
+bool XmlFootprint::Touches(const std::set<std::string> &region) const
+{
+    if (region.empty()) {
+        return false;
+    }
+    if (!Precise() || region.count(EVERYTHING) > 0) {
+        return true;
+    }
+    for (const auto *parts : {&reads, &writes}) {
+        for (const auto &part : *parts) {
+            if (region.count(part) > 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool XmlFootprint::Precise() const
+{
+    return reads.count(EVERYTHING) == 0 && writes.count(EVERYTHING) == 0;
+}
+
+void XmlFootprint::Inserted(pugi::xml_node node)
+{
+    const auto key = Key(node);
+    if (!key.empty() && RegionOf(node.parent()) == EVERYTHING) {
+        writes.insert(key);
+        writes.insert(ContainerOf(node));
+    } else {
+        writes.insert(RegionOf(node));
+    }
+}
+
+void XmlFootprint::Removing(pugi::xml_node node)
+{
+    Inserted(node);
+}
+
+void XmlFootprint::ChangingAttribute(pugi::xml_node node)
+{
+    writes.insert(RegionOf(node));
+}
+
+void XmlFootprint::ChangingValue(pugi::xml_node node)
+{
+    writes.insert(RegionOf(node));
+}
+
+std::string XmlFootprint::Asset(const std::string &guid)
+{
+    return "asset:" + guid;
+}
+
+std::string XmlFootprint::Template(const std::string &name)
+{
+    return "template:" + name;
+}
+
+std::string XmlFootprint::Key(pugi::xml_node node)
+{
+    const auto key_node = KeyNode(node);
+    if (!key_node) {
+        return {};
+    }
+    if (stricmp(node.name(), "Asset") == 0) {
+        return Asset(key_node.text().get());
+    }
+    return Template(key_node.text().get());
+}
+
+std::string XmlFootprint::RegionOf(pugi::xml_node node)
+{
+    // Assets can hold other assets, the outermost one is the part
+    pugi::xml_node root;
+    for (auto current = node; current; current = current.parent()) {
+        if (KeyNode(current)) {
+            root = current;
+        }
+    }
+    if (!root) {
+        return EVERYTHING;
+    }
+
+    // Changing the GUID or Name itself turns it into a different part
+    const auto key_node = KeyNode(root);
+    for (auto current = key_node; current && current != root; current = current.parent()) {
+        if (current == node) {
+            return EVERYTHING;
+        }
+    }
+    for (auto current = node; current && current != root; current = current.parent()) {
+        if (current == key_node) {
+            return EVERYTHING;
+        }
+    }
+    return Key(root);
+}
+
+std::string XmlFootprint::ContainerOf(pugi::xml_node node)
+{
+    return "container:" + Location(node.parent());
+}
+
+std::string XmlFootprint::Location(pugi::xml_node node)
+{
+    std::string location;
+    for (auto current = node; current && current.type() != pugi::node_document;
+         current = current.parent()) {
+        size_t index = 1;
+        for (auto sibling = current.previous_sibling(current.name()); sibling;
+             sibling      = sibling.previous_sibling(current.name())) {
+            ++index;
+        }
+        location = "/" + std::string(current.name()) + "[" + std::to_string(index) + "]" + location;
+    }
+    return location;
+}
@@ -0,0 +1,288 @@
+#include "xml_journal.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace
+{
+// The part of the document an entry depends on: the node itself and, for structural changes,
+// the sibling (or parent) it was inserted after or removed from
+template <typename Entry, typename Fn> void ForEachTouched(const Entry &entry, Fn &&fn)
+{
+    if (entry.node) {
+        fn(entry.node);
+    }
+    if (entry.previous) {
+        fn(entry.previous);
+    } else if (entry.parent) {
+        fn(entry.parent);
+    }
+}
+} // namespace
+
+XmlJournal::XmlJournal() = default;
+
+size_t XmlJournal::Begin(std::string name)
+{
+    segments_.push_back({std::move(name), ++sequence_, {}});
+    current_ = segments_.size() - 1;
+    return current_;
+}
+
+void XmlJournal::Reopen(size_t segment)
+{
+    segments_.at(segment).sequence = ++sequence_;
+    current_                       = segment;
+}
+
+size_t XmlJournal::Segments() const
+{
+    return segments_.size();
+}
+
+const std::string &XmlJournal::Name(size_t segment) const
+{
+    return segments_.at(segment).name;
+}
+
+size_t XmlJournal::Changes(size_t segment) const
+{
+    return segments_.at(segment).entries.size();
+}
+
+void XmlJournal::Record(Entry entry)
+{
+    if (segments_.empty()) {
+        Begin("");
+    }
+    auto &recorded = segments_[current_].entries.emplace_back(std::move(entry));
+    Track(&recorded.node);
+    Track(&recorded.parent);
+    Track(&recorded.previous);
+}
+
+void XmlJournal::Track(pugi::xml_node *handle)
+{
+    if (*handle) {
+        handles_[handle->internal_object()].push_back(handle);
+    }
+}
+
+void XmlJournal::Untrack(pugi::xml_node *handle)
+{
+    if (!*handle) {
+        return;
+    }
+    auto it = handles_.find(handle->internal_object());
+    if (it == handles_.end()) {
+        return;
+    }
+    auto &handles = it->second;
+    handles.erase(std::remove(handles.begin(), handles.end(), handle), handles.end());
+    if (handles.empty()) {
+        handles_.erase(it);
+    }
+}
+
+void XmlJournal::Retarget(pugi::xml_node from, pugi::xml_node to)
+{
+    // Copies have the exact same shape, walk both trees in lockstep
+    std::vector<std::pair<pugi::xml_node, pugi::xml_node>> pending = {{from, to}};
+    while (!pending.empty() && !handles_.empty()) {
+        auto [source, target] = pending.back();
+        pending.pop_back();
+
+        if (auto it = handles_.find(source.internal_object()); it != handles_.end()) {
+            auto handles = std::move(it->second);
+            handles_.erase(it);
+            for (auto *handle : handles) {
+                *handle = target;
+            }
+            auto &target_handles = handles_[target.internal_object()];
+            target_handles.insert(target_handles.end(), handles.begin(), handles.end());
+        }
+
+        auto source_child = source.first_child();
+        auto target_child = target.first_child();
+        for (; source_child && target_child; source_child = source_child.next_sibling(),
+                                             target_child = target_child.next_sibling()) {
+            pending.emplace_back(source_child, target_child);
+        }
+    }
+}
+
+void XmlJournal::Inserted(pugi::xml_node node)
+{
+    if (!node) {
+        return;
+    }
+    Entry entry    = {Kind::Inserted, node};
+    entry.parent   = node.parent();
+    entry.previous = node.previous_sibling();
+    Record(std::move(entry));
+}
+
+void XmlJournal::Removing(pugi::xml_node node)
+{
+    if (!node || !node.parent()) {
+        return;
+    }
+    // Everything recorded inside the subtree moves over to the copy
+    auto copy = graveyard_.append_copy(node);
+    Retarget(node, copy);
+
+    Entry entry    = {Kind::Removed, copy};
+    entry.parent   = node.parent();
+    entry.previous = node.previous_sibling();
+    Record(std::move(entry));
+}
+
+void XmlJournal::ChangingAttribute(pugi::xml_node node, const char *name)
+{
+    if (!node) {
+        return;
+    }
+    Entry entry = {Kind::Attribute, node};
+    entry.name  = name;
+    if (auto attribute = node.attribute(name)) {
+        entry.before = attribute.value();
+        if (auto previous = attribute.previous_attribute()) {
+            entry.previous_name = previous.name();
+        }
+    }
+    Record(std::move(entry));
+}
+
+void XmlJournal::ChangingValue(pugi::xml_node node)
+{
+    if (!node) {
+        return;
+    }
+    Entry entry  = {Kind::Value, node};
+    entry.before = node.value();
+    Record(std::move(entry));
+}
+
+void XmlJournal::Undo(Entry &entry)
+{
+    switch (entry.kind) {
+    case Kind::Inserted:
+        entry.node.parent().remove_child(entry.node);
+        break;
+    case Kind::Removed: {
+        const auto     copy = entry.node;
+        pugi::xml_node restored;
+        if (entry.previous) {
+            restored = entry.parent.insert_copy_after(copy, entry.previous);
+        } else {
+            restored = entry.parent.prepend_copy(copy);
+        }
+        if (!restored) {
+            // The anchor is gone, better late than never
+            restored = entry.parent.append_copy(copy);
+        }
+        Retarget(copy, restored);
+        graveyard_.remove_child(copy);
+        break;
+    }
+    case Kind::Attribute: {
+        entry.node.remove_attribute(entry.name.c_str());
+        if (!entry.before) {
+            break;
+        }
+        pugi::xml_attribute attribute;
+        if (entry.previous_name.empty()) {
+            attribute = entry.node.prepend_attribute(entry.name.c_str());
+        } else {
+            attribute = entry.node.insert_attribute_after(
+                entry.name.c_str(), entry.node.attribute(entry.previous_name.c_str()));
+        }
+        if (!attribute) {
+            attribute = entry.node.append_attribute(entry.name.c_str());
+        }
+        attribute.set_value(entry.before->c_str());
+        break;
+    }
+    case Kind::Value:
+        entry.node.set_value(entry.before->c_str());
+        break;
+    }
+}
+
+bool XmlJournal::Overlaps(const Segment &a, const Segment &b) const
+{
+    std::unordered_set<pugi::xml_node_struct *> touched;
+    std::unordered_set<pugi::xml_node_struct *> ancestors;
+    for (const auto &entry : a.entries) {
+        ForEachTouched(entry, [&](pugi::xml_node node) {
+            touched.insert(node.internal_object());
+            for (; node; node = node.parent()) {
+                if (!ancestors.insert(node.internal_object()).second) {
+                    break;
+                }
+            }
+        });
+    }
+
+    bool overlaps = false;
+    for (const auto &entry : b.entries) {
+        ForEachTouched(entry, [&](pugi::xml_node node) {
+            if (overlaps || ancestors.count(node.internal_object()) > 0) {
+                overlaps = true;
+                return;
+            }
+            for (; node; node = node.parent()) {
+                if (touched.count(node.internal_object()) > 0) {
+                    overlaps = true;
+                    return;
+                }
+            }
+        });
+        if (overlaps) {
+            break;
+        }
+    }
+    return overlaps;
+}
+
+std::vector<size_t> XmlJournal::Rollback(size_t segment)
+{
+    const auto sequence = segments_.at(segment).sequence;
+
+    std::vector<size_t> later;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (i != segment && segments_[i].sequence > sequence && !segments_[i].entries.empty()) {
+            later.push_back(i);
+        }
+    }
+    std::sort(later.begin(), later.end(), [this](auto l, auto r) {
+        return segments_[l].sequence < segments_[r].sequence;
+    });
+
+    // Anything that overlaps with a segment we roll back has to go as well
+    std::vector<size_t> rolled_back = {segment};
+    std::vector<size_t> reapply;
+    for (auto candidate : later) {
+        const auto overlaps =
+            std::any_of(rolled_back.begin(), rolled_back.end(), [&](auto rolled) {
+                return Overlaps(segments_[rolled], segments_[candidate]);
+            });
+        if (overlaps) {
+            rolled_back.push_back(candidate);
+            reapply.push_back(candidate);
+        }
+    }
+
+    // Newest changes first
+    for (auto it = rolled_back.rbegin(); it != rolled_back.rend(); ++it) {
+        auto &entries = segments_[*it].entries;
+        for (auto entry = entries.rbegin(); entry != entries.rend(); ++entry) {
+            Untrack(&entry->node);
+            Untrack(&entry->parent);
+            Untrack(&entry->previous);
+            Undo(*entry);
+        }
+        entries.clear();
+    }
+    return reapply;
+}
@@ -0,0 +1,173 @@
+#include "parallel_for.h"
+#include "string_writer.h"
+#include "xml_lazy_document.h"
+
+#include "spdlog/spdlog.h"
+
+#include <atomic>
+#include <thread>
+
+std::optional<XmlLazyDocument> XmlLazyDocument::Scan(std::string buffer, size_t threads)
+{
+    auto index = XmlPartIndex::Scan(buffer);
+    if (!index) {
+        return {};
+    }
+    return Open(std::move(buffer), std::move(*index), threads);
+}
+
+std::optional<XmlLazyDocument> XmlLazyDocument::Open(std::string buffer, XmlPartIndex index,
+                                                     size_t threads)
+{
+    for (const auto &part : index.parts) {
+        if (part.end > buffer.size()) {
+            spdlog::error("Asset index does not match the document");
+            return {};
+        }
+    }
+    XmlLazyDocument document;
+    document.buffer_  = std::move(buffer);
+    document.index_   = std::move(index);
+    document.threads_ = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    document.documents_.resize(document.index_.parts.size());
+    spdlog::debug("Found {} assets and templates in {} bytes", document.index_.parts.size(),
+                  document.buffer_.size());
+    return document;
+}
+
+void XmlLazyDocument::ApplyAll(std::vector<XmlOperation> &operations)
+{
+    size_t begin = 0;
+    while (!whole_ && begin < operations.size()) {
+        // Ops confined to one asset or template go to the part it is in. Confined ops neither
+        // add nor remove keys, so the index stays valid.
+        std::vector<std::vector<size_t>> routed(documents_.size());
+        std::vector<size_t>              missing;
+        size_t                           end = begin;
+        for (; end < operations.size(); ++end) {
+            const auto target = operations[end].Confinement();
+            if (target.empty()) {
+                continue;
+            }
+            if (target == XmlFootprint::EVERYTHING) {
+                break;
+            }
+            const auto part = index_.Find(target);
+            if (part == XmlPartIndex::NOT_FOUND) {
+                missing.push_back(end);
+            } else if (part == XmlPartIndex::DUPLICATE) {
+                // The lookup would see all of them
+                break;
+            } else {
+                routed[part].push_back(end);
+            }
+        }
+
+        std::vector<size_t> touched;
+        for (size_t i = 0; i < routed.size(); ++i) {
+            if (!routed[i].empty()) {
+                touched.push_back(i);
+            }
+        }
+        // Parse before applying anything. A part that does not parse on its own is read with
+        // the rest of the document, it would print empty otherwise.
+        std::atomic<bool> failed = false;
+        ParallelFor(touched.size(), threads_, [&](size_t i) {
+            auto &doc = documents_[touched[i]];
+            if (!doc) {
+                const auto &range = index_.parts[touched[i]];
+                doc               = std::make_shared<pugi::xml_document>();
+                if (!doc->load_buffer(buffer_.data() + range.begin, range.end - range.begin)) {
+                    spdlog::warn("Failed to parse asset at offset {}, parsing everything",
+                                 range.begin);
+                    doc    = nullptr;
+                    failed = true;
+                }
+            }
+        });
+        if (failed) {
+            Materialize();
+            break;
+        }
+        ParallelFor(touched.size(), threads_, [&](size_t i) {
+            for (auto index : routed[touched[i]]) {
+                operations[index].Apply(documents_[touched[i]]);
+            }
+        });
+        // Not found anywhere, they only have to tell
+        const auto empty = std::make_shared<pugi::xml_document>();
+        for (auto index : missing) {
+            operations[index].Apply(empty);
+        }
+        spdlog::debug("Applied {} operations to {} assets", end - begin, touched.size());
+
+        begin = end;
+        if (begin < operations.size()) {
+            Materialize();
+        }
+    }
+
+    if (begin < operations.size()) {
+        std::vector<XmlOperation> rest(operations.begin() + begin, operations.end());
+        XmlOperation::ApplyAll(whole_, rest, {}, threads_);
+    }
+}
+
+std::string XmlLazyDocument::Print() const
+{
+    if (whole_) {
+        StringWriter writer;
+        whole_->print(writer, "", pugi::format_raw);
+        return std::move(writer.result);
+    }
+
+    std::vector<StringWriter> printed(documents_.size());
+    ParallelFor(documents_.size(), threads_, [&](size_t i) {
+        if (documents_[i]) {
+            documents_[i]->print(printed[i], "", pugi::format_raw);
+        }
+    });
+
+    std::string result;
+    result.reserve(buffer_.size());
+    size_t position = 0;
+    for (size_t i = 0; i < documents_.size(); ++i) {
+        if (!documents_[i]) {
+            continue;
+        }
+        const auto &range = index_.parts[i];
+        result.append(buffer_, position, range.begin - position);
+        result.append(printed[i].result);
+        position = range.end;
+    }
+    result.append(buffer_, position, std::string::npos);
+    return result;
+}
+
+std::shared_ptr<pugi::xml_document> XmlLazyDocument::Materialize()
+{
+    if (!whole_) {
+        const auto text = Print();
+        whole_          = std::make_shared<pugi::xml_document>();
+        if (!whole_->load_buffer(text.data(), text.size())) {
+            spdlog::error("Failed to parse document");
+        }
+        buffer_.clear();
+        buffer_.shrink_to_fit();
+        documents_.clear();
+        spdlog::debug("Parsed the whole document");
+    }
+    return whole_;
+}
+
+size_t XmlLazyDocument::Parsed() const
+{
+    if (whole_) {
+        return index_.parts.size();
+    }
+    size_t parsed = 0;
+    for (const auto &document : documents_) {
+        parsed += document != nullptr;
+    }
+    return parsed;
+}
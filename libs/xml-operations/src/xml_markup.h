@@ -0,0 +1,119 @@
+#pragma once
+
+#include "byte_scan.h"
+
+#include <string_view>
+#include <vector>
+
+// Walks the markup of a raw XML buffer without building anything. `visitor` gets
+//   bool Open(std::string_view name, size_t begin) for start tags, `begin` is the '<'
+//   bool Close(std::string_view name, size_t end) for end tags and right after self-closing
+//     start tags, `end` is right past the '>'
+//   bool Text(size_t begin, size_t end) for character data and CDATA sections, raw
+// Comments and processing instructions are skipped. Returns false if a callback did or the
+// buffer is not well-formed enough to tell. Buffers that may not parse the same in pieces,
+// UTF-16 or ones declaring entities, are refused as well.
+template <typename Visitor> bool WalkMarkup(std::string_view buffer, Visitor &visitor)
+{
+    constexpr auto npos = std::string_view::npos;
+
+    const auto starts_with = [&](size_t position, std::string_view prefix) {
+        return buffer.compare(position, prefix.size(), prefix) == 0;
+    };
+    const auto name_end = [&](size_t position) {
+        while (position < buffer.size()) {
+            const char c = buffer[position];
+            if (c == '>' || c == '/' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                break;
+            }
+            ++position;
+        }
+        return position;
+    };
+
+    if (!buffer.empty() && (buffer[0] == '\xFE' || buffer[0] == '\xFF')) {
+        return false;
+    }
+
+    std::vector<std::string_view> open;
+    size_t                        position = 0;
+    while (position < buffer.size()) {
+        const auto tag = FindByte(buffer, position, '<');
+        if (tag != position) {
+            const auto end = tag == npos ? buffer.size() : tag;
+            if (!visitor.Text(position, end)) {
+                return false;
+            }
+            if (tag == npos) {
+                break;
+            }
+        }
+
+        size_t close = npos;
+        if (starts_with(tag, "<!--")) {
+            close = buffer.find("-->", tag + 4);
+            close = close == npos ? npos : close + 2;
+        } else if (starts_with(tag, "<![CDATA[")) {
+            close = buffer.find("]]>", tag + 9);
+            if (close == npos || !visitor.Text(tag + 9, close)) {
+                return false;
+            }
+            close += 2;
+        } else if (starts_with(tag, "<?")) {
+            close = buffer.find("?>", tag + 2);
+            if (close != npos && starts_with(tag, "<?xml ")) {
+                // Pieces are parsed without the declaration, they have to be UTF-8 either way
+                const auto declaration = buffer.substr(tag, close - tag);
+                const auto encoding    = declaration.find("encoding");
+                if (encoding != npos && declaration.find("UTF-8", encoding) == npos
+                    && declaration.find("utf-8", encoding) == npos) {
+                    return false;
+                }
+            }
+            close = close == npos ? npos : close + 1;
+        } else if (starts_with(tag, "<!")) {
+            close = buffer.find('>', tag);
+            if (buffer.substr(tag, close - tag).find('[') != npos) {
+                // Internal DTD subset, may declare entities
+                return false;
+            }
+        } else if (starts_with(tag, "</")) {
+            const auto end  = name_end(tag + 2);
+            const auto name = buffer.substr(tag + 2, end - tag - 2);
+            if (open.empty() || open.back() != name) {
+                return false;
+            }
+            close = buffer.find('>', end);
+            if (close == npos || !visitor.Close(name, close + 1)) {
+                return false;
+            }
+            open.pop_back();
+        } else {
+            const auto end  = name_end(tag + 1);
+            const auto name = buffer.substr(tag + 1, end - tag - 1);
+            if (name.empty() || !visitor.Open(name, tag)) {
+                return false;
+            }
+            close = FindAnyOf(buffer, end, '>', '"', '\'');
+            while (close != npos && buffer[close] != '>') {
+                const auto quote = FindByte(buffer, close + 1, buffer[close]);
+                close = quote == npos ? npos : FindAnyOf(buffer, quote + 1, '>', '"', '\'');
+            }
+            if (close == npos) {
+                return false;
+            }
+            if (buffer[close - 1] == '/') {
+                if (!visitor.Close(name, close + 1)) {
+                    return false;
+                }
+            } else {
+                open.push_back(name);
+            }
+        }
+        if (close == npos) {
+            return false;
+        }
+        position = close + 1;
+    }
+    return open.empty();
+}
@@ -41,6 +41,125 @@ static std::pair<size_t, size_t> get_location(const offset_data_t &data, ptrdiff
 
     return std::make_pair(1 + index, index == 0 ? offset + 1 : offset - data[index - 1]);
 }
+
+// All changes to the game document go through these, so they can be journaled
+
+static void RecordInserted(const ApplyContext &context, pugi::xml_node node)
+{
+    if (context.journal) {
+        context.journal->Inserted(node);
+    }
+    if (context.footprint && node) {
+        context.footprint->Inserted(node);
+    }
+    if (context.changes) {
+        context.changes->Inserted(node);
+    }
+}
+
+static void RemoveNode(const ApplyContext &context, pugi::xml_node node)
+{
+    if (context.journal) {
+        context.journal->Removing(node);
+    }
+    if (context.footprint) {
+        context.footprint->Removing(node);
+    }
+    if (context.changes) {
+        context.changes->Removing(node);
+    }
+    node.parent().remove_child(node);
+}
+
+static void SetNodeValue(const ApplyContext &context, pugi::xml_node node, const char *value)
+{
+    if (context.journal) {
+        context.journal->ChangingValue(node);
+    }
+    if (context.footprint) {
+        context.footprint->ChangingValue(node);
+    }
+    if (context.changes) {
+        context.changes->ChangingValue(node);
+    }
+    node.set_value(value);
+}
+
+// The arena backend has nothing to record changes in
+
+static void RecordInserted(const ApplyContext &, XmlArenaNode) {}
+
+static void RemoveNode(const ApplyContext &, XmlArenaNode node)
+{
+    node.parent().remove_child(node);
+}
+
+static void SetNodeValue(const ApplyContext &, XmlArenaNode node, const char *value)
+{
+    node.set_value(value);
+}
+
+// `value` as an XPath string literal. XPath 1.0 has no escapes, values with both kinds of quotes
+// are put together with concat().
+static std::string Literal(const std::string &value)
+{
+    if (value.find('\'') == std::string::npos) {
+        return "'" + value + "'";
+    }
+    if (value.find('"') == std::string::npos) {
+        return "\"" + value + "\"";
+    }
+    std::string result   = "concat('";
+    size_t      position = 0;
+    auto        quote    = value.find('\'');
+    while (quote != std::string::npos) {
+        result += value.substr(position, quote - position) + "', \"'\", '";
+        position = quote + 1;
+        quote    = value.find('\'', position);
+    }
+    return result + value.substr(position) + "')";
+}
+
+static std::string AssetPath(const std::string &guid)
+{
+    return "//Asset[Values/Standard/GUID=" + Literal(guid) + "]";
+}
+
+static std::string TemplatePath(const std::string &temp)
+{
+    return "//Template[Name=" + Literal(temp) + "]";
+}
+
+// Splits `guid('X')...` or `template('X')...` into X and what follows
+static bool ReadFunction(const std::string &path, const std::string &function, std::string &value,
+                         std::string &rest)
+{
+    if (path.compare(0, function.size() + 1, function + "(") != 0) {
+        return false;
+    }
+    const auto open  = function.size() + 1;
+    const auto quote = path[open];
+    if (quote != '\'' && quote != '"') {
+        return false;
+    }
+    const auto close = path.find(quote, open + 1);
+    if (close == std::string::npos || path.compare(close + 1, 1, ")") != 0) {
+        return false;
+    }
+    value = path.substr(open + 1, close - open - 1);
+    rest  = path.substr(close + 2);
+    return true;
+}
+
+static pugi::xml_node NodeOf(const pugi::xpath_node &target)
+{
+    return target.node();
+}
+
+static XmlArenaNode NodeOf(XmlArenaNode target)
+{
+    return target;
+}
 } // namespace
 
 XmlOperation::XmlOperation(std::shared_ptr<pugi::xml_document> doc, pugi::xml_node node,
@@ -57,6 +176,7 @@ XmlOperation::XmlOperation(std::shared_ptr<pugi::xml_document> doc, pugi::xml_no
     mod_path_  = mod_path;
 
     ReadPath(node, guid, temp);
+    query_ = XmlQuery(path_);
     ReadType(node, mod_name, game_path, mod_path);
     if (type_ != Type::Remove) {
         nodes_ = node.children();
@@ -72,6 +192,26 @@ void XmlOperation::ReadPath(pugi::xml_node node, std::string guid, std::string t
         prop_path = "/";
     }
 
+    // guid('X') and template('X') start where GUID="X" and Template="X" would. Paths that go on
+    // with a predicate or a descendant step are evaluated from the asset or template itself,
+    // the whole path is left for when that finds nothing.
+    std::string value;
+    std::string rest;
+    std::string full_path;
+    if (guid.empty() && temp.empty()) {
+        const bool asset = ReadFunction(prop_path, "guid", value, rest);
+        if (asset || ReadFunction(prop_path, "template", value, rest)) {
+            (asset ? guid : temp)       = value;
+            (asset ? guid_ : template_) = value;
+            if (rest.empty() || (rest[0] == '/' && rest.find("//") != 0)) {
+                prop_path = rest.empty() ? "/" : rest;
+            } else {
+                prop_path = "self::node()" + rest;
+                full_path = (asset ? AssetPath(value) : TemplatePath(value)) + rest;
+            }
+        }
+    }
+
     if (guid.empty()) {
         // Rewrite path to use faster GUID lookup
         int g;
@@ -100,7 +240,7 @@ void XmlOperation::ReadPath(pugi::xml_node node, std::string guid, std::string t
         //}
     } else {
         speculative_path_type_ = SpeculativePathType::SINGLE_ASSET;
-        path_                  = "//Asset[Values/Standard/GUID='" + guid + "']";
+        path_                  = AssetPath(guid);
     }
 
     if (temp.empty()) {
@@ -114,7 +254,7 @@ void XmlOperation::ReadPath(pugi::xml_node node, std::string guid, std::string t
         }
     } else {
         speculative_path_type_ = SpeculativePathType::SINGLE_TEMPLATE;
-        path_                  = "//Template[Name='" + temp + "']";
+        path_                  = TemplatePath(temp);
     }
 
     if (prop_path.find("/") != 0) {
@@ -129,6 +269,9 @@ void XmlOperation::ReadPath(pugi::xml_node node, std::string guid, std::string t
             path_ = path_.substr(0, path_.length() - 1);
         }
     }
+    if (!full_path.empty()) {
+        path_ = full_path;
+    }
 
     if (!guid.empty() || !temp.empty()) {
         if (speculative_path_type_ == SpeculativePathType::ASSET_CONTAINER
@@ -186,7 +329,7 @@ void XmlOperation::ReadType(pugi::xml_node node, std::string mod_name, fs::path
     }
 }
 
-std::optional<pugi::xml_node> XmlOperation::FindAsset(std::string guid, pugi::xml_node node)
+template <typename Node> std::optional<Node> XmlOperation::FindAsset(std::string guid, Node node)
 {
 #ifndef _WIN32
     auto stricmp = [](auto a, auto b) { return strcasecmp(a, b); };
@@ -208,7 +351,7 @@ std::optional<pugi::xml_node> XmlOperation::FindAsset(std::string guid, pugi::xm
             return {};
         }
 
-        if (GUID.text().get() != guid) {
+        if (GUID.child_value() != guid) {
             return {};
         }
         if (speculative_path_type_ == SpeculativePathType::ASSET_CONTAINER) {
@@ -225,7 +368,7 @@ std::optional<pugi::xml_node> XmlOperation::FindAsset(std::string guid, pugi::xm
         }
     }
 
-    for (pugi::xml_node n : node.children()) {
+    for (auto n = node.first_child(); n; n = n.next_sibling()) {
         if (auto found = FindAsset(guid, n); found) {
             return found;
         }
@@ -240,7 +383,8 @@ std::optional<pugi::xml_node> XmlOperation::FindAsset(std::shared_ptr<pugi::xml_
     return FindAsset(guid, doc->root());
 }
 
-std::optional<pugi::xml_node> XmlOperation::FindTemplate(std::string temp, pugi::xml_node node)
+template <typename Node>
+std::optional<Node> XmlOperation::FindTemplate(std::string temp, Node node)
 {
 #ifndef _WIN32
     auto stricmp = [](auto a, auto b) { return strcasecmp(a, b); };
@@ -252,7 +396,7 @@ std::optional<pugi::xml_node> XmlOperation::FindTemplate(std::string temp, pugi:
             return {};
         }
 
-        if (template_name.text().get() != temp) {
+        if (template_name.child_value() != temp) {
             return {};
         }
 
@@ -270,7 +414,7 @@ std::optional<pugi::xml_node> XmlOperation::FindTemplate(std::string temp, pugi:
         }
     }
 
-    for (pugi::xml_node n : node.children()) {
+    for (auto n = node.first_child(); n; n = n.next_sibling()) {
         if (auto found = FindTemplate(temp, n); found) {
             return found;
         }
@@ -285,6 +429,31 @@ std::optional<pugi::xml_node> XmlOperation::FindTemplate(std::shared_ptr<pugi::x
     return FindTemplate(temp, doc->root());
 }
 
+std::optional<XmlArenaNode> XmlOperation::FindAsset(XmlArenaDocument &doc, std::string guid)
+{
+    // The first asset with the GUID is where the walk would stop as well
+    const auto found = doc.Select(AssetPath(guid));
+    if (!found) {
+        return FindAsset(guid, doc.Root());
+    }
+    if (found->empty()) {
+        return {};
+    }
+    return FindAsset(guid, found->front());
+}
+
+std::optional<XmlArenaNode> XmlOperation::FindTemplate(XmlArenaDocument &doc, std::string temp)
+{
+    const auto found = doc.Select(TemplatePath(temp));
+    if (!found) {
+        return FindTemplate(temp, doc.Root());
+    }
+    if (found->empty()) {
+        return {};
+    }
+    return FindTemplate(temp, found->front());
+}
+
 pugi::xpath_node_set XmlOperation::ReadGuidNodes(std::shared_ptr<pugi::xml_document> doc)
 {
     pugi::xpath_node_set results;
@@ -339,10 +508,17 @@ pugi::xpath_node_set XmlOperation::ReadTemplateNodes(std::shared_ptr<pugi::xml_d
     return results;
 }
 
-void XmlOperation::Apply(std::shared_ptr<pugi::xml_document> doc)
+void XmlOperation::Apply(std::shared_ptr<pugi::xml_document> doc, const ApplyContext &context)
+{
+    if (auto targets = Resolve(doc); targets) {
+        ApplyTo(*targets, context);
+    }
+}
+
+std::optional<pugi::xpath_node_set> XmlOperation::Resolve(std::shared_ptr<pugi::xml_document> doc)
 {
     if (skip_ || GetType() == XmlOperation::Type::None) {
-        return;
+        return {};
     }
     try {
         spdlog::debug("Looking up {}", path_);
@@ -352,53 +528,153 @@ void XmlOperation::Apply(std::shared_ptr<pugi::xml_document> doc)
             results = ReadTemplateNodes(doc);
         }
 
+        last_lookup_ = XmlPlan::RelativeXPath;
         if (results.empty()) {
-            results = doc->select_nodes(GetPath().c_str());
+            last_lookup_ = XmlPlan::FullScan;
+            results      = doc->select_nodes(GetPath().c_str());
         }
-        if (results.empty()) {
-            offset_data_t offset_data;
-            build_offset_data(offset_data, mod_path_.string().c_str());
-            auto [line, column] = get_location(offset_data, node_.offset_debug());
-            spdlog::warn("No matching node for Path {} in {} ({}:{})", GetPath(), mod_name_,
-                         game_path_.string(), line);
-            return;
+        spdlog::debug("Lookup finished {}", path_);
+        return results;
+    } catch (const pugi::xpath_exception &e) {
+        spdlog::error("Failed to parse path {} in {}: {}", GetPath(), mod_path_.string(), e.what());
+    }
+    return {};
+}
+
+XmlPlan::Kind XmlOperation::LastLookup() const
+{
+    return last_lookup_;
+}
+
+void XmlOperation::ApplyTo(const pugi::xpath_node_set &targets, const ApplyContext &context)
+{
+    if (context.footprint) {
+        // Even the XPath fallback of a GUID or Template op stays inside that asset or template
+        context.footprint->reads.insert(!guid_.empty()       ? XmlFootprint::Asset(guid_)
+                                        : !template_.empty() ? XmlFootprint::Template(template_)
+                                                             : XmlFootprint::EVERYTHING);
+    }
+    if (targets.empty()) {
+        WarnNoMatch();
+        return;
+    }
+    ApplyToTargets(targets, context);
+}
+
+bool XmlOperation::Apply(XmlArenaDocument &doc)
+{
+    if (skip_ || GetType() == XmlOperation::Type::None) {
+        return true;
+    }
+
+    // Same lookups as Resolve
+    std::vector<XmlArenaNode> results;
+    if (!guid_.empty() || !template_.empty()) {
+        const auto node = !guid_.empty() ? FindAsset(doc, guid_) : FindTemplate(doc, template_);
+        if (node && speculative_path_ != "*") {
+            // What the arena can't evaluate below the node it may still seek with the whole path
+            if (auto selected = doc.Select(speculative_path_, *node)) {
+                results = std::move(*selected);
+            }
         }
+    }
+    if (results.empty()) {
+        auto selected = doc.Select(GetPath());
+        if (!selected) {
+            return false;
+        }
+        results = std::move(*selected);
+    }
 
-        spdlog::debug("Lookup finished {}", path_);
-        for (pugi::xpath_node xnode : results) {
-            pugi::xml_node game_node = xnode.node();
-            if (GetType() == XmlOperation::Type::Merge) {
-                auto content_node = GetContentNode();
-                if (content_node.begin() == content_node.end()) {
-                    //
-                    continue;
-                }
-                pugi::xml_node patching_node = *content_node.begin();
-                RecursiveMerge(game_node, game_node, patching_node);
-            } else if (GetType() == XmlOperation::Type::AddNextSibling) {
-                for (auto &&node : GetContentNode()) {
-                    game_node = game_node.parent().insert_copy_after(node, game_node);
-                }
-            } else if (GetType() == XmlOperation::Type::AddPrevSibling) {
-                for (auto &&node : GetContentNode()) {
-                    game_node.parent().insert_copy_before(node, game_node);
-                }
-            } else if (GetType() == XmlOperation::Type::Add) {
-                for (auto &node : GetContentNode()) {
-                    game_node.append_copy(node);
-                }
-            } else if (GetType() == XmlOperation::Type::Remove) {
-                game_node.parent().remove_child(game_node);
-            } else if (GetType() == XmlOperation::Type::Replace) {
-                for (auto &node : GetContentNode()) {
-                    game_node.parent().insert_copy_after(node, game_node);
+    if (results.empty()) {
+        WarnNoMatch();
+        return true;
+    }
+    ApplyToTargets(results, {});
+    return true;
+}
+
+XmlPlan XmlOperation::Explain(XmlArenaDocument &doc)
+{
+    if (!guid_.empty() || !template_.empty()) {
+        // Peek leaves the cache alone, Apply runs the same lookups right after
+        const auto lookup = !guid_.empty() ? AssetPath(guid_) : TemplatePath(template_);
+        const auto found  = doc.Peek(lookup);
+        if (found && !found->empty() && speculative_path_ != "*") {
+            const auto node = found->front();
+            auto       seek = doc.Plan(lookup);
+            if (speculative_path_ == "self::node()") {
+                return seek;
+            }
+            auto relative = doc.Plan(speculative_path_, node);
+            if (!relative.pugixml) {
+                relative.path = lookup + " then " + speculative_path_;
+                relative.estimated_visits += seek.estimated_visits;
+                const auto selected = doc.Peek(speculative_path_, node);
+                if (selected && selected->empty()) {
+                    // Nothing below the asset, Apply goes on with the whole path
+                    auto fallback = doc.Plan(GetPath());
+                    fallback.path = relative.path + " else " + fallback.path;
+                    fallback.estimated_visits += relative.estimated_visits;
+                    return fallback;
                 }
-                game_node.parent().remove_child(game_node);
+                return relative;
             }
         }
-    } catch (const pugi::xpath_exception &e) {
-        spdlog::error("Failed to parse path {} in {}: {}", GetPath(), mod_path_.string(), e.what());
     }
+    return doc.Plan(GetPath());
+}
+
+void XmlOperation::WarnNoMatch()
+{
+    offset_data_t offset_data;
+    build_offset_data(offset_data, mod_path_.string().c_str());
+    auto [line, column] = get_location(offset_data, node_.offset_debug());
+    spdlog::warn("No matching node for Path {} in {} ({}:{})", GetPath(), mod_name_,
+                 game_path_.string(), line);
+}
+
+template <typename Targets>
+void XmlOperation::ApplyToTargets(const Targets &targets, const ApplyContext &context)
+{
+    for (const auto &target : targets) {
+        auto game_node = NodeOf(target);
+        if (GetType() == XmlOperation::Type::Merge) {
+            auto content_node = GetContentNode();
+            if (content_node.begin() == content_node.end()) {
+                //
+                continue;
+            }
+            pugi::xml_node patching_node = *content_node.begin();
+            RecursiveMerge(game_node, game_node, patching_node, context);
+        } else if (GetType() == XmlOperation::Type::AddNextSibling) {
+            for (auto &&node : GetContentNode()) {
+                game_node = game_node.parent().insert_copy_after(node, game_node);
+                RecordInserted(context, game_node);
+            }
+        } else if (GetType() == XmlOperation::Type::AddPrevSibling) {
+            for (auto &&node : GetContentNode()) {
+                RecordInserted(context, game_node.parent().insert_copy_before(node, game_node));
+            }
+        } else if (GetType() == XmlOperation::Type::Add) {
+            for (auto &node : GetContentNode()) {
+                RecordInserted(context, game_node.append_copy(node));
+            }
+        } else if (GetType() == XmlOperation::Type::Remove) {
+            RemoveNode(context, game_node);
+        } else if (GetType() == XmlOperation::Type::Replace) {
+            for (auto &node : GetContentNode()) {
+                RecordInserted(context, game_node.parent().insert_copy_after(node, game_node));
+            }
+            RemoveNode(context, game_node);
+        }
+    }
+}
+
+bool XmlOperation::Affected(const XmlChanges &changes) const
+{
+    // GUID and Template lookups go by the same names as path_, which they stand in for
+    return changes.Affects(query_);
 }
 
 std::vector<XmlOperation> XmlOperation::GetXmlOperations(std::shared_ptr<pugi::xml_document> doc,
@@ -468,9 +744,19 @@ std::vector<XmlOperation> XmlOperation::GetXmlOperationsFromFile(fs::path    pat
     return GetXmlOperations(doc, mod_name, game_path, mod_path, doc_path);
 }
 
-void MergeProperties(pugi::xml_node game_node, pugi::xml_node patching_node)
+void MergeProperties(pugi::xml_node game_node, pugi::xml_node patching_node,
+                     const ApplyContext &context)
 {
     for (pugi::xml_attribute &attr : patching_node.attributes()) {
+        if (context.journal && game_node) {
+            context.journal->ChangingAttribute(game_node, attr.name());
+        }
+        if (context.footprint && game_node) {
+            context.footprint->ChangingAttribute(game_node);
+        }
+        if (context.changes && game_node) {
+            context.changes->ChangingAttribute(attr.name());
+        }
         if (auto at = game_node.find_attribute(
                 [attr](auto x) { return std::string(x.name()) == attr.name(); });
             at) {
@@ -480,7 +766,14 @@ void MergeProperties(pugi::xml_node game_node, pugi::xml_node patching_node)
     }
 }
 
-static bool HasNonTextNode(pugi::xml_node node)
+void MergeProperties(XmlArenaNode game_node, pugi::xml_node patching_node, const ApplyContext &)
+{
+    for (pugi::xml_attribute &attr : patching_node.attributes()) {
+        game_node.set_attribute(attr.name(), attr.value());
+    }
+}
+
+template <typename Node> static bool HasNonTextNode(Node node)
 {
     while (node) {
         if (node.type() != pugi::xml_node_type::node_pcdata) {
@@ -491,19 +784,20 @@ static bool HasNonTextNode(pugi::xml_node node)
     return false;
 }
 
-void XmlOperation::RecursiveMerge(pugi::xml_node root_game_node, pugi::xml_node game_node,
-                                  pugi::xml_node patching_node)
+template <typename Node>
+void XmlOperation::RecursiveMerge(Node root_game_node, Node game_node, pugi::xml_node patching_node,
+                                  const ApplyContext &context)
 {
     if (!patching_node) {
         return;
     }
 
-    const auto find_node_with_name = [](pugi::xml_node game_node, auto name) -> pugi::xml_node {
+    const auto find_node_with_name = [](Node game_node, auto name) -> Node {
         if (game_node.name() == std::string(name)) {
             return game_node;
         }
-        auto children = game_node.children();
-        for (pugi::xml_node cur_node : children) {
+        for (auto cur_node = game_node.first_child(); cur_node;
+             cur_node      = cur_node.next_sibling()) {
             if (cur_node.name() == std::string(name)) {
                 return cur_node;
             }
@@ -530,25 +824,27 @@ void XmlOperation::RecursiveMerge(pugi::xml_node root_game_node, pugi::xml_node
         }
     }
 
-    pugi::xml_node prev_game_node;
+    Node prev_game_node;
     for (auto cur_node = patching_node; cur_node; cur_node = cur_node.next_sibling()) {
         if (game_node && game_node.type() != pugi::xml_node_type::node_pcdata) {
             prev_game_node = game_node;
         }
         game_node = find_node_with_name(game_node, cur_node.name());
-        MergeProperties(game_node, cur_node);
+        MergeProperties(game_node, cur_node, context);
         if (game_node) {
             if (game_node.type() == pugi::xml_node_type::node_pcdata) {
-                game_node.set_value(cur_node.value());
+                SetNodeValue(context, game_node, cur_node.value());
                 return;
             } else {
-                RecursiveMerge(root_game_node, game_node.first_child(), cur_node.first_child());
+                RecursiveMerge(root_game_node, game_node.first_child(), cur_node.first_child(),
+                               context);
             }
             game_node = game_node.next_sibling();
         } else {
             if (cur_node && prev_game_node) {
                 while (prev_game_node) {
-                    RecursiveMerge(root_game_node, prev_game_node.first_child(), cur_node);
+                    RecursiveMerge(root_game_node, prev_game_node.first_child(), cur_node,
+                                   context);
                     if (prev_game_node == game_node) {
                         break;
                     }
@@ -573,3 +869,66 @@ XmlOperation::Type XmlOperation::GetType() const
 {
     return type_;
 }
+
+static bool HasElement(pugi::xml_node node, const char *name)
+{
+    for (auto child : node.children()) {
+        if (strcmp(child.name(), name) == 0 || HasElement(child, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether `path` only walks down from its context node
+static bool StaysBelow(const std::string &path)
+{
+    for (auto axis : {"..", "|", "ancestor::", "ancestor-or-self::", "parent::", "preceding::",
+                      "preceding-sibling::", "following::", "following-sibling::"}) {
+        if (path.find(axis) != std::string::npos) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < path.size(); ++i) {
+        if (path[i] == '/' && (i == 0 || strchr("[(=,! ", path[i - 1]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string XmlOperation::Confinement() const
+{
+    if (skip_ || type_ == Type::None) {
+        return {};
+    }
+
+    // Renaming or adding assets and templates changes what other ops find
+    const char *key   = nullptr;
+    std::string target;
+    if (speculative_path_type_ == SpeculativePathType::SINGLE_ASSET) {
+        key    = "GUID";
+        target = XmlFootprint::Asset(guid_);
+    } else if (speculative_path_type_ == SpeculativePathType::SINGLE_TEMPLATE) {
+        key    = "Name";
+        target = XmlFootprint::Template(template_);
+    } else {
+        return XmlFootprint::EVERYTHING;
+    }
+    if (!StaysBelow(speculative_path_) || speculative_path_.find(key) != std::string::npos) {
+        return XmlFootprint::EVERYTHING;
+    }
+    if ((type_ == Type::Remove || type_ == Type::Replace)
+        && (speculative_path_ == "Values" || speculative_path_ == "Values/Standard")) {
+        return XmlFootprint::EVERYTHING;
+    }
+    if (nodes_) {
+        for (auto node : *nodes_) {
+            if (strcmp(node.name(), key) == 0 || HasElement(node, key)
+                || HasElement(node, "Asset") || HasElement(node, "Template")) {
+                return XmlFootprint::EVERYTHING;
+            }
+        }
+    }
+    return target;
+}
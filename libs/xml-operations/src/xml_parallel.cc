@@ -0,0 +1,191 @@
+#include "parallel_for.h"
+#include "xml_operations.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+// Where an asset or template is and the outermost one around it, which may be itself
+struct Target {
+    pugi::xml_node node;
+    pugi::xml_node outermost;
+};
+using Targets = std::unordered_map<std::string, std::vector<Target>>;
+
+void IndexTargets(pugi::xml_node node, pugi::xml_node outermost, Targets &targets)
+{
+    for (auto child : node.children()) {
+        auto around = outermost;
+        if (auto key = XmlFootprint::Key(child); !key.empty()) {
+            if (!around) {
+                around = child;
+            }
+            targets[key].push_back({child, around});
+        }
+        IndexTargets(child, around, targets);
+    }
+}
+
+// A copy of one outermost asset or template and the ops that go into it
+struct Shard {
+    pugi::xml_node                      root       = {};
+    std::vector<size_t>                 operations = {};
+    std::shared_ptr<pugi::xml_document> doc        = {};
+};
+
+using Groups = std::unordered_map<std::string, std::vector<size_t>>;
+
+// Operations [begin, end) by the asset or template they are confined to
+Groups GroupByConfinement(std::vector<XmlOperation> &operations, size_t begin, size_t end)
+{
+    Groups groups;
+    for (size_t i = begin; i < end; ++i) {
+        if (auto target = operations[i].Confinement(); !target.empty()) {
+            groups[target].push_back(i);
+        }
+    }
+    return groups;
+}
+
+// Applies operations [begin, end), all confined to a single asset or template each.
+// Returns false without touching the document if they cannot be split up.
+bool ApplyConfined(std::shared_ptr<pugi::xml_document> doc, std::vector<XmlOperation> &operations,
+                   size_t begin, size_t end, const Groups &groups, size_t threads)
+{
+
+    Targets targets;
+    IndexTargets(*doc, {}, targets);
+
+    // Ops on nested assets go into the same shard as the asset around them
+    std::vector<Shard>                                  shards;
+    std::unordered_map<pugi::xml_node_struct *, size_t> shard_of;
+    std::vector<size_t>                                 unresolved;
+    for (auto &[target, indices] : groups) {
+        auto it = targets.find(target);
+        if (it == targets.end()) {
+            // Nothing in this run can add it, these find nothing either way
+            unresolved.insert(unresolved.end(), indices.begin(), indices.end());
+            continue;
+        }
+        if (it->second.size() > 1) {
+            // Duplicate GUIDs, the XPath fallback would see all of them
+            return false;
+        }
+        const auto root        = it->second.front().outermost;
+        auto [shard, inserted] = shard_of.emplace(root.internal_object(), shards.size());
+        if (inserted) {
+            shards.push_back({root});
+        }
+        auto &shard_operations = shards[shard->second].operations;
+        shard_operations.insert(shard_operations.end(), indices.begin(), indices.end());
+    }
+    if (shards.size() < 2) {
+        return false;
+    }
+
+    // Documents are not thread safe, every shard gets one of its own. The game document is only
+    // read until all of them are done.
+    ParallelFor(shards.size(), threads, [&](size_t i) {
+        auto &shard = shards[i];
+        std::sort(shard.operations.begin(), shard.operations.end());
+        shard.doc = std::make_shared<pugi::xml_document>();
+        shard.doc->append_copy(shard.root);
+        for (auto index : shard.operations) {
+            operations[index].Apply(shard.doc);
+        }
+    });
+
+    // Shards are disjoint, put them back in place in any order. Ops may have removed the root
+    // or added siblings next to it.
+    for (auto &shard : shards) {
+        auto parent = shard.root.parent();
+        for (auto node : shard.doc->children()) {
+            parent.insert_copy_before(node, shard.root);
+        }
+        parent.remove_child(shard.root);
+    }
+    std::sort(unresolved.begin(), unresolved.end());
+    for (auto index : unresolved) {
+        operations[index].Apply(doc);
+    }
+    spdlog::debug("Applied {} operations to {} assets concurrently", end - begin, shards.size());
+    return true;
+}
+
+// Applies `batch` in order. All targets are resolved concurrently against the document as it is
+// now, the ones an op before may have moved are resolved again right before they are used.
+void ApplyResolved(std::shared_ptr<pugi::xml_document> doc, std::vector<XmlOperation> &operations,
+                   const std::vector<size_t> &batch, const ApplyContext &context, size_t threads)
+{
+    if (batch.size() < 2 || threads < 2) {
+        for (auto index : batch) {
+            operations[index].Apply(doc, context);
+        }
+        return;
+    }
+
+    std::vector<std::optional<pugi::xpath_node_set>> targets(batch.size());
+    ParallelFor(batch.size(), threads,
+            [&](size_t i) { targets[i] = operations[batch[i]].Resolve(doc); });
+
+    XmlChanges changes;
+    size_t     again = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        auto &operation = operations[batch[i]];
+        if (!changes.Empty() && operation.Affected(changes)) {
+            targets[i] = operation.Resolve(doc);
+            ++again;
+        }
+        if (targets[i]) {
+            operation.ApplyTo(*targets[i], {context.journal, context.footprint, &changes});
+        }
+    }
+    spdlog::debug("Resolved {} operations concurrently, {} again", batch.size(), again);
+}
+} // namespace
+
+void XmlOperation::ApplyAll(std::shared_ptr<pugi::xml_document> doc,
+                            std::vector<XmlOperation> &operations, const ApplyContext &context,
+                            size_t threads)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // Journals and footprints point into the document, changes have to happen right there
+    const bool parallel = threads > 1 && !context.journal && !context.footprint;
+
+    // Everything that is not split up by asset, lookups only read so they all run up front
+    std::vector<size_t> batch;
+    const auto          flush = [&]() {
+        ApplyResolved(doc, operations, batch, context, threads);
+        batch.clear();
+    };
+
+    size_t begin = 0;
+    while (begin < operations.size()) {
+        size_t end = begin;
+        while (parallel && end < operations.size()
+               && operations[end].Confinement() != XmlFootprint::EVERYTHING) {
+            ++end;
+        }
+        if (const auto groups = GroupByConfinement(operations, begin, end); groups.size() > 1) {
+            // Shards are copied from the document as it is after everything before them
+            flush();
+            if (ApplyConfined(doc, operations, begin, end, groups, threads)) {
+                begin = end;
+                continue;
+            }
+        }
+        // Ops that may reach anywhere and runs that cannot be split
+        end = std::max(end, begin + 1);
+        for (; begin < end; ++begin) {
+            batch.push_back(begin);
+        }
+    }
+    flush();
+}
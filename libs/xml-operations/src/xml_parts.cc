@@ -0,0 +1,343 @@
+#include "xml_parts.h"
+#include "xml_footprint.h"
+#include "xml_markup.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+#ifndef _WIN32
+int strnicmp(const char *a, const char *b, size_t size)
+{
+    return strncasecmp(a, b, size);
+}
+#endif
+
+bool IsNamed(std::string_view name, const char *expected)
+{
+    return name.size() == strlen(expected) && strnicmp(name.data(), expected, name.size()) == 0;
+}
+
+bool IsWhitespace(std::string_view text)
+{
+    return text.find_first_not_of(" \t\r\n") == std::string_view::npos;
+}
+
+// Follows XmlFootprint::Key: an asset is known by the text of its first Values/Standard/GUID, a
+// template by the text of its first Name
+class Scanner
+{
+  public:
+    explicit Scanner(std::string_view buffer)
+        : buffer_(buffer)
+    {
+    }
+
+    XmlPartIndex                                 index;
+    std::unordered_map<std::string_view, size_t> names;
+
+    bool Open(std::string_view name, size_t begin)
+    {
+        ++names[name];
+        auto role = Role::None;
+        if (!open_.empty()) {
+            auto &parent = open_.back();
+            if (parent.role == Role::AssetKey || parent.role == Role::TemplateKey) {
+                // Markup inside the GUID or Name, not worth following what pugi makes of it
+                return false;
+            }
+            if (!parent.child_found) {
+                if ((parent.role == Role::Asset && name == "Values")
+                    || (parent.role == Role::Values && name == "Standard")
+                    || (parent.role == Role::Standard && name == "GUID")
+                    || (parent.role == Role::Template && name == "Name")) {
+                    role               = static_cast<Role>(static_cast<int>(parent.role) + 1);
+                    parent.child_found = true;
+                }
+            }
+        }
+        if (IsNamed(name, "Asset")) {
+            role = Role::Asset;
+        } else if (IsNamed(name, "Template")) {
+            role = Role::Template;
+        }
+
+        if ((role == Role::Asset || role == Role::Template) && part_depth_ == 0) {
+            index.parts.push_back({begin, 0});
+            part_depth_ = open_.size() + 1;
+        }
+        open_.push_back({role, begin});
+        return true;
+    }
+
+    bool Close(std::string_view, size_t end)
+    {
+        const auto element = open_.back();
+        open_.pop_back();
+        if (element.role == Role::AssetKey || element.role == Role::TemplateKey) {
+            // The asset or template this is the key of
+            const auto owner = element.role == Role::AssetKey ? Role::Asset : Role::Template;
+            for (auto it = open_.rbegin(); it != open_.rend(); ++it) {
+                if (it->role == owner) {
+                    it->key = text_;
+                    break;
+                }
+            }
+            text_ = {};
+        }
+        if (element.key) {
+            const auto text = std::string(*element.key);
+            index.keys.push_back({element.role == Role::Asset ? XmlFootprint::Asset(text)
+                                                              : XmlFootprint::Template(text),
+                                  element.begin, end, index.parts.size() - 1});
+        }
+        if (part_depth_ == open_.size() + 1) {
+            index.parts.back().end = end;
+            part_depth_            = 0;
+        }
+        return true;
+    }
+
+    bool Text(size_t begin, size_t end)
+    {
+        if (open_.empty()
+            || (open_.back().role != Role::AssetKey && open_.back().role != Role::TemplateKey)) {
+            return true;
+        }
+        const auto text = buffer_.substr(begin, end - begin);
+        if (IsWhitespace(text)) {
+            // Dropped by the parser
+            return true;
+        }
+        if (!text_.empty() || text.find_first_of("&\r") != std::string_view::npos) {
+            // Split up, escaped or with line endings the parser would change
+            return false;
+        }
+        text_ = text;
+        return true;
+    }
+
+  private:
+    // Consecutive roles are parent and child
+    enum class Role { None, Asset, Values, Standard, AssetKey, Template, TemplateKey };
+
+    struct Element {
+        Role   role  = Role::None;
+        size_t begin = 0;
+        // Text of the key element once closed
+        std::optional<std::string_view> key = {};
+        // Whether the child that leads to the key was seen already, only the first one counts
+        bool child_found = false;
+    };
+
+    std::string_view     buffer_;
+    std::vector<Element> open_;
+    // Depth of the current part, 0 outside of parts
+    size_t           part_depth_ = 0;
+    std::string_view text_;
+};
+} // namespace
+
+std::optional<XmlPartIndex> XmlPartIndex::Scan(std::string_view buffer)
+{
+    Scanner scanner(buffer);
+    if (!WalkMarkup(buffer, scanner)) {
+        return {};
+    }
+
+    auto &keys = scanner.index.keys;
+    std::stable_sort(keys.begin(), keys.end(),
+                     [](const auto &a, const auto &b) { return a.key < b.key; });
+    size_t kept = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (kept > 0 && keys[kept - 1].key == keys[i].key) {
+            keys[kept - 1].part = DUPLICATE;
+        } else {
+            if (kept != i) {
+                keys[kept] = std::move(keys[i]);
+            }
+            ++kept;
+        }
+    }
+    keys.resize(kept);
+
+    auto &names = scanner.index.names;
+    for (const auto &[name, count] : scanner.names) {
+        names.push_back({std::string(name), count});
+    }
+    std::sort(names.begin(), names.end(),
+              [](const auto &a, const auto &b) { return a.name < b.name; });
+    return std::move(scanner.index);
+}
+
+namespace
+{
+const XmlPartKey *FindKey(const std::vector<XmlPartKey> &keys, std::string_view key)
+{
+    const auto it =
+        std::lower_bound(keys.begin(), keys.end(), key,
+                         [](const auto &entry, auto value) { return entry.key < value; });
+    return it != keys.end() && it->key == key ? &*it : nullptr;
+}
+} // namespace
+
+size_t XmlPartIndex::Find(std::string_view key) const
+{
+    const auto *entry = FindKey(keys, key);
+    return entry ? entry->part : NOT_FOUND;
+}
+
+std::string_view XmlPartIndex::Extract(std::string_view buffer, std::string_view key) const
+{
+    const auto *entry = FindKey(keys, key);
+    if (!entry || entry->part == DUPLICATE || entry->end > buffer.size()) {
+        return {};
+    }
+    return buffer.substr(entry->begin, entry->end - entry->begin);
+}
+
+size_t XmlPartIndex::Count(std::string_view name) const
+{
+    const auto it =
+        std::lower_bound(names.begin(), names.end(), name,
+                         [](const auto &entry, auto value) { return entry.name < value; });
+    return it != names.end() && it->name == name ? it->count : 0;
+}
+
+namespace
+{
+constexpr char     MAGIC[4] = {'X', 'P', 'I', 'X'};
+constexpr uint32_t VERSION  = 2;
+
+template <typename T> void Append(std::string &data, T value)
+{
+    data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+class Reader
+{
+  public:
+    explicit Reader(std::string_view data)
+        : data_(data)
+    {
+    }
+
+    template <typename T> bool Read(T &value)
+    {
+        if (data_.size() < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, data_.data(), sizeof(value));
+        data_.remove_prefix(sizeof(value));
+        return true;
+    }
+
+    bool Read(std::string &value, size_t size)
+    {
+        if (data_.size() < size) {
+            return false;
+        }
+        value.assign(data_.data(), size);
+        data_.remove_prefix(size);
+        return true;
+    }
+
+    bool Done() const { return data_.empty(); }
+
+  private:
+    std::string_view data_;
+};
+} // namespace
+
+std::string XmlPartIndex::Save() const
+{
+    std::string data(MAGIC, sizeof(MAGIC));
+    Append(data, VERSION);
+    Append<uint64_t>(data, parts.size());
+    for (const auto &part : parts) {
+        Append<uint64_t>(data, part.begin);
+        Append<uint64_t>(data, part.end);
+    }
+    Append<uint64_t>(data, keys.size());
+    for (const auto &entry : keys) {
+        Append<uint32_t>(data, static_cast<uint32_t>(entry.key.size()));
+        data.append(entry.key);
+        Append<uint64_t>(data, entry.begin);
+        Append<uint64_t>(data, entry.end);
+        Append<uint64_t>(data, entry.part == DUPLICATE ? UINT64_MAX : entry.part);
+    }
+    Append<uint64_t>(data, names.size());
+    for (const auto &entry : names) {
+        Append<uint32_t>(data, static_cast<uint32_t>(entry.name.size()));
+        data.append(entry.name);
+        Append<uint64_t>(data, entry.count);
+    }
+    return data;
+}
+
+std::optional<XmlPartIndex> XmlPartIndex::Load(std::string_view data)
+{
+    if (data.substr(0, sizeof(MAGIC)) != std::string_view(MAGIC, sizeof(MAGIC))) {
+        return {};
+    }
+    Reader   reader(data.substr(sizeof(MAGIC)));
+    uint32_t version = 0;
+    uint64_t count   = 0;
+    if (!reader.Read(version) || version != VERSION || !reader.Read(count)
+        || count > data.size() / 16) {
+        return {};
+    }
+
+    XmlPartIndex index;
+    index.parts.resize(count);
+    for (auto &part : index.parts) {
+        uint64_t begin = 0;
+        uint64_t end   = 0;
+        if (!reader.Read(begin) || !reader.Read(end) || begin > end) {
+            return {};
+        }
+        part = {begin, end};
+    }
+    if (!reader.Read(count) || count > data.size() / 28) {
+        return {};
+    }
+    index.keys.resize(count);
+    for (auto &entry : index.keys) {
+        uint32_t size  = 0;
+        uint64_t begin = 0;
+        uint64_t end   = 0;
+        uint64_t part  = 0;
+        if (!reader.Read(size) || !reader.Read(entry.key, size) || !reader.Read(begin)
+            || !reader.Read(end) || !reader.Read(part) || begin > end
+            || (part != UINT64_MAX && part >= index.parts.size())) {
+            return {};
+        }
+        entry.begin = begin;
+        entry.end   = end;
+        entry.part  = part == UINT64_MAX ? DUPLICATE : part;
+    }
+    if (!reader.Read(count) || count > data.size() / 12) {
+        return {};
+    }
+    index.names.resize(count);
+    for (auto &entry : index.names) {
+        uint32_t size  = 0;
+        uint64_t times = 0;
+        if (!reader.Read(size) || !reader.Read(entry.name, size) || !reader.Read(times)) {
+            return {};
+        }
+        entry.count = times;
+    }
+    const auto sorted =
+        std::is_sorted(index.keys.begin(), index.keys.end(),
+                       [](const auto &a, const auto &b) { return a.key < b.key; })
+        && std::is_sorted(index.names.begin(), index.names.end(),
+                          [](const auto &a, const auto &b) { return a.name < b.name; });
+    if (!reader.Done() || !sorted) {
+        return {};
+    }
+    return index;
+}
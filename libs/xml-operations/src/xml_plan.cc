@@ -0,0 +1,16 @@
+#include "xml_plan.h"
+
+const char *XmlPlan::Name(Kind kind)
+{
+    switch (kind) {
+    case IndexSeek:
+        return "index seek";
+    case PostingScan:
+        return "posting scan";
+    case RelativeXPath:
+        return "relative xpath";
+    case FullScan:
+        return "full scan";
+    }
+    return "";
+}
@@ -0,0 +1,316 @@
+#include "parallel_for.h"
+#include "string_writer.h"
+#include "xml_markup.h"
+#include "xml_sharded_document.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <thread>
+
+namespace
+{
+// Stands in for a shard in the skeleton
+constexpr auto PLACEHOLDER = "ModLoaderShard";
+// Key found in more than one place
+constexpr auto DUPLICATE = std::numeric_limits<size_t>::max();
+
+struct Range {
+    size_t begin;
+    size_t end;
+};
+
+// Byte ranges of the outermost Group and Assets elements
+class Splitter
+{
+  public:
+    std::vector<Range> shards;
+
+    bool Open(std::string_view name, size_t begin)
+    {
+        ++depth_;
+        if (shard_depth_ == 0 && (name == "Group" || name == "Assets")) {
+            shards.push_back({begin, 0});
+            shard_depth_ = depth_;
+        }
+        return true;
+    }
+
+    bool Close(std::string_view, size_t end)
+    {
+        if (shard_depth_ == depth_) {
+            shards.back().end = end;
+            shard_depth_      = 0;
+        }
+        --depth_;
+        return true;
+    }
+
+    bool Text(size_t, size_t)
+    {
+        return true;
+    }
+
+  private:
+    size_t depth_ = 0;
+    // Depth of the current shard, 0 outside of shards
+    size_t shard_depth_ = 0;
+};
+
+std::optional<std::vector<Range>> Split(std::string_view buffer)
+{
+    Splitter splitter;
+    if (!WalkMarkup(buffer, splitter) || splitter.shards.size() < 2) {
+        return {};
+    }
+    return std::move(splitter.shards);
+}
+
+void IndexKeys(pugi::xml_node node, size_t part, std::unordered_map<std::string, size_t> &index)
+{
+    for (auto child : node.children()) {
+        if (auto key = XmlFootprint::Key(child); !key.empty()) {
+            auto [it, inserted] = index.emplace(std::move(key), part);
+            if (!inserted) {
+                it->second = DUPLICATE;
+            }
+        }
+        IndexKeys(child, part, index);
+    }
+}
+
+// Shards of the keys in `index`, found by where they are in the buffer
+void IndexKeys(const XmlPartIndex &index, const std::vector<Range> &ranges,
+               std::unordered_map<std::string, size_t> &keys)
+{
+    keys.reserve(index.keys.size());
+    for (const auto &key : index.keys) {
+        if (key.part == XmlPartIndex::DUPLICATE) {
+            keys.emplace(key.key, DUPLICATE);
+            continue;
+        }
+        auto shard = std::upper_bound(ranges.begin(), ranges.end(), key.begin,
+                                      [](size_t begin, const Range &range) {
+                                          return begin < range.begin;
+                                      });
+        if (shard != ranges.begin() && key.begin < std::prev(shard)->end) {
+            keys.emplace(key.key, std::prev(shard) - ranges.begin());
+        } else {
+            // The skeleton
+            keys.emplace(key.key, ranges.size());
+        }
+    }
+}
+
+// Whether `index` may have been scanned from `buffer`
+bool Matches(const XmlPartIndex &index, std::string_view buffer)
+{
+    for (const auto &key : index.keys) {
+        if (key.end > buffer.size() || key.begin >= key.end || buffer[key.begin] != '<') {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FindPlaceholders(pugi::xml_node node, std::vector<pugi::xml_node> &placeholders)
+{
+    for (auto child : node.children()) {
+        if (strcmp(child.name(), PLACEHOLDER) == 0) {
+            placeholders.push_back(child);
+        } else {
+            FindPlaceholders(child, placeholders);
+        }
+    }
+}
+} // namespace
+
+std::optional<XmlShardedDocument> XmlShardedDocument::Parse(std::string_view buffer,
+                                                           size_t           threads)
+{
+    return Parse(buffer, nullptr, threads);
+}
+
+std::optional<XmlShardedDocument> XmlShardedDocument::Open(std::string_view    buffer,
+                                                          const XmlPartIndex &index,
+                                                          size_t              threads)
+{
+    if (!Matches(index, buffer)) {
+        spdlog::error("Asset index does not match the document, looking through the shards");
+        return Parse(buffer, nullptr, threads);
+    }
+    return Parse(buffer, &index, threads);
+}
+
+std::optional<XmlShardedDocument> XmlShardedDocument::Parse(std::string_view    buffer,
+                                                           const XmlPartIndex *index,
+                                                           size_t              threads)
+{
+    const auto ranges = Split(buffer);
+    if (!ranges) {
+        return {};
+    }
+
+    XmlShardedDocument document;
+    document.threads_ = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+
+    std::string skeleton;
+    size_t      position = 0;
+    for (const auto &range : *ranges) {
+        skeleton.append(buffer.substr(position, range.begin - position));
+        skeleton.append("<").append(PLACEHOLDER).append("/>");
+        position = range.end;
+    }
+    skeleton.append(buffer.substr(position));
+
+    // The skeleton is one more part after the shards
+    const auto                                           parts = ranges->size() + 1;
+    std::vector<std::shared_ptr<pugi::xml_document>>     documents(parts);
+    std::vector<std::unordered_map<std::string, size_t>> indexes(parts);
+    // Not vector<bool>, threads write next to each other
+    std::vector<char> parsed(parts);
+    ParallelFor(parts, document.threads_, [&](size_t i) {
+        documents[i] = std::make_shared<pugi::xml_document>();
+        const auto text =
+            i < ranges->size()
+                ? buffer.substr((*ranges)[i].begin, (*ranges)[i].end - (*ranges)[i].begin)
+                : std::string_view{skeleton};
+        parsed[i] = static_cast<bool>(documents[i]->load_buffer(text.data(), text.size()));
+        if (!index) {
+            IndexKeys(*documents[i], i, indexes[i]);
+        }
+    });
+    if (index) {
+        IndexKeys(*index, *ranges, document.index_);
+    }
+    for (size_t i = 0; i < parts; ++i) {
+        if (!parsed[i]) {
+            spdlog::debug("Failed to parse shard {}", i);
+            return {};
+        }
+        for (auto &[key, part] : indexes[i]) {
+            auto [it, inserted] = document.index_.emplace(key, part);
+            if (!inserted) {
+                it->second = DUPLICATE;
+            }
+        }
+    }
+
+    document.skeleton_ = std::move(documents.back());
+    documents.pop_back();
+    document.shards_ = std::move(documents);
+    FindPlaceholders(*document.skeleton_, document.placeholders_);
+    if (document.placeholders_.size() != document.shards_.size()) {
+        // The document has elements of that name itself
+        return {};
+    }
+    spdlog::debug("Split {} bytes into {} shards", buffer.size(), document.shards_.size());
+    return document;
+}
+
+void XmlShardedDocument::ApplyAll(std::vector<XmlOperation> &operations)
+{
+    size_t begin = 0;
+    while (!materialized_ && begin < operations.size()) {
+        // Ops confined to one asset or template go to the shard it is in, those that cannot
+        // be found anywhere to the skeleton. Confined ops neither add nor remove keys.
+        std::vector<std::vector<size_t>> routed(shards_.size() + 1);
+        size_t                           end = begin;
+        for (; end < operations.size(); ++end) {
+            const auto target = operations[end].Confinement();
+            if (target.empty()) {
+                continue;
+            }
+            if (target == XmlFootprint::EVERYTHING) {
+                break;
+            }
+            const auto it = index_.find(target);
+            if (it != index_.end() && it->second == DUPLICATE) {
+                // The lookup would see all of them
+                break;
+            }
+            routed[it != index_.end() ? it->second : shards_.size()].push_back(end);
+        }
+
+        ParallelFor(routed.size(), threads_, [&](size_t i) {
+            const auto &doc = i < shards_.size() ? shards_[i] : skeleton_;
+            for (auto index : routed[i]) {
+                operations[index].Apply(doc);
+            }
+        });
+        spdlog::debug("Applied {} operations to {} shards", end - begin, shards_.size());
+
+        begin = end;
+        if (begin < operations.size()) {
+            Materialize();
+        }
+    }
+
+    if (begin < operations.size()) {
+        std::vector<XmlOperation> rest(operations.begin() + begin, operations.end());
+        XmlOperation::ApplyAll(skeleton_, rest, {}, threads_);
+    }
+}
+
+std::string XmlShardedDocument::Print()
+{
+    StringWriter skeleton;
+    skeleton_->print(skeleton, "", pugi::format_raw);
+    if (materialized_) {
+        return std::move(skeleton.result);
+    }
+
+    std::vector<StringWriter> shards(shards_.size());
+    ParallelFor(shards_.size(), threads_,
+                [&](size_t i) { shards_[i]->print(shards[i], "", pugi::format_raw); });
+
+    size_t size = skeleton.result.size();
+    for (const auto &shard : shards) {
+        size += shard.result.size();
+    }
+    std::string result;
+    result.reserve(size);
+
+    // Placeholders are empty elements, printed in document order
+    const auto placeholder = std::string("<") + PLACEHOLDER + EmptyElementEnd();
+    size_t     position    = 0;
+    for (const auto &shard : shards) {
+        const auto found = skeleton.result.find(placeholder, position);
+        if (found == std::string::npos) {
+            spdlog::error("Shard placeholder went missing, printing the joined document");
+            Materialize();
+            return Print();
+        }
+        result.append(skeleton.result, position, found - position);
+        result.append(shard.result);
+        position = found + placeholder.size();
+    }
+    result.append(skeleton.result, position, std::string::npos);
+    return result;
+}
+
+std::shared_ptr<pugi::xml_document> XmlShardedDocument::Materialize()
+{
+    if (!materialized_) {
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            auto placeholder = placeholders_[i];
+            for (auto node : shards_[i]->children()) {
+                placeholder.parent().insert_copy_before(node, placeholder);
+            }
+            placeholder.parent().remove_child(placeholder);
+        }
+        shards_.clear();
+        placeholders_.clear();
+        materialized_ = true;
+        spdlog::debug("Joined shards into a single document");
+    }
+    return skeleton_;
+}
+
+size_t XmlShardedDocument::Shards() const
+{
+    return shards_.size();
+}
@@ -0,0 +1,239 @@
+#include "xml_splice.h"
+
+#include "spdlog/spdlog.h"
+
+#include <map>
+#include <string_view>
+
+namespace
+{
+using Region = std::set<std::string>;
+using Parts  = std::map<std::string, std::vector<pugi::xml_node>>;
+
+constexpr std::string_view CONTAINER = "container:";
+
+// Outermost assets and templates by key
+void IndexParts(pugi::xml_node node, Parts &parts)
+{
+    for (auto child : node.children()) {
+        if (auto key = XmlFootprint::Key(child); !key.empty()) {
+            parts[key].push_back(child);
+        } else {
+            IndexParts(child, parts);
+        }
+    }
+}
+
+// Returns false if the key is not unique
+bool FindPart(const Parts &parts, const std::string &key, pugi::xml_node &node)
+{
+    node    = {};
+    auto it = parts.find(key);
+    if (it == parts.end()) {
+        return true;
+    }
+    if (it->second.size() > 1) {
+        return false;
+    }
+    node = it->second.front();
+    return true;
+}
+
+pugi::xml_node Resolve(pugi::xml_node node, const std::string &location)
+{
+    // /Name[index]/Name[index]...
+    size_t position = 0;
+    while (node && position < location.size()) {
+        const auto open  = location.find('[', position);
+        const auto close = location.find(']', open);
+        if (open == std::string::npos || close == std::string::npos) {
+            return {};
+        }
+        const auto name  = location.substr(position + 1, open - position - 1);
+        auto       index = std::stoul(location.substr(open + 1, close - open - 1));
+
+        node = node.child(name.c_str());
+        while (node && --index > 0) {
+            node = node.next_sibling(name.c_str());
+        }
+        position = close + 1;
+    }
+    return node;
+}
+
+bool HasParts(pugi::xml_node node)
+{
+    Parts parts;
+    IndexParts(node, parts);
+    return !parts.empty() || !XmlFootprint::Key(node).empty();
+}
+} // namespace
+
+std::optional<XmlSplice> XmlSplice::Apply(const pugi::xml_document &base,
+                                          const pugi::xml_document &cached,
+                                          const std::vector<XmlFootprint> &old_footprints,
+                                          std::vector<XmlOperation> &changed,
+                                          std::vector<XmlOperation *> later,
+                                          const std::vector<XmlFootprint> &later_footprints)
+{
+    if (later.size() != later_footprints.size()) {
+        return {};
+    }
+
+    XmlSplice splice;
+    splice.later_footprints = later_footprints;
+
+    // Everything the old version wrote has to be rebuilt from `base`
+    Region region;
+    for (const auto &footprint : old_footprints) {
+        region.insert(footprint.writes.begin(), footprint.writes.end());
+    }
+
+    auto work = std::make_shared<pugi::xml_document>();
+    work->reset(base);
+    splice.footprints.resize(changed.size());
+    for (size_t i = 0; i < changed.size(); ++i) {
+        changed[i].Apply(work, {nullptr, &splice.footprints[i]});
+        const auto &writes = splice.footprints[i].writes;
+        region.insert(writes.begin(), writes.end());
+    }
+    if (region.count(XmlFootprint::EVERYTHING) > 0) {
+        spdlog::debug("Changed patch writes outside of assets and templates");
+        return {};
+    }
+
+    // Later ops that overlap have to run again, whatever they wrote is rebuilt as well
+    std::vector<bool> rerun(later.size());
+    for (bool grown = true; grown;) {
+        grown = false;
+        for (size_t i = 0; i < later.size(); ++i) {
+            const auto &footprint = later_footprints[i];
+            if (rerun[i] || !footprint.Touches(region)) {
+                continue;
+            }
+            if (!footprint.Precise()) {
+                spdlog::debug("Later op {} is not limited to assets or templates",
+                              later[i]->GetPath());
+                return {};
+            }
+            rerun[i] = true;
+            region.insert(footprint.writes.begin(), footprint.writes.end());
+            grown = true;
+        }
+    }
+
+    for (size_t i = 0; i < later.size(); ++i) {
+        if (!rerun[i]) {
+            continue;
+        }
+        XmlFootprint footprint;
+        later[i]->Apply(work, {nullptr, &footprint});
+        if (!footprint.Precise()) {
+            return {};
+        }
+
+        // The op may reach parts it did not reach before, those must not depend on skipped ops.
+        // Skipped ops after it must not see what it writes there, the ones before must not have
+        // written what it reads.
+        for (size_t j = 0; j < later.size(); ++j) {
+            if (rerun[j]) {
+                continue;
+            }
+            const auto &skipped = later_footprints[j];
+            for (const auto &part : footprint.writes) {
+                if (region.count(part) == 0 && skipped.Touches({part})) {
+                    return {};
+                }
+            }
+            for (const auto &part : footprint.reads) {
+                if (j < i && region.count(part) == 0 && skipped.writes.count(part) > 0) {
+                    return {};
+                }
+            }
+        }
+        region.insert(footprint.writes.begin(), footprint.writes.end());
+        splice.later_footprints[i] = std::move(footprint);
+        ++splice.rerun;
+    }
+
+    // Start from the cached result and bring in everything that was rebuilt
+    auto result = std::make_shared<pugi::xml_document>();
+    result->reset(cached);
+    Parts work_parts;
+    Parts result_parts;
+    IndexParts(*work, work_parts);
+    IndexParts(*result, result_parts);
+
+    for (const auto &part : region) {
+        if (part.compare(0, CONTAINER.size(), CONTAINER) == 0) {
+            continue;
+        }
+        pugi::xml_node rebuilt;
+        pugi::xml_node previous;
+        if (!FindPart(work_parts, part, rebuilt) || !FindPart(result_parts, part, previous)) {
+            spdlog::debug("{} is not unique", part);
+            return {};
+        }
+        if (!rebuilt && !previous) {
+            continue;
+        }
+        const auto container = XmlFootprint::ContainerOf(rebuilt ? rebuilt : previous);
+        if (region.count(container) > 0) {
+            // Rebuilt together with its siblings
+            continue;
+        }
+        // Adding or removing an asset always writes its container
+        if (!rebuilt || !previous || XmlFootprint::ContainerOf(previous) != container) {
+            return {};
+        }
+        previous.parent().insert_copy_after(rebuilt, previous);
+        previous.parent().remove_child(previous);
+    }
+
+    for (const auto &part : region) {
+        if (part.compare(0, CONTAINER.size(), CONTAINER) != 0) {
+            continue;
+        }
+        const auto location  = part.substr(CONTAINER.size());
+        const auto rebuilt   = Resolve(*work, location);
+        auto       container = Resolve(*result, location);
+        if (!rebuilt || !container) {
+            return {};
+        }
+
+        // The order comes from the rebuilt container, untouched parts from the cached result
+        size_t old_children = 0;
+        size_t untouched    = 0;
+        for (auto child : container.children()) {
+            ++old_children;
+            const auto key = XmlFootprint::Key(child);
+            untouched += !key.empty() && region.count(key) == 0;
+        }
+        for (auto child : rebuilt.children()) {
+            const auto key = XmlFootprint::Key(child);
+            if (key.empty() && HasParts(child)) {
+                // Would drag along stale copies of parts we did not rebuild
+                return {};
+            }
+            if (key.empty() || region.count(key) > 0) {
+                container.append_copy(child);
+                continue;
+            }
+            pugi::xml_node previous;
+            if (!FindPart(result_parts, key, previous) || previous.parent() != container) {
+                return {};
+            }
+            container.append_copy(previous);
+            --untouched;
+        }
+        if (untouched != 0) {
+            return {};
+        }
+        for (; old_children > 0; --old_children) {
+            container.remove_child(container.first_child());
+        }
+    }
+
+    splice.document = std::move(result);
+    return splice;
+}
@@ -1,2 +1,2 @@
 #!/bin/bash
-bazel --noworkspace_rc --nohome_rc --bazelrc=.linux.bazelrc test --spawn_strategy=standalone --test_output=all //tests/xml/...
+bazel --noworkspace_rc --nohome_rc --bazelrc=.linux.bazelrc test --spawn_strategy=standalone --test_output=all //tests/...
@@ -0,0 +1,255 @@
+#include "cache.h"
+#include "fingerprint.h"
+#include "in_memory_game_files.h"
+
+#include "catch2/catch.hpp"
+
+#include <fstream>
+
+namespace
+{
+fs::path StoreDirectory()
+{
+    auto path = fs::temp_directory_path() / "mod-loader-tests" / "layers";
+    fs::remove_all(path);
+    return path;
+}
+} // namespace
+
+TEST_CASE("Layer transitions survive reordering")
+{
+    const auto directory = StoreDirectory();
+    {
+        LayerStore store(directory, "1");
+        store.Load();
+        store.Push("base", "a", TestHash("base+a"), "base+a");
+        store.Push(TestHash("base+a"), "b", TestHash("base+a+b"), "base+a+b");
+        store.Save();
+    }
+
+    LayerStore store(directory, "1");
+    store.Load();
+    // Disabling `a` only needs the new transition, enabling it again hits the old chain
+    CHECK_FALSE(store.Lookup("base", "b"));
+    store.Push("base", "b", TestHash("base+b"), "base+b");
+    CHECK(store.Lookup("base", "a") == TestHash("base+a"));
+    CHECK(store.Lookup(TestHash("base+a"), "b") == TestHash("base+a+b"));
+    CHECK(store.Read(TestHash("base+a+b")) == "base+a+b");
+}
+
+TEST_CASE("Unused layers are trimmed")
+{
+    const auto directory = StoreDirectory();
+    {
+        LayerStore store(directory, "1");
+        store.Load();
+        store.Push("base", "a", "out", "data");
+        store.Save();
+    }
+    for (int i = 0; i < 3; ++i) {
+        LayerStore store(directory, "1");
+        store.Load();
+        store.Trim(1);
+        store.Save();
+    }
+    CHECK_FALSE(fs::exists(directory / "out"));
+}
+
+TEST_CASE("Every load of the layer store is a session")
+{
+    const auto directory = StoreDirectory();
+    {
+        LayerStore store(directory, "1");
+        store.Load();
+        store.Push("base", "a", "out", "data");
+        store.Push("base", "b", "unused", "other data");
+        store.Save();
+    }
+    // Looking a transition up keeps it, the other one goes once it missed more than two sessions
+    for (int i = 0; i < 3; ++i) {
+        LayerStore store(directory, "1");
+        store.Load();
+        CHECK(store.Lookup("base", "a") == "out");
+        CHECK(store.HasLayer("unused"));
+        store.Trim(2);
+        store.Save();
+    }
+    LayerStore store(directory, "1");
+    store.Load();
+    CHECK(store.Lookup("base", "a") == "out");
+    CHECK(store.Read("out") == "data");
+    CHECK_FALSE(store.Lookup("base", "b"));
+    CHECK_FALSE(store.HasLayer("unused"));
+    CHECK_FALSE(fs::exists(directory / "unused"));
+}
+
+TEST_CASE("Looking up a chain keeps every transition of it")
+{
+    const auto directory = StoreDirectory();
+    {
+        LayerStore store(directory, "1");
+        store.Load();
+        store.Push("base", "a", "base+a", "1");
+        store.Push("base+a", "b", "base+a+b", "2");
+        store.Push("base+a+b", "c", "base+a+b+c", "3");
+        store.Save();
+    }
+    for (int i = 0; i < 7; ++i) {
+        LayerStore store(directory, "1");
+        store.Load();
+        CHECK(store.LookupChain("base", {"a", "b", "c"}) == "base+a+b+c");
+        store.Trim(5);
+        store.Save();
+    }
+
+    LayerStore store(directory, "1");
+    store.Load();
+    // Only `c` changed, everything before it is still there
+    CHECK(store.Lookup("base+a", "b") == "base+a+b");
+    CHECK(store.Read("base+a+b") == "2");
+    CHECK_FALSE(store.LookupChain("base", {"a", "b", "d"}));
+    CHECK_FALSE(store.LookupChain("base", {"b", "c"}));
+    CHECK(store.LookupChain("base", {}) == "base");
+}
+
+TEST_CASE("Hot reloads keep the chains of files they skip")
+{
+    const auto directory = StoreDirectory();
+    const auto state     = directory.parent_path() / "fingerprints.json";
+    const auto patch     = directory.parent_path() / "unchanged.xml";
+    fs::remove(state);
+    std::ofstream(patch) << "<ModOps />";
+    size_t     hashed = 0;
+    const auto hasher = [&](const std::string& data) {
+        hashed++;
+        return TestHash(data);
+    };
+
+    {
+        // Like ModManager, one store and fingerprint cache for the game start and every reload
+        LayerStore       store(directory, "1");
+        FingerprintCache fingerprints(state, "1", hasher);
+        store.Load();
+        fingerprints.Load();
+        store.Push("base", fingerprints.FileHash(patch), "unchanged", "data");
+        fingerprints.SetChain("unchanged.xml", {"key", "base", "unchanged"});
+        store.Trim(5);
+        store.Save();
+        fingerprints.Save();
+
+        // Reloads only look at the file that was edited
+        for (int i = 0; i < 7; ++i) {
+            store.Push("base", "edit" + std::to_string(i), "edited" + std::to_string(i), "data");
+            store.Trim(5);
+            store.Save();
+            fingerprints.Save();
+        }
+    }
+
+    LayerStore       store(directory, "1");
+    FingerprintCache fingerprints(state, "1", hasher);
+    store.Load();
+    fingerprints.Load();
+    const auto before     = hashed;
+    const auto patch_hash = fingerprints.FileHash(patch);
+    CHECK(hashed == before);
+    const auto chain = fingerprints.GetChain("unchanged.xml");
+    REQUIRE(chain);
+    CHECK(store.LookupChain(chain->input_hash, {patch_hash}) == chain->output_hash);
+    CHECK(store.Read("unchanged") == "data");
+}
+
+TEST_CASE("Layers stay while a transition references them")
+{
+    const auto directory = StoreDirectory();
+    {
+        LayerStore store(directory, "1");
+        store.Load();
+        store.Push("base", "a", "shared", "data");
+        store.Push("other", "a", "shared", "data");
+        // Replaced, `shared` is still the output of the other transition
+        store.Push("base", "a", "new", "new data");
+        store.Save();
+        CHECK(fs::exists(directory / "shared"));
+    }
+    {
+        LayerStore store(directory, "1");
+        store.Load();
+        CHECK(store.Lookup("base", "a") == "new");
+        CHECK(store.Lookup("other", "a") == "shared");
+        store.Push("other", "a", "new", "new data");
+        store.Save();
+    }
+    CHECK_FALSE(fs::exists(directory / "shared"));
+    CHECK(fs::exists(directory / "new"));
+
+    // Another version starts over
+    LayerStore store(directory, "2");
+    store.Load();
+    CHECK_FALSE(store.Lookup("base", "a"));
+    store.Save();
+    CHECK_FALSE(fs::exists(directory / "new"));
+}
+
+TEST_CASE("Prefetched layers are decompressed in the background")
+{
+    const auto directory = StoreDirectory();
+    LayerStore store(directory, "1");
+    store.Load();
+    for (int i = 0; i < 16; ++i) {
+        store.Push("base", std::to_string(i), "out" + std::to_string(i),
+                   std::string(1024 * 1024, 'a' + i));
+    }
+
+    LayerPrefetcher prefetcher(store, 4);
+    for (int i = 0; i < 16; ++i) {
+        prefetcher.Request("out" + std::to_string(i));
+    }
+    for (int i = 15; i >= 0; --i) {
+        CHECK(prefetcher.Take("out" + std::to_string(i)) == std::string(1024 * 1024, 'a' + i));
+    }
+    // Not requested, read directly
+    CHECK(prefetcher.Take("out0") == std::string(1024 * 1024, 'a'));
+}
+
+TEST_CASE("Sidecars belong to their layer")
+{
+    const auto directory = StoreDirectory();
+    {
+        LayerStore store(directory, "1");
+        store.Load();
+        store.PushSidecar("out", "missing layer");
+        store.Push("base", "a", "out", "data");
+        store.Push("base", "b", "other", "data");
+        store.PushSidecar("out", "index");
+        store.PushSidecar("other", "other index");
+        auto sidecar = store.ReadSidecar("out");
+        REQUIRE(sidecar);
+        CHECK(sidecar->data == "index");
+        CHECK_FALSE(fs::exists(directory / "missing layer.sidecar"));
+        store.Save();
+    }
+    // Copied over another layer's, it has to be ignored
+    fs::copy_file(directory / "other.sidecar", directory / "out.sidecar",
+                  fs::copy_options::overwrite_existing);
+    {
+        LayerStore store(directory, "1");
+        store.Load();
+        CHECK_FALSE(store.ReadSidecar("out"));
+        auto sidecar = store.ReadSidecar("other");
+        REQUIRE(sidecar);
+        CHECK(sidecar->data == "other index");
+    }
+    {
+        LayerStore store(directory, "2");
+        store.Load();
+        CHECK_FALSE(store.ReadSidecar("other"));
+    }
+    for (int i = 0; i < 3; ++i) {
+        LayerStore store(directory, "1");
+        store.Load();
+        store.Trim(1);
+        store.Save();
+    }
+    CHECK_FALSE(fs::exists(directory / "other.sidecar"));
+}
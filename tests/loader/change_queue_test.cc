@@ -0,0 +1,131 @@
+#include "change_queue.h"
+#include "directory_watcher.h"
+
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+bool Contains(const ChangeQueue::Batch& batch, const fs::path& path)
+{
+    return std::find(batch.paths.begin(), batch.paths.end(), path) != batch.paths.end();
+}
+} // namespace
+
+TEST_CASE("Change queue coalesces a burst of changes into one batch")
+{
+    ChangeQueue queue(50ms, 5s);
+
+    std::thread writer([&]() {
+        for (int i = 0; i < 20; ++i) {
+            queue.Push("mod/data/config/assets.xml");
+            queue.Push("mod/./data/config/templates.xml");
+            std::this_thread::sleep_for(5ms);
+        }
+    });
+
+    const auto batch = queue.Wait();
+    writer.join();
+    REQUIRE(batch);
+    CHECK_FALSE(batch->full);
+    CHECK(batch->paths.size() == 2);
+    CHECK(Contains(*batch, "mod/data/config/assets.xml"));
+    CHECK(Contains(*batch, "mod/data/config/templates.xml"));
+}
+
+TEST_CASE("Change queue hands out changes made during a reload in a follow up batch")
+{
+    ChangeQueue queue(20ms, 1s);
+    queue.Push("a/first.xml");
+
+    const auto first = queue.Wait();
+    REQUIRE(first);
+    // Reloading...
+    queue.Push("a/second.xml");
+
+    const auto second = queue.Wait();
+    REQUIRE(second);
+    CHECK(first->paths == std::vector<fs::path>{"a/first.xml"});
+    CHECK(second->paths == std::vector<fs::path>{"a/second.xml"});
+}
+
+TEST_CASE("Change queue falls back to a full reload")
+{
+    ChangeQueue queue(10ms, 1s, 3);
+    for (int i = 0; i < 10; ++i) {
+        queue.Push("mod/file" + std::to_string(i));
+    }
+    auto batch = queue.Wait();
+    REQUIRE(batch);
+    CHECK(batch->full);
+    CHECK(batch->paths.empty());
+
+    queue.Push("mod/file");
+    queue.PushOverflow();
+    batch = queue.Wait();
+    REQUIRE(batch);
+    CHECK(batch->full);
+}
+
+TEST_CASE("Change queue does not wait forever on a steady stream of changes")
+{
+    ChangeQueue      queue(100ms, 150ms);
+    std::atomic_bool done = false;
+
+    std::thread writer([&]() {
+        while (!done.load()) {
+            queue.Push("mod/busy.xml");
+            std::this_thread::sleep_for(10ms);
+        }
+    });
+    const auto batch = queue.Wait();
+    done.store(true);
+    writer.join();
+    CHECK(batch);
+}
+
+TEST_CASE("Change queue wakes up waiters when closed")
+{
+    ChangeQueue queue(10ms, 1s);
+    std::thread closer([&]() {
+        std::this_thread::sleep_for(20ms);
+        queue.Close();
+    });
+    CHECK_FALSE(queue.Wait());
+    closer.join();
+}
+
+TEST_CASE("Directory watcher reports changes relative to the root")
+{
+    const auto root = fs::temp_directory_path() / "mod-loader-tests" / "watched";
+    fs::remove_all(root);
+    fs::create_directories(root / "mod" / "data");
+    fs::create_directories(root / ".cache");
+
+    ChangeQueue queue(50ms, 1s);
+    auto        watcher = DirectoryWatcher::Create(
+        root, queue, [](const fs::path& path) { return path.native().find(".cache") == 0; });
+    REQUIRE(watcher);
+
+    std::ofstream(root / "mod" / "data" / "assets.xml") << "<ModOps />";
+    std::ofstream(root / ".cache" / "index.json") << "{}";
+    fs::create_directories(root / "new-mod");
+
+    auto batch = queue.Wait();
+    REQUIRE(batch);
+    CHECK(Contains(*batch, "mod/data/assets.xml"));
+    CHECK(Contains(*batch, "new-mod"));
+    CHECK_FALSE(Contains(*batch, ".cache/index.json"));
+
+    // Directories created after the watcher started are watched as well
+    std::ofstream(root / "new-mod" / "modinfo.json") << "{}";
+    batch = queue.Wait();
+    REQUIRE(batch);
+    CHECK(batch->paths == std::vector<fs::path>{"new-mod/modinfo.json"});
+}
@@ -0,0 +1,89 @@
+#include "dom_checkpoints.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+void Store(DomCheckpoints& checkpoints, const fs::path& game_path, const std::string& layer_hash,
+           const char* xml)
+{
+    pugi::xml_document document;
+    REQUIRE(document.load_string(xml));
+    checkpoints.Store(game_path, layer_hash, document);
+}
+
+std::string Name(const pugi::xml_document& document)
+{
+    return document.first_child().attribute("Name").value();
+}
+} // namespace
+
+TEST_CASE("Checkpoints hand out a copy of the document they stored")
+{
+    DomCheckpoints     checkpoints(2);
+    pugi::xml_document document;
+    REQUIRE(document.load_string("<Asset Name='a'/>"));
+    checkpoints.Store("data/assets.xml", "layer-a", document);
+
+    // Later changes to the stored document don't leak into the checkpoint
+    document.first_child().attribute("Name").set_value("changed");
+
+    auto taken = checkpoints.Take("data/assets.xml", "layer-a");
+    REQUIRE(taken);
+    CHECK(Name(*taken) == "a");
+    // Taking hands the document over, patching it changes what was taken only
+    CHECK_FALSE(checkpoints.Take("data/assets.xml", "layer-a"));
+
+    // Storing it again after patching keeps the patched state apart
+    checkpoints.Store("data/assets.xml", "layer-a", *taken);
+    taken->first_child().attribute("Name").set_value("patched");
+    auto again = checkpoints.Take("data/assets.xml", "layer-a");
+    REQUIRE(again);
+    CHECK(Name(*again) == "a");
+}
+
+TEST_CASE("Checkpoints are looked up by file and layer")
+{
+    DomCheckpoints checkpoints(2);
+    Store(checkpoints, "data/assets.xml", "layer-a", "<Asset Name='a'/>");
+    Store(checkpoints, "data/templates.xml", "layer-b", "<Asset Name='b'/>");
+
+    CHECK_FALSE(checkpoints.Take("data/assets.xml", "layer-b"));
+    CHECK_FALSE(checkpoints.Take("data/templates.xml", "layer-a"));
+    CHECK_FALSE(checkpoints.Take("data/other.xml", "layer-a"));
+    CHECK(Name(*checkpoints.Take("data/assets.xml", "layer-a")) == "a");
+    CHECK(Name(*checkpoints.Take("data/templates.xml", "layer-b")) == "b");
+}
+
+TEST_CASE("Only the newest checkpoints of a file are kept")
+{
+    DomCheckpoints checkpoints(2);
+    Store(checkpoints, "data/assets.xml", "layer-a", "<Asset Name='a'/>");
+    Store(checkpoints, "data/assets.xml", "layer-b", "<Asset Name='b'/>");
+    Store(checkpoints, "data/templates.xml", "layer-x", "<Asset Name='x'/>");
+    Store(checkpoints, "data/assets.xml", "layer-c", "<Asset Name='c'/>");
+
+    CHECK_FALSE(checkpoints.Take("data/assets.xml", "layer-a"));
+    CHECK(checkpoints.Take("data/assets.xml", "layer-b"));
+    CHECK(checkpoints.Take("data/assets.xml", "layer-c"));
+    // Other files have their own budget
+    CHECK(checkpoints.Take("data/templates.xml", "layer-x"));
+}
+
+TEST_CASE("Storing a layer twice keeps the first document")
+{
+    DomCheckpoints checkpoints(2);
+    Store(checkpoints, "data/assets.xml", "layer-a", "<Asset Name='a'/>");
+    Store(checkpoints, "data/assets.xml", "layer-b", "<Asset Name='b'/>");
+    Store(checkpoints, "data/assets.xml", "layer-a", "<Asset Name='other'/>");
+
+    CHECK(Name(*checkpoints.Take("data/assets.xml", "layer-a")) == "a");
+    CHECK(checkpoints.Take("data/assets.xml", "layer-b"));
+}
+
+TEST_CASE("Checkpoints are disabled with a budget of zero")
+{
+    DomCheckpoints checkpoints(0);
+    Store(checkpoints, "data/assets.xml", "layer-a", "<Asset Name='a'/>");
+    CHECK_FALSE(checkpoints.Take("data/assets.xml", "layer-a"));
+}
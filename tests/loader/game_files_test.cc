@@ -0,0 +1,68 @@
+#include "in_memory_game_files.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+fs::path StateFile()
+{
+    auto path = fs::temp_directory_path() / "mod-loader-tests" / "base_files.json";
+    fs::remove(path);
+    return path;
+}
+} // namespace
+
+TEST_CASE("Base file hash is only computed once per archive state")
+{
+    const auto             state_file = StateFile();
+    InMemoryGameFileSource source;
+    source.Set("data/config/export/main/asset/assets.xml", "<Assets/>");
+
+    {
+        BaseFileCache cache(source, state_file, TestHash);
+        cache.Load();
+        CHECK(cache.Hash("data/config/export/main/asset/assets.xml") == TestHash("<Assets/>"));
+        CHECK(source.Reads() == 1);
+        // Data read while hashing is handed out without reading again
+        CHECK(cache.Read("data/config/export/main/asset/assets.xml") == "<Assets/>");
+        CHECK(source.Reads() == 1);
+        cache.Save();
+    }
+
+    BaseFileCache cache(source, state_file, TestHash);
+    cache.Load();
+    CHECK(cache.Hash("data/config/export/main/asset/assets.xml") == TestHash("<Assets/>"));
+    CHECK(source.Reads() == 1);
+    CHECK(cache.Read("data/config/export/main/asset/assets.xml") == "<Assets/>");
+    CHECK(source.Reads() == 2);
+}
+
+TEST_CASE("Base file hash is recomputed when the archive changed")
+{
+    const auto             state_file = StateFile();
+    InMemoryGameFileSource source;
+    source.Set("data/config/game/camera.xml", "<Camera/>");
+
+    {
+        BaseFileCache cache(source, state_file, TestHash);
+        cache.Load();
+        cache.Hash("data/config/game/camera.xml");
+        cache.Save();
+    }
+
+    source.Set("data/config/game/camera.xml", "<Camera/>", "data1.rda");
+    BaseFileCache cache(source, state_file, TestHash);
+    cache.Load();
+    CHECK(cache.Hash("data/config/game/camera.xml") == TestHash("<Camera/>"));
+    CHECK(source.Reads() == 2);
+}
+
+TEST_CASE("Missing base files have no hash")
+{
+    InMemoryGameFileSource source;
+    BaseFileCache          cache(source, StateFile(), TestHash);
+    cache.Load();
+    CHECK_FALSE(cache.Exists("data/config/gui/new.include.xml"));
+    CHECK(cache.Hash("data/config/gui/new.include.xml").empty());
+    CHECK(source.Reads() == 0);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "game_files.h"
+
+#include <functional>
+#include <map>
+#include <string>
+
+// Stand-in for the RDA archives
+class InMemoryGameFileSource : public GameFileSource
+{
+  public:
+    void Set(const fs::path& game_path, std::string data, std::string archive = "data0.rda")
+    {
+        files_[game_path.generic_string()] = {std::move(data), std::move(archive)};
+    }
+
+    std::optional<std::string> Identity(const fs::path& game_path) const override
+    {
+        auto it = files_.find(game_path.generic_string());
+        if (it == files_.end()) {
+            return {};
+        }
+        return it->second.archive + ":" + std::to_string(it->second.data.size());
+    }
+
+    std::string Read(const fs::path& game_path) const override
+    {
+        reads_ += 1;
+        auto it = files_.find(game_path.generic_string());
+        if (it == files_.end()) {
+            return "";
+        }
+        return it->second.data;
+    }
+
+    size_t Reads() const
+    {
+        return reads_;
+    }
+
+  private:
+    struct File {
+        std::string data;
+        std::string archive;
+    };
+
+    std::map<std::string, File> files_;
+    mutable size_t              reads_ = 0;
+};
+
+inline std::string TestHash(const std::string& data)
+{
+    return std::to_string(std::hash<std::string>{}(data));
+}
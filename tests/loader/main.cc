@@ -0,0 +1,4 @@
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_SINGLE_INCLUDE
+#include <catch2/catch.hpp>
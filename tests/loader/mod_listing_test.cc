@@ -0,0 +1,68 @@
+#include "mod_listing.h"
+
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+fs::path ModDirectory()
+{
+    auto path = fs::temp_directory_path() / "mod-loader-tests" / "mods" / "[Test] Mod";
+    fs::remove_all(path);
+    fs::create_directories(path / "data" / "config");
+    std::ofstream(path / "modinfo.json") << "{}";
+    std::ofstream(path / "data" / "config" / "assets.xml") << "<ModOps />";
+    return fs::canonical(path);
+}
+
+void Touch(const fs::path& directory)
+{
+    // Don't rely on the timestamp resolution of the file system
+    fs::last_write_time(directory, fs::last_write_time(directory) + std::chrono::seconds(1));
+}
+
+std::vector<std::string> Sorted(std::vector<std::string> files)
+{
+    std::sort(files.begin(), files.end());
+    return files;
+}
+} // namespace
+
+TEST_CASE("Mod scans list files relative to the mod root")
+{
+    const auto root    = ModDirectory();
+    const auto listing = ModListingCache::Scan(root);
+
+    CHECK(Sorted(listing.files)
+          == std::vector<std::string>{"data/config/assets.xml", "modinfo.json"});
+    CHECK(listing.directories.size() == 3);
+}
+
+TEST_CASE("Unchanged mods are not scanned again")
+{
+    const auto root       = ModDirectory();
+    const auto state_file = root.parent_path() / "mod_listings.json";
+    {
+        ModListingCache cache(state_file);
+        cache.Load();
+        CHECK(cache.Get(root).files.size() == 2);
+        CHECK(cache.Rescans() == 1);
+        CHECK(cache.Get(root).files.size() == 2);
+        CHECK(cache.Rescans() == 1);
+        cache.Save();
+    }
+
+    ModListingCache cache(state_file);
+    cache.Load();
+    CHECK(cache.Get(root).files.size() == 2);
+    CHECK(cache.Rescans() == 0);
+
+    std::ofstream(root / "data" / "config" / "templates.xml") << "<ModOps />";
+    Touch(root / "data" / "config");
+    CHECK(Sorted(cache.Get(root).files)
+          == std::vector<std::string>{"data/config/assets.xml", "data/config/templates.xml",
+                                      "modinfo.json"});
+    CHECK(cache.Rescans() == 1);
+}
@@ -0,0 +1,42 @@
+#include "path_index.h"
+
+#include "catch2/catch.hpp"
+
+TEST_CASE("Path index lookups are case and separator insensitive")
+{
+    PathIndex index;
+    index.Insert(L"data\\config\\export\\main\\asset\\assets.xml", 1);
+    index.Insert(L"data/graphics/ui/appicons/anno7.png", 2);
+
+    CHECK(index.Find(L"data/config/export/main/asset/assets.xml") == 1);
+    CHECK(index.Find(L"DATA/Config/Export/main/asset/ASSETS.xml") == 1);
+    CHECK(index.Find(L"data//config/./export/main/foo/../asset/assets.xml") == 1);
+    CHECK(index.Find(L"data/graphics/ui/appicons/anno7.png") == 2);
+    CHECK(index.Find(L"data/graphics/ui/appicons/anno8.png") == PathIndex::npos);
+    CHECK(index.Size() == 2);
+}
+
+TEST_CASE("Path index aliases resolve to their target")
+{
+    PathIndex index;
+    index.Insert(L"data/config/export/main/asset/assets.xml", 7);
+    CHECK(index.Alias(L"data/config/game/asset/assets.xml",
+                      L"data/config/export/main/asset/assets.xml"));
+    CHECK_FALSE(index.Alias(L"data/config/game/asset/templates.xml",
+                            L"data/config/export/main/asset/templates.xml"));
+
+    CHECK(index.Find(L"data/config/game/asset/assets.xml") == 7);
+    CHECK_FALSE(index.Contains(L"data/config/game/asset/templates.xml"));
+}
+
+TEST_CASE("Path index grows and overwrites")
+{
+    PathIndex index;
+    for (uint32_t i = 0; i < 10000; ++i) {
+        index.Insert(L"data/file" + std::to_wstring(i) + L".dds", i);
+    }
+    index.Insert(L"data/FILE42.dds", 1);
+    CHECK(index.Size() == 10000);
+    CHECK(index.Find(L"data/file42.dds") == 1);
+    CHECK(index.Find(L"data/file9999.dds") == 9999);
+}
@@ -0,0 +1,92 @@
+#include "snapshot_ptr.h"
+
+#include "catch2/catch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct Table {
+    explicit Table(int generation)
+        : generation(generation)
+        , values(256, generation)
+    {
+    }
+    ~Table()
+    {
+        // Make use after free visible even without sanitizers
+        generation = -1;
+        values.assign(values.size(), -1);
+    }
+
+    int              generation;
+    std::vector<int> values;
+};
+} // namespace
+
+TEST_CASE("Snapshot readers see the latest published value")
+{
+    SnapshotPtr<Table> table;
+    CHECK_FALSE(table.Read());
+
+    table.Publish(std::make_unique<Table>(1));
+    CHECK(table.Read()->generation == 1);
+
+    {
+        auto guard = table.Read();
+        CHECK(guard->generation == 1);
+    }
+    table.Publish(std::make_unique<Table>(2));
+    CHECK(table.Read()->generation == 2);
+}
+
+TEST_CASE("Snapshot readers stay consistent while the value is swapped")
+{
+    constexpr int GENERATIONS = 2000;
+
+    SnapshotPtr<Table> table(std::make_unique<Table>(0));
+    std::atomic_bool   done         = false;
+    std::atomic_int    inconsistent = 0;
+    std::atomic_int    reads        = 0;
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&]() {
+            int last_seen = 0;
+            while (!done.load()) {
+                const auto guard      = table.Read();
+                const auto generation = guard->generation;
+                for (auto value : guard->values) {
+                    if (value != generation) {
+                        inconsistent += 1;
+                        break;
+                    }
+                }
+                // Generations only ever go forward
+                if (generation < last_seen) {
+                    inconsistent += 1;
+                }
+                last_seen = generation;
+                reads += 1;
+            }
+        });
+    }
+
+    for (int generation = 1; generation <= GENERATIONS; ++generation) {
+        table.Publish(std::make_unique<Table>(generation));
+    }
+    // Publishing may be done before a reader got to run at all
+    while (reads.load() == 0) {
+        std::this_thread::yield();
+    }
+    done.store(true);
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    CHECK(inconsistent.load() == 0);
+    CHECK(reads.load() > 0);
+    CHECK(table.Read()->generation == GENERATIONS);
+}
@@ -0,0 +1,350 @@
+#include "helpers.h"
+#include "xml_arena_document.h"
+#include "xml_operations.h"
+
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <string>
+
+namespace
+{
+constexpr auto INPUT = R"(<?xml version="1.0" encoding="utf-8"?>
+<AssetList>
+  <Groups>
+    <Group>
+      <Assets>
+        <Asset>
+          <Template>Building</Template>
+          <Values><Standard><GUID>1</GUID><Name>One &amp; only</Name></Standard><Cost Amount="1" /></Values>
+        </Asset>
+        <Asset>
+          <Values><Standard><GUID>2</GUID></Standard></Values>
+          <Assets><Asset><Values><Standard><GUID>20</GUID></Standard></Values></Asset></Assets>
+        </Asset>
+        <!-- <Asset> -->
+        <Asset><Values><Standard><GUID>3</GUID></Standard></Values></Asset>
+      </Assets>
+    </Group>
+  </Groups>
+  <Templates>
+    <Template><Name>Building</Name><Properties><Cost /></Properties></Template>
+  </Templates>
+</AssetList>
+)";
+
+// Applies `patch` to both backends, they have to come out the same
+void Compare(const char *patch)
+{
+    const auto operations = Load(patch);
+
+    auto doc   = Load(INPUT);
+    auto arena = XmlArenaDocument::Parse(INPUT);
+    REQUIRE(arena);
+    for (auto &&operation : XmlOperation::GetXmlOperations(operations)) {
+        operation.Apply(doc);
+        REQUIRE(operation.Apply(*arena));
+    }
+    CHECK(arena->Print() == Print(*doc));
+
+    // Those go by the names the ops kept up to date
+    for (const char *path : {"//GUID", "//Asset", "//Standard[GUID='4']", "//Amount", "//Size",
+                             "//Asset[Template='Building']", "//Asset[Template='Other']",
+                             "//Standard[Name='Renamed']", "//Standard[Name='One & only']"}) {
+        INFO(path);
+        const auto selected = arena->Select(path);
+        REQUIRE(selected);
+        const auto nodes = doc->select_nodes(path);
+        REQUIRE(selected->size() == nodes.size());
+        size_t i = 0;
+        for (auto node : nodes) {
+            CHECK((*selected)[i++].child_value() == node.node().child_value());
+        }
+    }
+}
+} // namespace
+
+TEST_CASE("Arena documents parse and print like pugixml")
+{
+    const std::string input = "<?xml version=\"1.0\"?>\r\n<!DOCTYPE A>\r\n<A  x = 'a&quot;b\"c'\r\n"
+                              "  y=\"1\t2&#10;3&lt;\">\r\n  <B>one &amp; &#x41;&#66; &unknown; >"
+                              "</B>\r\n  <!-- <B> -->\r\n  <C><![CDATA[ <x> & ]]></C>\r\n"
+                              "  <D>line\r\nbreak &#1;</D><E/><F></F>   <G> <H /> </G>\r\n</A>\r\n";
+    auto              arena = XmlArenaDocument::Parse(input);
+    REQUIRE(arena);
+    // Whether pugixml puts a space before "/>" depends on its version
+    const auto end = Print(*Load("<E/>")).substr(2);
+    CHECK(arena->Print()
+          == "<A x=\"a&quot;b&quot;c\" y=\"1 2&#10;3&lt;\"><B>one &amp; AB &amp;unknown; &gt;</B>"
+             "<C><![CDATA[ <x> & ]]></C><D>line\nbreak &#01;</D><E"
+                 + end + "<F" + end + "<G><H" + end + "</G></A>");
+    auto doc = XmlArenaDocument::Parse(INPUT);
+    REQUIRE(doc);
+    CHECK(doc->Print() == Print(*Load(INPUT)));
+
+    auto empty = XmlArenaDocument::Parse("");
+    REQUIRE(empty);
+    CHECK(empty->Print().empty());
+    CHECK_FALSE(XmlArenaDocument::Parse("<A><B></A>"));
+    CHECK_FALSE(XmlArenaDocument::Parse("<A b></A>"));
+}
+
+TEST_CASE("Arena documents select a subset of XPath")
+{
+    auto arena = XmlArenaDocument::Parse(INPUT);
+    REQUIRE(arena);
+    auto doc = Load(INPUT);
+
+    for (const char *path :
+         {"//Asset", "/AssetList/*", "//Assets//Asset", "//Asset/Values", "//Assets/Asset/Values",
+          "//Asset[Values/Standard/GUID='20']", "//Standard[Name=\"One & only\"]",
+          "//Cost[@Amount='1']", "//Asset[Template]", "//Values//GUID", "//Missing",
+          "//Asset[Missing='1']", "Groups", "//Template[Name='Building']/Properties"}) {
+        INFO(path);
+        const auto selected = arena->Select(path);
+        REQUIRE(selected);
+        const auto nodes = doc->select_nodes(path);
+        REQUIRE(selected->size() == nodes.size());
+        size_t i = 0;
+        for (auto node : nodes) {
+            CHECK(std::string((*selected)[i++].name()) == node.node().name());
+        }
+    }
+
+    const auto asset = arena->Select("//Asset[Values/Standard/GUID='2']");
+    REQUIRE(asset);
+    REQUIRE(asset->size() == 1);
+    const auto guid = arena->Select("Values/Standard/GUID", asset->front());
+    REQUIRE(guid);
+    REQUIRE(guid->size() == 1);
+    CHECK(guid->front().child_value() == "2");
+    CHECK(arena->Select("self::node()", asset->front())->front() == asset->front());
+    CHECK(arena->Select("//Values[Cost/@Amount='1']")->size() == 1);
+    CHECK(arena->Select("//Values[Cost/@Amount]")->size() == 1);
+
+    CHECK(arena->Select("guid('2')")->front() == asset->front());
+    CHECK(arena->Select("guid(\"20\")/Values/Standard/GUID")->front().child_value() == "20");
+    CHECK(arena->Select("guid('1')/Values[Cost]")->size() == 1);
+    CHECK(arena->Select("guid('2')/Values[Cost]")->empty());
+    CHECK(arena->Select("guid('2')[Assets]//GUID")->size() == 2);
+    CHECK(arena->Select("guid('4')")->empty());
+    CHECK(arena->Select("template('Building')/Properties/Cost")->size() == 1);
+    CHECK(arena->Plan("guid('2')/Values").kind == XmlPlan::IndexSeek);
+
+    for (const char *path : {"//Asset/..", "//Asset[1]", "count(//Asset)", "//Asset | //Template",
+                             "//Asset[GUID!='1']", "//Asset[GUID=1]", "//Standard/text()",
+                             "//Asset/Template/..", "/", "", "guid(2)", "guid('2'",
+                             "guid('2')Values", "name('2')"}) {
+        INFO(path);
+        CHECK_FALSE(arena->Select(path));
+    }
+}
+
+TEST_CASE("Asset and template paths quote their value")
+{
+    auto operations = XmlOperation::GetXmlOperations(Load(R"(<ModOps>
+      <ModOp Type="add" Template="It's" Path="/Properties"><Extra /></ModOp>
+      <ModOp Type="add" Path='template("It&apos;s")/Properties'><Extra /></ModOp>
+      <ModOp Type="add" Template="Say &quot;it's&quot;" Path="/Properties"><Extra /></ModOp>
+    </ModOps>)"));
+    REQUIRE(operations.size() == 3);
+    CHECK(operations[0].GetPath() == R"(//Template[Name="It's"]/Properties)");
+    CHECK(operations[1].GetPath() == R"(//Template[Name="It's"]/Properties)");
+    CHECK(operations[2].GetPath()
+          == R"(//Template[Name=concat('Say "it', "'", 's"')]/Properties)");
+
+    auto arena = XmlArenaDocument::Parse(
+        R"(<Templates><Template><Name>It's</Name><Properties /></Template></Templates>)");
+    REQUIRE(arena);
+    CHECK(arena->Select(operations[0].GetPath())->size() == 1);
+    CHECK(arena->Select(R"(template("It's")/Properties)")->size() == 1);
+}
+
+TEST_CASE("Arena documents apply ops like pugixml")
+{
+    Compare(R"(<ModOps>
+      <ModOp Type="merge" GUID="1" Path="/Values/Standard"><Standard><Name>Renamed</Name></Standard></ModOp>
+      <ModOp Type="merge" GUID="1" Path="/Values"><Cost Amount="2" Extra="&lt;" /></ModOp>
+      <ModOp Type="add" GUID="20" Path="/Values"><Building><Size>3</Size></Building></ModOp>
+      <ModOp Type="addNextSibling" GUID="2"><Asset><Values><Standard><GUID>4</GUID></Standard></Values></Asset></ModOp>
+      <ModOp Type="addPrevSibling" Path="//Asset[Values/Standard/GUID='3']"><A /><B /></ModOp>
+      <ModOp Type="replace" Template="Building" Path="/Properties/Cost"><Cost><Amount>5</Amount></Cost></ModOp>
+      <ModOp Type="add" GUID="2"><Template>Building</Template></ModOp>
+      <ModOp Type="merge" GUID="1"><Template>Other</Template></ModOp>
+      <ModOp Type="remove" GUID="3" />
+      <ModOp Type="add" Path="//Assets[Asset/Values/Standard/GUID='4']"><Asset /></ModOp>
+      <ModOp Type="merge" Path="//Template[Name='Building']"><Properties><Cost><Amount>6</Amount></Cost></Properties></ModOp>
+      <ModOp Type="add" GUID="5" Path="/Values"><Missing /></ModOp>
+      <ModOp Type="remove" GUID="1" Path="/Values/*" Skip="1" />
+      <ModOp Type="remove" GUID="20" />
+      <ModOp Type="add" Path="guid('2')/Values[Standard]"><Building /></ModOp>
+      <ModOp Type="merge" Path="guid('4')[Values/Standard]//Standard"><Name>Four</Name></ModOp>
+      <ModOp Type="add" Path='template("Building")'><Extra /></ModOp>
+    </ModOps>)");
+
+    const auto operations = Load(R"(<ModOps>
+      <ModOp Type="remove" Path="//Asset[1]" />
+    </ModOps>)");
+    auto       arena      = XmlArenaDocument::Parse(INPUT);
+    REQUIRE(arena);
+    const auto before = arena->Print();
+    CHECK_FALSE(XmlOperation::GetXmlOperations(operations)[0].Apply(*arena));
+    CHECK(arena->Print() == before);
+}
+
+TEST_CASE("Arena value indexes follow ops")
+{
+    auto arena = XmlArenaDocument::Parse(INPUT, {{"Asset", "Values/Standard/GUID"}});
+    REQUIRE(arena);
+    const auto guids = [&](const char *guid) {
+        const auto selected =
+            arena->Select(std::string("//Asset[Values/Standard/GUID='") + guid + "']");
+        REQUIRE(selected);
+        return selected->size();
+    };
+    CHECK(guids("20") == 1);
+
+    const auto operations = Load(R"(<ModOps>
+      <ModOp Type="remove" GUID="20" />
+      <ModOp Type="merge" GUID="3" Path="/Values/Standard"><GUID>20</GUID></ModOp>
+      <ModOp Type="addNextSibling" GUID="1"><Asset><Values><Standard><GUID>20</GUID></Standard></Values></Asset></ModOp>
+    </ModOps>)");
+    auto       applied    = XmlOperation::GetXmlOperations(operations);
+    REQUIRE(applied[0].Apply(*arena));
+    CHECK(guids("20") == 0);
+    REQUIRE(applied[1].Apply(*arena));
+    CHECK(guids("20") == 1);
+    CHECK(guids("3") == 0);
+    REQUIRE(applied[2].Apply(*arena));
+    const auto selected = arena->Select("//Asset[Values/Standard/GUID='20']/Values/Standard/GUID");
+    REQUIRE(selected);
+    CHECK(selected->size() == 2);
+    CHECK(arena->Select("//Asset[Values/Standard/GUID='20']")->front().first_child().name()
+          == std::string("Values"));
+}
+
+TEST_CASE("Arena plans tell how paths are evaluated")
+{
+    auto arena = XmlArenaDocument::Parse(INPUT);
+    REQUIRE(arena);
+
+    const auto explain = [&](const char *path) {
+        const auto plan   = arena->Plan(path);
+        const auto before = arena->Visits();
+        const auto nodes  = arena->Select(path);
+        CHECK(nodes.has_value() == !plan.pugixml);
+        return std::make_pair(plan, arena->Visits() - before);
+    };
+
+    auto [seek, seek_visits] = explain("//Asset[Values/Standard/GUID='20']");
+    CHECK(seek.kind == XmlPlan::IndexSeek);
+    CHECK(seek.estimated_visits == 1);
+    CHECK(seek_visits == 1);
+
+    auto [scan, scan_visits] = explain("//GUID");
+    CHECK(scan.kind == XmlPlan::PostingScan);
+    CHECK(scan.estimated_visits == 4);
+    CHECK(scan_visits == 4);
+
+    auto [full, full_visits] = explain("//*[GUID]");
+    CHECK(full.kind == XmlPlan::FullScan);
+    CHECK(full.estimated_visits == full_visits);
+
+    auto [relative, relative_visits] = explain("/AssetList/Templates");
+    CHECK(relative.kind == XmlPlan::RelativeXPath);
+    CHECK(relative_visits == 3);
+
+    auto [pugixml, pugixml_visits] = explain("//Asset[1]");
+    CHECK(pugixml.pugixml);
+    CHECK(pugixml_visits == 0);
+
+    const auto operations = Load(R"(<ModOps>
+      <ModOp Type="add" GUID="3"><Extra /></ModOp>
+      <ModOp Type="add" GUID="1" Path="/Values/Standard"><Extra /></ModOp>
+      <ModOp Type="add" Template="Building" Path="/Properties"><Extra /></ModOp>
+      <ModOp Type="add" Path="//Cost"><Extra /></ModOp>
+      <ModOp Type="add" GUID="1" Path="/Values/Missing"><Extra /></ModOp>
+    </ModOps>)");
+    auto       applied    = XmlOperation::GetXmlOperations(operations);
+    REQUIRE(applied.size() == 5);
+    CHECK(applied[0].Explain(*arena).kind == XmlPlan::IndexSeek);
+    CHECK(applied[1].Explain(*arena).kind == XmlPlan::RelativeXPath);
+    CHECK(applied[1].Explain(*arena).path
+          == "//Asset[Values/Standard/GUID='1'] then Values/Standard");
+    CHECK(applied[2].Explain(*arena).kind == XmlPlan::RelativeXPath);
+    CHECK(applied[3].Explain(*arena).kind == XmlPlan::PostingScan);
+    // Nothing below the asset, Apply falls back to the whole path
+    CHECK(applied[4].Explain(*arena).path
+          == "//Asset[Values/Standard/GUID='1'] then Values/Missing else "
+             "//Asset[Values/Standard/GUID='1']/Values/Missing");
+
+    // Explaining leaves what Apply measures alone
+    const auto visits = arena->Visits();
+    const auto hits   = arena->CacheHits();
+    const auto misses = arena->CacheMisses();
+    applied[1].Explain(*arena);
+    CHECK(arena->Visits() == visits);
+    CHECK(arena->CacheHits() == hits);
+    CHECK(arena->CacheMisses() == misses);
+}
+
+TEST_CASE("Arena selections are reused until what they depend on changes")
+{
+    auto arena = XmlArenaDocument::Parse(INPUT);
+    REQUIRE(arena);
+    const auto select = [&](const char *path, XmlArenaNode context = {}) {
+        const auto hits   = arena->CacheHits();
+        const auto nodes  = arena->Select(path, context);
+        const bool cached = arena->CacheHits() > hits;
+        REQUIRE(nodes);
+        return std::make_pair(*nodes, cached);
+    };
+    const auto apply = [&](const char *patch) {
+        for (auto &&operation : XmlOperation::GetXmlOperations(Load(patch))) {
+            REQUIRE(operation.Apply(*arena));
+        }
+    };
+
+    const auto asset = select("//Asset[Values/Standard/GUID='2']").first;
+    REQUIRE(asset.size() == 1);
+    const auto visits = arena->Visits();
+    CHECK(select("//Asset[Values/Standard/GUID='2']") == std::make_pair(asset, true));
+    CHECK(arena->Visits() == visits);
+    CHECK(select("//Asset[Values/Standard/GUID='2']/Values").second == false);
+    CHECK(select("Values/Standard/GUID", asset[0]).second == false);
+    CHECK(select("//Cost").second == false);
+
+    // Nothing of asset 2 changes and no asset is added or removed
+    apply(R"(<ModOps>
+      <ModOp Type="merge" GUID="1" Path="/Values/Standard"><Standard><Name>Renamed</Name></Standard></ModOp>
+    </ModOps>)");
+    CHECK(select("//Asset[Values/Standard/GUID='2']") == std::make_pair(asset, true));
+    CHECK(select("//Asset[Values/Standard/GUID='2']/Values").second);
+    CHECK(select("Values/Standard/GUID", asset[0]).second);
+    CHECK(select("//Cost").second);
+
+    // Below asset 2 changes, which asset has GUID 2 does not
+    apply(R"(<ModOps>
+      <ModOp Type="add" GUID="2" Path="/Values"><Cost /></ModOp>
+    </ModOps>)");
+    CHECK(select("//Asset[Values/Standard/GUID='2']").second);
+    CHECK(select("//Asset[Values/Standard/GUID='2']/Values").second == false);
+    CHECK(select("Values/Standard/GUID", asset[0]).second == false);
+    const auto [costs, cached] = select("//Cost");
+    CHECK_FALSE(cached);
+    CHECK(costs.size() == 3);
+
+    apply(R"(<ModOps>
+      <ModOp Type="merge" GUID="3" Path="/Values/Standard"><GUID>2</GUID></ModOp>
+    </ModOps>)");
+    const auto [renumbered, renumbered_cached] = select("//Asset[Values/Standard/GUID='2']");
+    CHECK_FALSE(renumbered_cached);
+    CHECK(renumbered.size() == 2);
+
+    apply(R"(<ModOps>
+      <ModOp Type="remove" Path="//Asset[Values/Standard/GUID='2']" />
+    </ModOps>)");
+    CHECK(select("//Asset[Values/Standard/GUID='2']").first.empty());
+    CHECK(select("Values/Standard/GUID", asset[0]).second == false);
+    CHECK(arena->CacheMisses() > 0);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "pugixml.hpp"
+
+#include "xml_operations.h"
+
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+inline std::shared_ptr<pugi::xml_document> Load(const std::string &xml)
+{
+    auto doc = std::make_shared<pugi::xml_document>();
+    REQUIRE(doc->load_string(xml.c_str()));
+    return doc;
+}
+
+inline std::string Print(const pugi::xml_document &doc)
+{
+    std::stringstream ss;
+    doc.print(ss, "", pugi::format_raw);
+    return ss.str();
+}
+
+// Applies `patches` to `input` one after the other, the way the loader does without any caching
+inline std::string Replay(const std::string &input, const std::vector<const char *> &patches)
+{
+    auto doc = Load(input);
+    for (auto patch : patches) {
+        for (auto &&operation : XmlOperation::GetXmlOperations(Load(patch))) {
+            operation.Apply(doc);
+        }
+    }
+    return Print(*doc);
+}
@@ -0,0 +1,109 @@
+#include "helpers.h"
+#include "xml_journal.h"
+#include "xml_operations.h"
+
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr auto INPUT = R"(<Assets>
+  <Asset><Values><Standard><GUID>1</GUID><Name>One</Name></Standard></Values></Asset>
+  <Asset><Values><Standard><GUID>2</GUID><Name>Two</Name></Standard><Cost Amount="5" /></Values></Asset>
+  <Asset><Values><Standard><GUID>3</GUID><Name>Three</Name></Standard></Values></Asset>
+</Assets>)";
+
+constexpr auto PATCH_A = R"(<ModOps>
+  <ModOp Type="merge" GUID="1" Path="/Values/Standard"><Standard><Name>Uno</Name></Standard></ModOp>
+  <ModOp Type="add" GUID="1" Path="/Values"><Extra Value="a" /></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_A_EDITED = R"(<ModOps>
+  <ModOp Type="merge" GUID="1" Path="/Values/Standard"><Standard><Name>Eins</Name></Standard></ModOp>
+  <ModOp Type="add" GUID="1" Path="/Values"><Extra Value="b" /></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_B = R"(<ModOps>
+  <ModOp Type="remove" GUID="2" Path="/Values/Standard/Name" />
+  <ModOp Type="merge" GUID="2" Path="/Values/Cost"><Cost Amount="10" Extra="1" /></ModOp>
+  <ModOp Type="replace" GUID="3" Path="/Values/Standard/Name"><Name>Drei</Name></ModOp>
+  <ModOp Type="addNextSibling" GUID="3" Path="/Values/Standard"><Flag /></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_C = R"(<ModOps>
+  <ModOp Type="merge" GUID="1" Path="/Values/Extra"><Extra Value="c" /></ModOp>
+</ModOps>)";
+
+void Apply(std::shared_ptr<pugi::xml_document> doc, const char *patch,
+           XmlJournal *journal = nullptr)
+{
+    for (auto &&operation : XmlOperation::GetXmlOperations(Load(patch))) {
+        operation.Apply(doc, {journal});
+    }
+}
+} // namespace
+
+TEST_CASE("Journal rolls every change back")
+{
+    auto       doc      = Load(INPUT);
+    const auto original = Print(*doc);
+
+    XmlJournal journal;
+    const auto segment = journal.Begin("all");
+    Apply(doc, PATCH_A, &journal);
+    Apply(doc, PATCH_B, &journal);
+    Apply(doc, PATCH_C, &journal);
+    REQUIRE(Print(*doc) == Replay(INPUT, {PATCH_A, PATCH_B, PATCH_C}));
+    CHECK(journal.Changes(segment) > 0);
+
+    CHECK(journal.Rollback(segment).empty());
+    CHECK(Print(*doc) == original);
+    CHECK(journal.Changes(segment) == 0);
+}
+
+TEST_CASE("Journal rolls back a single patch and keeps unrelated ones")
+{
+    auto       doc = Load(INPUT);
+    XmlJournal journal;
+    const auto a = journal.Begin("a");
+    Apply(doc, PATCH_A, &journal);
+    journal.Begin("b");
+    Apply(doc, PATCH_B, &journal);
+    const auto c = journal.Begin("c");
+    Apply(doc, PATCH_C, &journal);
+
+    // `c` merges into the node `a` added, `b` touches other assets
+    const auto reapply = journal.Rollback(a);
+    CHECK(reapply == std::vector<size_t>{c});
+    CHECK(Print(*doc) == Replay(INPUT, {PATCH_B}));
+
+    // Edit `a`, then bring back whatever depended on it
+    journal.Reopen(a);
+    Apply(doc, PATCH_A_EDITED, &journal);
+    for (auto segment : reapply) {
+        journal.Reopen(segment);
+        Apply(doc, PATCH_C, &journal);
+    }
+    CHECK(Print(*doc) == Replay(INPUT, {PATCH_A_EDITED, PATCH_B, PATCH_C}));
+}
+
+TEST_CASE("Journal restores removed nodes changed before")
+{
+    auto       doc = Load(INPUT);
+    XmlJournal journal;
+    const auto b   = journal.Begin("b");
+    Apply(doc, PATCH_B, &journal);
+    const auto remove = journal.Begin("remove");
+    Apply(doc, R"(<ModOps><ModOp Type="remove" GUID="2" /></ModOps>)", &journal);
+    CHECK(Print(*doc) ==
+          Replay(INPUT, {PATCH_B, R"(<ModOps><ModOp Type="remove" GUID="2" /></ModOps>)"}));
+
+    // The asset comes back with the changes of `b`, which can then be rolled back as well
+    CHECK(journal.Rollback(remove).empty());
+    CHECK(Print(*doc) == Replay(INPUT, {PATCH_B}));
+    CHECK(journal.Rollback(b).empty());
+    CHECK(Print(*doc) == Replay(INPUT, {}));
+}
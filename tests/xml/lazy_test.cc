@@ -0,0 +1,135 @@
+#include "helpers.h"
+#include "xml_lazy_document.h"
+#include "xml_operations.h"
+#include "xml_parts.h"
+
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr auto INPUT = R"(<?xml version="1.0" encoding="utf-8"?>
+<AssetList>
+  <Groups>
+    <Group>
+      <Assets>
+        <Asset>
+          <Template>Building</Template>
+          <Values><Standard><GUID>1</GUID><Name>One &amp; only</Name></Standard><Cost Amount="1" /></Values>
+        </Asset>
+        <Asset>
+          <Values><Standard><GUID>2</GUID></Standard></Values>
+          <Assets><Asset><Values><Standard><GUID>20</GUID></Standard></Values></Asset></Assets>
+        </Asset>
+        <!-- <Asset> -->
+        <Asset><Values><Standard><GUID>3</GUID></Standard></Values></Asset>
+      </Assets>
+    </Group>
+  </Groups>
+  <Templates>
+    <Template><Name>Building</Name><Properties><Cost /></Properties></Template>
+  </Templates>
+</AssetList>
+)";
+
+// Applies `patch` to the whole input and to a lazy one, both have to come out the same
+void Compare(const char *patch, size_t parsed)
+{
+    const auto operations = Load(patch);
+
+    auto doc = Load(INPUT);
+    for (auto &&operation : XmlOperation::GetXmlOperations(operations)) {
+        operation.Apply(doc);
+    }
+
+    auto lazy = XmlLazyDocument::Scan(INPUT, 2);
+    REQUIRE(lazy);
+    auto lazy_operations = XmlOperation::GetXmlOperations(operations);
+    lazy->ApplyAll(lazy_operations);
+    CHECK(lazy->Parsed() == parsed);
+    CHECK(Print(*Load(lazy->Print())) == Print(*doc));
+}
+} // namespace
+
+TEST_CASE("Untouched documents are printed as they are")
+{
+    auto lazy = XmlLazyDocument::Scan(INPUT);
+    REQUIRE(lazy);
+    CHECK(lazy->Print() == INPUT);
+    CHECK(lazy->Parsed() == 0);
+}
+
+TEST_CASE("Documents open with an index scanned before")
+{
+    auto index = XmlPartIndex::Scan(INPUT);
+    REQUIRE(index);
+    auto loaded = XmlPartIndex::Load(index->Save());
+    REQUIRE(loaded);
+    CHECK_FALSE(XmlLazyDocument::Open("<AssetList />", *loaded));
+
+    auto lazy = XmlLazyDocument::Open(INPUT, std::move(*loaded));
+    REQUIRE(lazy);
+    auto operations = XmlOperation::GetXmlOperations(Load(
+        R"(<ModOps><ModOp Type="add" GUID="3" Path="/Values"><Added /></ModOp></ModOps>)"));
+    lazy->ApplyAll(operations);
+    CHECK(lazy->Parsed() == 1);
+    const auto added = "<GUID>3</GUID></Standard>" + Print(*Load("<Added/>")) + "</Values>";
+    CHECK(lazy->Print().find(added) != std::string::npos);
+}
+
+TEST_CASE("Only assets ops go to are parsed")
+{
+    Compare(R"(<ModOps>
+      <ModOp Type="merge" GUID="1" Path="/Values/Cost"><Cost Amount="2" /></ModOp>
+      <ModOp Type="add" GUID="20" Path="/Values"><Nested /></ModOp>
+      <ModOp Type="addNextSibling" GUID="1"><Marker /></ModOp>
+      <ModOp Type="add" GUID="404" Path="/Values"><Missing /></ModOp>
+    </ModOps>)",
+            2);
+    Compare(R"(<ModOps>
+      <ModOp Type="remove" GUID="3" />
+      <ModOp Type="add" Template="Building" Path="/Properties"><Upkeep /></ModOp>
+    </ModOps>)",
+            2);
+}
+
+TEST_CASE("Ops that may reach anywhere parse the whole document")
+{
+    Compare(R"(<ModOps>
+      <ModOp Type="merge" GUID="1" Path="/Values/Cost"><Cost Amount="2" /></ModOp>
+      <ModOp Type="add" Path="//Asset[Values/Cost[@Amount='2']]/Values"><Seen /></ModOp>
+      <ModOp Type="add" GUID="2" Path="/Values"><After /></ModOp>
+    </ModOps>)",
+            4);
+}
+
+TEST_CASE("Assets that do not parse on their own parse the whole document")
+{
+    // Scanning does not look at attributes, the missing quotes are left to pugixml
+    constexpr auto broken = R"(<AssetList><Assets>
+  <Asset><Values><Standard><GUID>1</GUID></Standard></Values></Asset>
+  <Asset><Values><Standard><GUID>2</GUID></Standard><Cost Amount=5 /></Values></Asset>
+</Assets></AssetList>)";
+    const auto     patch  = Load(R"(<ModOps>
+      <ModOp Type="add" GUID="1" Path="/Values"><One /></ModOp>
+      <ModOp Type="add" GUID="2" Path="/Values"><Two /></ModOp>
+    </ModOps>)");
+
+    // What the loader gets without a lazy document
+    auto doc = std::make_shared<pugi::xml_document>();
+    CHECK_FALSE(doc->load_string(broken));
+    for (auto &&operation : XmlOperation::GetXmlOperations(patch)) {
+        operation.Apply(doc);
+    }
+
+    auto lazy = XmlLazyDocument::Scan(broken, 2);
+    REQUIRE(lazy);
+    auto operations = XmlOperation::GetXmlOperations(patch);
+    lazy->ApplyAll(operations);
+    CHECK(lazy->Parsed() == 2);
+    CHECK(lazy->Print() == Print(*doc));
+    CHECK(lazy->Print().find("<GUID>2</GUID>") != std::string::npos);
+}
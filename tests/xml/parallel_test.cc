@@ -0,0 +1,130 @@
+#include "helpers.h"
+#include "xml_operations.h"
+
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+std::string Asset(int guid, const std::string &inner = "")
+{
+    return "<Asset><Values><Standard><GUID>" + std::to_string(guid) + "</GUID><Name>A"
+           + std::to_string(guid) + "</Name></Standard><Cost Amount=\"1\" /></Values>" + inner
+           + "</Asset>";
+}
+
+std::string Input()
+{
+    std::string xml = "<AssetList><Groups>";
+    for (int group = 0; group < 3; ++group) {
+        xml += "<Group><Assets>";
+        for (int i = 0; i < 20; ++i) {
+            const auto guid = group * 100 + i;
+            xml += guid == 5 ? Asset(guid, "<Assets>" + Asset(900) + "</Assets>") : Asset(guid);
+        }
+        xml += "</Assets></Group>";
+    }
+    xml += "</Groups><Templates><Template><Name>Building</Name><Properties><Cost /></Properties>"
+           "</Template><Template><Name>Ship</Name><Properties /></Template></Templates>"
+           "</AssetList>";
+    return xml;
+}
+
+std::string Patch()
+{
+    std::string xml = "<ModOps>";
+    for (int round = 0; round < 3; ++round) {
+        for (int group = 0; group < 3; ++group) {
+            for (int i = round; i < 20; i += 3) {
+                const auto guid = std::to_string(group * 100 + i);
+                xml += "<ModOp Type=\"merge\" GUID=\"" + guid
+                       + "\" Path=\"/Values/Cost\"><Cost Amount=\"" + std::to_string(round + 2)
+                       + "\" /></ModOp>";
+                xml += "<ModOp Type=\"add\" GUID=\"" + guid + "\" Path=\"/Values\"><Round"
+                       + std::to_string(round) + " /></ModOp>";
+            }
+        }
+        // Runs are cut at ops that may reach anywhere
+        xml += R"(<ModOp Type="add" Path="//Asset[Values/Cost[@Amount='3']]/Values"><Seen /></ModOp>)";
+    }
+    xml += R"(
+      <ModOp Type="merge" GUID="900" Path="/Values/Standard"><Standard><Name>Nested</Name></Standard></ModOp>
+      <ModOp Type="add" GUID="5" Path="/Values"><Outer /></ModOp>
+      <ModOp Type="remove" GUID="7" />
+      <ModOp Type="addNextSibling" GUID="8"><Marker /></ModOp>
+      <ModOp Type="replace" GUID="9" Path="/Values/Standard/Name"><Name>Replaced</Name></ModOp>
+      <ModOp Type="merge" GUID="404" Path="/Values/Cost"><Cost Amount="9" /></ModOp>
+      <ModOp Type="add" Template="Building" Path="/Properties"><Upkeep /></ModOp>
+      <ModOp Type="merge" Template="Ship" Path="/Properties"><Properties Speed="2" /></ModOp>
+      <ModOp Type="merge" GUID="10" Path="/Values/Standard"><Standard><GUID>10000</GUID></Standard></ModOp>
+      <ModOp Type="add" GUID="10000" Path="/Values"><Renamed /></ModOp>
+      <ModOp Type="add" GUID="11" Path="/Values"><Eleven /></ModOp>
+      <ModOp Type="add" GUID="12" Path="/Values"><Twelve /></ModOp>
+    </ModOps>)";
+    return xml;
+}
+} // namespace
+
+TEST_CASE("Ops are confined to the asset or template they target")
+{
+    auto operations = XmlOperation::GetXmlOperations(Load(R"(<ModOps>
+      <ModOp Type="merge" GUID="1" Path="/Values/Cost"><Cost Amount="2" /></ModOp>
+      <ModOp Type="add" Template="Ship" Path="/Properties"><Speed /></ModOp>
+      <ModOp Type="add" Path="//Asset[Values/Standard/GUID='1']/Values"><Extra /></ModOp>
+      <ModOp Type="add" Path="//Assets[Asset/Values/Standard/GUID='1']"><Asset /></ModOp>
+      <ModOp Type="add" GUID="1" Path="/Values/../.."><Extra /></ModOp>
+      <ModOp Type="merge" GUID="1" Path="/Values/Standard"><Standard><GUID>2</GUID></Standard></ModOp>
+      <ModOp Type="remove" GUID="1" Path="/Values/Standard" />
+      <ModOp Type="add" GUID="1" Path="/Values[/AssetList]"><Extra /></ModOp>
+      <ModOp Type="add" GUID="1" Path="/Values" Skip="1"><Extra /></ModOp>
+    </ModOps>)"));
+    REQUIRE(operations.size() == 9);
+    CHECK(operations[0].Confinement() == "asset:1");
+    CHECK(operations[1].Confinement() == "template:Ship");
+    for (size_t i = 2; i < 8; ++i) {
+        INFO(i);
+        CHECK(operations[i].Confinement() == XmlFootprint::EVERYTHING);
+    }
+    CHECK(operations[8].Confinement().empty());
+}
+
+TEST_CASE("Applying ops concurrently matches load order")
+{
+    const auto input = Input();
+    const auto patch = Load(Patch());
+
+    auto sequential = Load(input);
+    for (auto &&operation : XmlOperation::GetXmlOperations(patch)) {
+        operation.Apply(sequential);
+    }
+
+    for (size_t threads : {1, 2, 4, 16}) {
+        INFO(threads);
+        auto doc        = Load(input);
+        auto operations = XmlOperation::GetXmlOperations(patch);
+        XmlOperation::ApplyAll(doc, operations, {}, threads);
+        CHECK(Print(*doc) == Print(*sequential));
+    }
+}
+
+TEST_CASE("Duplicate GUIDs are applied in load order")
+{
+    const auto input = "<Assets>" + Asset(1) + Asset(2) + Asset(1) + "</Assets>";
+    const auto patch = Load(R"(<ModOps>
+      <ModOp Type="add" GUID="1" Path="/Values"><First /></ModOp>
+      <ModOp Type="add" GUID="2" Path="/Values"><Second /></ModOp>
+      <ModOp Type="add" GUID="1" Path="/Values/Cost"><Third /></ModOp>
+    </ModOps>)");
+
+    auto sequential = Load(input);
+    for (auto &&operation : XmlOperation::GetXmlOperations(patch)) {
+        operation.Apply(sequential);
+    }
+    auto doc        = Load(input);
+    auto operations = XmlOperation::GetXmlOperations(patch);
+    XmlOperation::ApplyAll(doc, operations, {}, 4);
+    CHECK(Print(*doc) == Print(*sequential));
+}
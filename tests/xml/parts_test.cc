@@ -0,0 +1,127 @@
+#include "xml_parts.h"
+
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr auto INPUT = R"(<?xml version="1.0" encoding="utf-8"?>
+<AssetList>
+  <Groups>
+    <Group>
+      <Assets>
+        <Asset>
+          <Template>Building</Template>
+          <Values><Standard><GUID>1</GUID><Name>One &amp; only</Name></Standard></Values>
+        </Asset>
+        <Asset>
+          <Values><Standard><GUID>2</GUID></Standard></Values>
+          <Assets><Asset><Values><Standard><GUID>20</GUID></Standard></Values></Asset></Assets>
+        </Asset>
+        <!-- <Asset> -->
+        <Asset><Values><Standard><GUID>3</GUID></Standard></Values></Asset>
+      </Assets>
+    </Group>
+  </Groups>
+  <Templates>
+    <Template><Name>Building</Name><Properties><Cost /></Properties></Template>
+  </Templates>
+</AssetList>
+)";
+} // namespace
+
+TEST_CASE("Scanning finds assets and templates without parsing")
+{
+    const std::string input = INPUT;
+    auto              index = XmlPartIndex::Scan(input);
+    REQUIRE(index);
+    REQUIRE(index->parts.size() == 4);
+    CHECK(input.substr(index->parts[0].begin, 7) == "<Asset>");
+    CHECK(input.substr(index->parts[3].end - 11) == "</Template>\n  </Templates>\n</AssetList>\n");
+    CHECK(index->Find("asset:1") == 0);
+    CHECK(index->Find("asset:20") == 1);
+    CHECK(index->Find("asset:3") == 2);
+    CHECK(index->Find("template:Building") == 3);
+    CHECK(index->Find("asset:4") == XmlPartIndex::NOT_FOUND);
+    CHECK(index->keys.size() == 5);
+    CHECK(index->Count("Asset") == 4);
+    CHECK(index->Count("GUID") == 4);
+    CHECK(index->Count("Template") == 2);
+    CHECK(index->Count("Cost") == 1);
+    CHECK(index->Count("Missing") == 0);
+    CHECK(index->Extract(input, "asset:20")
+          == "<Asset><Values><Standard><GUID>20</GUID></Standard></Values></Asset>");
+    CHECK(index->Extract(input, "asset:3")
+          == "<Asset><Values><Standard><GUID>3</GUID></Standard></Values></Asset>");
+
+    auto duplicates = XmlPartIndex::Scan("<A><Asset><Values><Standard><GUID>1</GUID></Standard>"
+                                         "</Values></Asset><Asset><Values><Standard><GUID>1</GUID>"
+                                         "</Standard></Values></Asset></A>");
+    REQUIRE(duplicates);
+    CHECK(duplicates->Find("asset:1") == XmlPartIndex::DUPLICATE);
+    CHECK(duplicates->Extract("", "asset:1").empty());
+
+    CHECK_FALSE(XmlPartIndex::Scan("<A><Asset><Values><Standard><GUID>&#49;</GUID></Standard>"
+                                   "</Values></Asset></A>"));
+    CHECK_FALSE(XmlPartIndex::Scan("<A><Asset></A>"));
+    CHECK_FALSE(XmlPartIndex::Scan("<A><Asset Name=\"></Asset></A>"));
+}
+
+TEST_CASE("Scanning does not depend on where the markup is")
+{
+    // Moves tags and quotes across every offset the scanner compares at once
+    std::string              input = "<AssetList>";
+    std::vector<std::string> assets;
+    for (size_t i = 0; i < 70; ++i) {
+        input.append(i, ' ');
+        assets.push_back("<Asset Note='" + std::string(i % 7, '>') + "\"'><Values><Standard><GUID>"
+                         + std::to_string(i) + "</GUID></Standard></Values></Asset>");
+        input += assets.back();
+    }
+    input += "</AssetList>";
+
+    auto index = XmlPartIndex::Scan(input);
+    REQUIRE(index);
+    REQUIRE(index->parts.size() == assets.size());
+    for (size_t i = 0; i < assets.size(); ++i) {
+        CHECK(index->Find("asset:" + std::to_string(i)) == i);
+        CHECK(index->Extract(input, "asset:" + std::to_string(i)) == assets[i]);
+    }
+}
+
+TEST_CASE("Indexes survive saving and loading")
+{
+    const std::string input = INPUT;
+    auto              index = XmlPartIndex::Scan(input);
+    REQUIRE(index);
+
+    const auto data   = index->Save();
+    auto       loaded = XmlPartIndex::Load(data);
+    REQUIRE(loaded);
+    REQUIRE(loaded->parts.size() == index->parts.size());
+    for (size_t i = 0; i < index->parts.size(); ++i) {
+        CHECK(loaded->parts[i].begin == index->parts[i].begin);
+        CHECK(loaded->parts[i].end == index->parts[i].end);
+    }
+    REQUIRE(loaded->keys.size() == index->keys.size());
+    for (size_t i = 0; i < index->keys.size(); ++i) {
+        CHECK(loaded->keys[i].key == index->keys[i].key);
+        CHECK(loaded->Find(index->keys[i].key) == index->keys[i].part);
+        CHECK(loaded->Extract(input, index->keys[i].key)
+              == index->Extract(input, index->keys[i].key));
+    }
+    REQUIRE(loaded->names.size() == index->names.size());
+    for (const auto &entry : index->names) {
+        CHECK(loaded->Count(entry.name) == entry.count);
+    }
+    CHECK(loaded->Save() == data);
+
+    CHECK_FALSE(XmlPartIndex::Load(""));
+    CHECK_FALSE(XmlPartIndex::Load(data.substr(0, data.size() - 1)));
+    CHECK_FALSE(XmlPartIndex::Load(data + '\0'));
+    auto version = data;
+    version[4]++;
+    CHECK_FALSE(XmlPartIndex::Load(version));
+}
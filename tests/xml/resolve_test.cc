@@ -0,0 +1,159 @@
+#include "helpers.h"
+#include "xml_changes.h"
+#include "xml_operations.h"
+
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+using Names = std::unordered_set<std::string>;
+
+constexpr auto INPUT = R"(<AssetList><Groups><Group><Assets>
+  <Asset><Values><Standard><GUID>1</GUID><Name>One</Name></Standard><Cost Amount="1" /></Values></Asset>
+  <Asset><Values><Standard><GUID>2</GUID><Name>Two</Name></Standard><Cost Amount="2" /></Values></Asset>
+  <Asset><Values><Standard><GUID>3</GUID><Name>Three</Name></Standard></Values></Asset>
+</Assets></Group></Groups></AssetList>)";
+
+// Every op looks at something an op before it changed, or not
+constexpr auto PATCH = R"(<ModOps>
+  <ModOp Type="add" Path="//Asset[Values/Standard/GUID='1']/Values"><Flag /></ModOp>
+  <ModOp Type="add" Path="//Asset[Values/Flag]/Values"><Flagged /></ModOp>
+  <ModOp Type="merge" Path="//Asset[Values/Standard/Name='Two']/Values/Standard"><Standard><Name>Zwei</Name></Standard></ModOp>
+  <ModOp Type="add" Path="//Asset[Values/Standard/Name='Zwei']/Values"><Renamed /></ModOp>
+  <ModOp Type="merge" Path="//Asset[Values/Standard/GUID='2']/Values/Cost"><Cost Amount="5" /></ModOp>
+  <ModOp Type="add" Path="//Asset[Values/Cost[@Amount='5']]/Values"><Expensive /></ModOp>
+  <ModOp Type="remove" Path="//Asset[Values/Standard/GUID='3']" />
+  <ModOp Type="add" Path="//Asset[Values/Standard/GUID='3']/Values"><Gone /></ModOp>
+  <ModOp Type="add" GUID="1" Path="/Values"><Speculative /></ModOp>
+  <ModOp Type="add" Path="//Assets"><Asset><Values><Standard><GUID>4</GUID></Standard></Values></Asset></ModOp>
+  <ModOp Type="add" GUID="4" Path="/Values"><New /></ModOp>
+  <ModOp Type="add" Path="//Values/*[last()]"><Last /></ModOp>
+  <ModOp Type="add" Path="//Asset[Values/Standard/GUID='1'"><Broken /></ModOp>
+</ModOps>)";
+} // namespace
+
+TEST_CASE("Queries know the names they look at")
+{
+    XmlQuery guid("//Asset[Values/Standard/GUID='1']/Values/Cost");
+    CHECK(guid.names == Names{"Asset", "Values", "Standard", "GUID", "Cost"});
+    CHECK(guid.compared == Names{"GUID"});
+    CHECK(guid.attributes.empty());
+    CHECK_FALSE(guid.any_name);
+    CHECK_FALSE(guid.any_value);
+
+    XmlQuery attribute("//Values/Cost[@Amount > 2 and not(Extra)]");
+    CHECK(attribute.names == Names{"Values", "Cost", "Extra"});
+    CHECK(attribute.compared.empty());
+    CHECK(attribute.attributes == Names{"Amount"});
+
+    XmlQuery text("//Standard/Name/text()");
+    CHECK(text.names == Names{"Standard", "Name", "#text"});
+
+    CHECK(XmlQuery("//Values/*[1]").any_name);
+    CHECK(XmlQuery("//Name[contains(., 'x')]").any_value);
+    CHECK(XmlQuery("//Name[. = 'x']").any_value);
+    CHECK(XmlQuery("//Standard['x' = Name]").compared == Names{"Name"});
+    CHECK_FALSE(XmlQuery("//Cost[position() = last() - 1]").any_value);
+}
+
+TEST_CASE("Changes only affect queries that look at them")
+{
+    auto doc    = Load(INPUT);
+    auto values = doc->child("AssetList").child("Groups").child("Group").child("Assets").child(
+        "Asset").child("Values");
+
+    XmlQuery guid("//Asset[Values/Standard/GUID='1']/Values/Cost");
+    XmlQuery name("//Asset[Values/Standard/Name='One']");
+    XmlQuery amount("//Cost[@Amount='1']");
+
+    XmlChanges merged;
+    merged.ChangingAttribute("Level");
+    merged.ChangingValue(values.child("Standard").child("Name").first_child());
+    CHECK_FALSE(merged.Affects(guid));
+    CHECK(merged.Affects(name));
+    CHECK_FALSE(merged.Affects(amount));
+    merged.ChangingAttribute("Amount");
+    CHECK(merged.Affects(amount));
+
+    XmlChanges added;
+    added.Inserted(values.append_child("Extra"));
+    CHECK_FALSE(added.Affects(guid));
+    CHECK(added.Affects(XmlQuery("//Values[not(Extra)]")));
+    CHECK(added.Affects(XmlQuery("//Values/*[last()]")));
+
+    XmlChanges removed;
+    removed.Removing(values.child("Cost"));
+    CHECK(removed.Affects(guid));
+    CHECK_FALSE(removed.Affects(name));
+}
+
+TEST_CASE("Resolving targets up front matches load order")
+{
+    const auto patch = Load(PATCH);
+
+    auto sequential = Load(INPUT);
+    for (auto &&operation : XmlOperation::GetXmlOperations(patch)) {
+        operation.Apply(sequential);
+    }
+
+    for (size_t threads : {1, 2, 8}) {
+        INFO(threads);
+        auto doc        = Load(INPUT);
+        auto operations = XmlOperation::GetXmlOperations(patch);
+        XmlOperation::ApplyAll(doc, operations, {}, threads);
+        CHECK(Print(*doc) == Print(*sequential));
+    }
+}
+
+TEST_CASE("Resolve does not change the document")
+{
+    auto       doc    = Load(INPUT);
+    const auto before = Print(*doc);
+    for (auto &&operation : XmlOperation::GetXmlOperations(Load(PATCH))) {
+        operation.Resolve(doc);
+    }
+    CHECK(Print(*doc) == before);
+}
+
+TEST_CASE("Resolve tells whether the path below the asset found the targets")
+{
+    auto doc = Load(INPUT);
+    auto ops = XmlOperation::GetXmlOperations(Load(R"(<ModOps>
+  <ModOp Type="add" GUID="1" Path="/Values"><Found /></ModOp>
+  <ModOp Type="add" GUID="1" Path="/Missing"><Lost /></ModOp>
+  <ModOp Type="add" Path="//Asset[Values/Standard/GUID='2']/Values"><Plain /></ModOp>
+</ModOps>)"));
+    REQUIRE(ops.size() == 3);
+
+    CHECK(ops[0].Resolve(doc)->size() == 1);
+    CHECK(ops[0].LastLookup() == XmlPlan::RelativeXPath);
+    CHECK(ops[1].Resolve(doc)->empty());
+    CHECK(ops[1].LastLookup() == XmlPlan::FullScan);
+    CHECK(ops[2].Resolve(doc)->size() == 1);
+    CHECK(ops[2].LastLookup() == XmlPlan::FullScan);
+}
+
+TEST_CASE("guid() paths with a condition or // are looked up below the asset")
+{
+    auto doc = Load(INPUT);
+    auto ops = XmlOperation::GetXmlOperations(Load(R"(<ModOps>
+  <ModOp Type="add" Path="guid('1')[Values/Cost]//Standard"><Found /></ModOp>
+  <ModOp Type="add" Path="guid('3')[Values/Cost]"><Lost /></ModOp>
+</ModOps>)"));
+    REQUIRE(ops.size() == 2);
+
+    CHECK(ops[0].GetPath() == "//Asset[Values/Standard/GUID='1'][Values/Cost]//Standard");
+    CHECK(ops[0].Confinement() == XmlFootprint::Asset("1"));
+    const auto found = ops[0].Resolve(doc);
+    REQUIRE(found->size() == 1);
+    CHECK(std::string(found->first().node().child_value("GUID")) == "1");
+    CHECK(ops[0].LastLookup() == XmlPlan::RelativeXPath);
+
+    CHECK(ops[1].Resolve(doc)->empty());
+    CHECK(ops[1].LastLookup() == XmlPlan::FullScan);
+}
@@ -1,5 +1,6 @@
 #include "pugixml.hpp"
 
+#include "xml_arena_document.h"
 #include "xml_operations.h"
 
 #include "catch2/catch.hpp"
@@ -7,8 +8,10 @@
 #include <vector>
 #include <string_view>
 #include <cstring>
+#include <fstream>
 #include <sstream>
 #include <memory>
+#include <optional>
 
 class TestRunner
 {
@@ -21,11 +24,27 @@ public:
             input_doc_ = std::make_shared<pugi::xml_document>();
             input_doc_->load_file(input.data());
         }
+        {
+            std::ifstream file(input.data(), std::ios::binary);
+            std::stringstream ss;
+            ss << file.rdbuf();
+            arena_doc_ = XmlArenaDocument::Parse(ss.str());
+        }
     }
 
+    // Also applies the patches to an arena document, which has to come out the same unless it
+    // could not take some of them
     void ApplyPatches() {
         for (auto &&operation : xml_operations_) {
             operation.Apply(input_doc_);
+            if (arena_doc_ && !operation.Apply(*arena_doc_)) {
+                arena_doc_.reset();
+            }
+        }
+        if (arena_doc_) {
+            std::stringstream ss;
+            input_doc_->print(ss, "", pugi::format_raw);
+            CHECK(arena_doc_->Print() == ss.str());
         }
     }
 
@@ -54,4 +73,5 @@ public:
 private:
     std::vector<XmlOperation> xml_operations_;
     std::shared_ptr<pugi::xml_document> input_doc_ = nullptr;
+    std::optional<XmlArenaDocument> arena_doc_;
 };
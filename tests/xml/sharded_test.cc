@@ -0,0 +1,163 @@
+#include "helpers.h"
+#include "xml_operations.h"
+#include "xml_parts.h"
+#include "xml_sharded_document.h"
+
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+std::string Asset(int guid, const std::string &inner = "")
+{
+    return "<Asset>\n  <Values><Standard><GUID>" + std::to_string(guid)
+           + "</GUID><Name>A &amp; " + std::to_string(guid)
+           + "</Name></Standard><Cost Amount=\"1\" Note=\"a > b / c\" /></Values>" + inner
+           + "</Asset>\n";
+}
+
+std::string Input()
+{
+    std::string xml = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<!-- <Group> -->\n"
+                      "<AssetList>\n  <Groups>\n";
+    for (int group = 0; group < 4; ++group) {
+        xml += "    <Group><Name>G" + std::to_string(group) + "</Name><Groups><Group><Assets>";
+        for (int i = 0; i < 10; ++i) {
+            const auto guid = group * 100 + i;
+            xml += guid == 5 ? Asset(guid, "<Assets>" + Asset(900) + "</Assets>") : Asset(guid);
+        }
+        xml += "</Assets></Group></Groups><![CDATA[</Group>]]></Group>\n";
+    }
+    xml += "  <Group />\n  </Groups>\n  " + Asset(1000)
+           + "  <Templates><Template><Name>Building</Name><Properties /></Template></Templates>\n"
+             "</AssetList>\n";
+    return xml;
+}
+
+// Applies `patch` to the whole input and to a sharded one, returns both printed
+std::pair<std::string, std::string> Compare(const std::string &patch, size_t &shards_left)
+{
+    const auto input      = Input();
+    const auto operations = Load(patch);
+
+    auto doc = Load(input);
+    for (auto &&operation : XmlOperation::GetXmlOperations(operations)) {
+        operation.Apply(doc);
+    }
+
+    auto sharded = XmlShardedDocument::Parse(input, 4);
+    REQUIRE(sharded);
+    auto sharded_operations = XmlOperation::GetXmlOperations(operations);
+    sharded->ApplyAll(sharded_operations);
+    shards_left = sharded->Shards();
+    return {Print(*doc), sharded->Print()};
+}
+} // namespace
+
+TEST_CASE("Sharded documents print like the whole document")
+{
+    const auto input   = Input();
+    auto       sharded = XmlShardedDocument::Parse(input, 4);
+    REQUIRE(sharded);
+    // The top-level groups, not the ones nested inside
+    CHECK(sharded->Shards() == 5);
+    CHECK(sharded->Print() == Print(*Load(input)));
+
+    CHECK(Print(*sharded->Materialize()) == Print(*Load(input)));
+    CHECK(sharded->Shards() == 0);
+    CHECK(sharded->Print() == Print(*Load(input)));
+}
+
+TEST_CASE("Documents that do not split are left alone")
+{
+    CHECK_FALSE(XmlShardedDocument::Parse("<AssetList><Groups><Group /></Groups></AssetList>"));
+    CHECK_FALSE(XmlShardedDocument::Parse("<A><Group><Group /></Group></A>"));
+    CHECK_FALSE(XmlShardedDocument::Parse("<A><Group></Group><Group></Group>"));
+    CHECK_FALSE(XmlShardedDocument::Parse("<A><Group></Group><Group></Grou></A>"));
+    CHECK_FALSE(XmlShardedDocument::Parse(
+        "<A><Group><ModLoaderShard /></Group><Group></Group><ModLoaderShard /></A>"));
+    CHECK(XmlShardedDocument::Parse("<A><Group></Group><Assets></Assets></A>"));
+}
+
+TEST_CASE("Ops confined to assets are routed to their shard")
+{
+    size_t shards     = 0;
+    auto [whole, cut] = Compare(R"(<ModOps>
+      <ModOp Type="merge" GUID="1" Path="/Values/Cost"><Cost Amount="2" /></ModOp>
+      <ModOp Type="add" GUID="101,202,303" Path="/Values"><Extra /></ModOp>
+      <ModOp Type="add" GUID="900" Path="/Values"><Nested /></ModOp>
+      <ModOp Type="remove" GUID="7" />
+      <ModOp Type="addNextSibling" GUID="8"><Marker /></ModOp>
+      <ModOp Type="add" GUID="1000" Path="/Values"><Skeleton /></ModOp>
+      <ModOp Type="add" GUID="404" Path="/Values"><Missing /></ModOp>
+      <ModOp Type="add" Template="Building" Path="/Properties"><Upkeep /></ModOp>
+    </ModOps>)",
+                                shards);
+    CHECK(cut == whole);
+    CHECK(shards == 5);
+}
+
+TEST_CASE("Sharded documents open with an index scanned before")
+{
+    const auto input = Input();
+    const auto patch = Load(R"(<ModOps>
+      <ModOp Type="add" GUID="101,202,303" Path="/Values"><Extra /></ModOp>
+      <ModOp Type="add" GUID="900" Path="/Values"><Nested /></ModOp>
+      <ModOp Type="add" GUID="1000" Path="/Values"><Skeleton /></ModOp>
+      <ModOp Type="add" Template="Building" Path="/Properties"><Upkeep /></ModOp>
+    </ModOps>)");
+
+    auto doc = Load(input);
+    for (auto &&operation : XmlOperation::GetXmlOperations(patch)) {
+        operation.Apply(doc);
+    }
+
+    // The second one was scanned from something else, the shards are looked through then
+    for (const auto &scanned : {input, " " + input}) {
+        const auto index = XmlPartIndex::Scan(scanned);
+        REQUIRE(index);
+        auto sharded = XmlShardedDocument::Open(input, *index, 4);
+        REQUIRE(sharded);
+        auto operations = XmlOperation::GetXmlOperations(patch);
+        sharded->ApplyAll(operations);
+        CHECK(sharded->Shards() == 5);
+        CHECK(sharded->Print() == Print(*doc));
+    }
+}
+
+TEST_CASE("Other ops join the shards first")
+{
+    size_t shards     = 0;
+    auto [whole, cut] = Compare(R"(<ModOps>
+      <ModOp Type="merge" GUID="1" Path="/Values/Cost"><Cost Amount="2" /></ModOp>
+      <ModOp Type="add" Path="//Asset[Values/Cost[@Amount='2']]/Values"><Seen /></ModOp>
+      <ModOp Type="add" GUID="2" Path="/Values"><After /></ModOp>
+    </ModOps>)",
+                                shards);
+    CHECK(cut == whole);
+    CHECK(shards == 0);
+}
+
+TEST_CASE("Duplicate GUIDs across shards join them first")
+{
+    const auto input = "<AssetList><Group>" + Asset(1) + "</Group><Group>" + Asset(2) + Asset(1)
+                       + "</Group></AssetList>";
+    const auto patch = Load(R"(<ModOps>
+      <ModOp Type="add" GUID="2" Path="/Values"><First /></ModOp>
+      <ModOp Type="add" GUID="1" Path="/Values"><Second /></ModOp>
+    </ModOps>)");
+
+    auto doc = Load(input);
+    for (auto &&operation : XmlOperation::GetXmlOperations(patch)) {
+        operation.Apply(doc);
+    }
+    auto sharded = XmlShardedDocument::Parse(input, 2);
+    REQUIRE(sharded);
+    auto operations = XmlOperation::GetXmlOperations(patch);
+    sharded->ApplyAll(operations);
+    CHECK(sharded->Shards() == 0);
+    CHECK(sharded->Print() == Print(*doc));
+}
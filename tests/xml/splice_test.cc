@@ -0,0 +1,189 @@
+#include "helpers.h"
+#include "xml_operations.h"
+#include "xml_splice.h"
+
+#include "catch2/catch.hpp"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr auto INPUT = R"(<Assets>
+  <Asset><Values><Standard><GUID>1</GUID><Name>One</Name></Standard></Values></Asset>
+  <Asset><Values><Standard><GUID>2</GUID><Name>Two</Name></Standard><Cost Amount="5" /></Values></Asset>
+  <Asset><Values><Standard><GUID>3</GUID><Name>Three</Name></Standard></Values></Asset>
+</Assets>)";
+
+constexpr auto PATCH_A = R"(<ModOps>
+  <ModOp Type="merge" GUID="1" Path="/Values/Standard"><Standard><Name>Uno</Name></Standard></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_A_EDITED = R"(<ModOps>
+  <ModOp Type="merge" GUID="1" Path="/Values/Standard"><Standard><Name>Eins</Name></Standard></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_B = R"(<ModOps>
+  <ModOp Type="add" Path="//Assets[Asset/Values/Standard/GUID='1']">
+    <Asset><Values><Standard><GUID>4</GUID><Name>Four</Name></Standard></Values></Asset>
+  </ModOp>
+  <ModOp Type="merge" GUID="2" Path="/Values/Cost"><Cost Amount="7" /></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_B_EDITED = R"(<ModOps>
+  <ModOp Type="add" Path="//Assets[Asset/Values/Standard/GUID='1']">
+    <Asset><Values><Standard><GUID>4</GUID><Name>Vier</Name></Standard></Values></Asset>
+    <Asset><Values><Standard><GUID>6</GUID><Name>Six</Name></Standard></Values></Asset>
+  </ModOp>
+  <ModOp Type="merge" GUID="2" Path="/Values/Cost"><Cost Amount="8" /></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_B_REMOVES = R"(<ModOps>
+  <ModOp Type="remove" GUID="3" />
+</ModOps>)";
+
+constexpr auto PATCH_C = R"(<ModOps>
+  <ModOp Type="merge" GUID="1" Path="/Values/Standard"><Standard><Name>Ein</Name></Standard></ModOp>
+  <ModOp Type="add" GUID="4" Path="/Values"><Extra /></ModOp>
+  <ModOp Type="merge" GUID="3" Path="/Values/Standard"><Standard><Name>Drei</Name></Standard></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_D = R"(<ModOps>
+  <ModOp Type="add" Path="//Assets[Asset/Values/Standard/GUID='2']">
+    <Asset><Values><Standard><GUID>5</GUID><Name>Five</Name></Standard></Values></Asset>
+  </ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_GUID = R"(<ModOps>
+  <ModOp Type="merge" GUID="3" Path="/Values/Standard"><Standard><GUID>7</GUID></Standard></ModOp>
+</ModOps>)";
+
+constexpr auto PATCH_XPATH = R"(<ModOps>
+  <ModOp Type="merge" Path="//Asset[Values/Standard/Name='Uno']/Values/Standard">
+    <Standard><Name>Found</Name></Standard>
+  </ModOp>
+</ModOps>)";
+
+std::vector<XmlOperation> Operations(const char *patch)
+{
+    return XmlOperation::GetXmlOperations(Load(patch));
+}
+
+std::vector<XmlFootprint> Apply(std::shared_ptr<pugi::xml_document> doc,
+                                std::vector<XmlOperation> &operations)
+{
+    std::vector<XmlFootprint> footprints(operations.size());
+    for (size_t i = 0; i < operations.size(); ++i) {
+        operations[i].Apply(doc, {nullptr, &footprints[i]});
+    }
+    return footprints;
+}
+
+// Patches `before` and `changed` on top of INPUT, then `after`, and splices in `edited`
+struct Chain {
+    std::shared_ptr<pugi::xml_document> base;
+    std::shared_ptr<pugi::xml_document> cached;
+    std::vector<XmlFootprint>           footprints;
+    std::vector<XmlOperation>           later;
+    std::vector<XmlFootprint>           later_footprints;
+
+    Chain(const std::vector<const char *> &before, const char *changed,
+          const std::vector<const char *> &after)
+    {
+        base = Load(INPUT);
+        for (auto patch : before) {
+            auto operations = Operations(patch);
+            Apply(base, operations);
+        }
+        cached = std::make_shared<pugi::xml_document>();
+        cached->reset(*base);
+        auto operations = Operations(changed);
+        footprints      = Apply(cached, operations);
+        for (auto patch : after) {
+            for (auto &&operation : Operations(patch)) {
+                later.emplace_back(std::move(operation));
+            }
+        }
+        later_footprints = Apply(cached, later);
+    }
+
+    std::optional<XmlSplice> Splice(const char *edited)
+    {
+        auto                        operations = Operations(edited);
+        std::vector<XmlOperation *> pointers;
+        for (auto &operation : later) {
+            pointers.push_back(&operation);
+        }
+        return XmlSplice::Apply(*base, *cached, footprints, operations, pointers,
+                                later_footprints);
+    }
+};
+} // namespace
+
+TEST_CASE("Footprints name the assets an op read and wrote")
+{
+    auto doc        = Load(INPUT);
+    auto operations = Operations(PATCH_B);
+    auto footprints = Apply(doc, operations);
+    REQUIRE(footprints.size() == 2);
+    CHECK(footprints[0].reads == std::set<std::string>{"asset:1"});
+    CHECK(footprints[0].writes == std::set<std::string>{"asset:4", "container:/Assets[1]"});
+    CHECK(footprints[1].reads == std::set<std::string>{"asset:2"});
+    CHECK(footprints[1].writes == std::set<std::string>{"asset:2"});
+
+    operations = Operations(PATCH_XPATH);
+    footprints = Apply(doc, operations);
+    CHECK_FALSE(footprints[0].Precise());
+
+    // Changing a GUID moves the change to a different asset
+    operations = Operations(PATCH_GUID);
+    footprints = Apply(doc, operations);
+    CHECK_FALSE(footprints[0].Precise());
+}
+
+TEST_CASE("Splicing a changed patch matches a full replay")
+{
+    Chain chain({PATCH_A}, PATCH_B, {PATCH_C, PATCH_D});
+
+    auto splice = chain.Splice(PATCH_B_EDITED);
+    REQUIRE(splice);
+    CHECK(Print(*splice->document) == Replay(INPUT, {PATCH_A, PATCH_B_EDITED, PATCH_C, PATCH_D}));
+    // Asset 4 in C and the new asset in D, which goes into the same container
+    CHECK(splice->rerun == 2);
+}
+
+TEST_CASE("Splicing only runs overlapping ops again")
+{
+    Chain chain({}, PATCH_A, {PATCH_D, PATCH_C});
+
+    auto splice = chain.Splice(PATCH_A_EDITED);
+    REQUIRE(splice);
+    CHECK(Print(*splice->document) == Replay(INPUT, {PATCH_A_EDITED, PATCH_D, PATCH_C}));
+    // Only the merge into asset 1 in C
+    CHECK(splice->rerun == 1);
+}
+
+TEST_CASE("Splicing handles removed assets")
+{
+    Chain chain({PATCH_A}, PATCH_B, {PATCH_C});
+
+    auto splice = chain.Splice(PATCH_B_REMOVES);
+    REQUIRE(splice);
+    CHECK(Print(*splice->document) == Replay(INPUT, {PATCH_A, PATCH_B_REMOVES, PATCH_C}));
+
+    // And back, with the footprints the splice recorded
+    chain.cached           = splice->document;
+    chain.footprints       = splice->footprints;
+    chain.later_footprints = splice->later_footprints;
+    splice                 = chain.Splice(PATCH_B);
+    REQUIRE(splice);
+    CHECK(Print(*splice->document) == Replay(INPUT, {PATCH_A, PATCH_B, PATCH_C}));
+}
+
+TEST_CASE("Splicing falls back when an op is not limited to assets")
+{
+    Chain chain({}, PATCH_A, {PATCH_XPATH});
+    CHECK_FALSE(chain.Splice(PATCH_B));
+}